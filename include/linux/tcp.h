@@ -119,6 +119,7 @@ struct tcp_request_sock {
 	const struct tcp_request_sock_ops *af_specific;
 	u64				snt_synack; /* first SYNACK sent time */
 	bool				tfo_listener;
+	bool				syncookie; /* answered with a syncookie */
 	bool				is_mptcp;
 #if IS_ENABLED(CONFIG_MPTCP)
 	bool				drop_req;
@@ -45,10 +45,13 @@ struct mptcp_out_options {
 #endif
 	};
 	u8 addr_id;
+	u16 port;
 	u64 ahmac;
 	u8 rm_id;
 	u8 join_id;
 	u8 backup;
+	u8 reset_reason:4,
+	   reset_transient:1;
 	u32 nonce;
 	u64 thmac;
 	u32 token;
@@ -77,6 +80,8 @@ static inline bool rsk_drop_req(const struct request_sock *req)
 }
 
 void mptcp_space(const struct sock *ssk, int *space, int *full_space);
+struct sock *mptcp_reuseport_select_sock(struct sock *sk, struct sk_buff *skb,
+					 int doff);
 bool mptcp_syn_options(struct sock *sk, const struct sk_buff *skb,
 		       unsigned int *size, struct mptcp_out_options *opts);
 bool mptcp_synack_options(const struct request_sock *req, unsigned int *size,
@@ -86,6 +91,7 @@ bool mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 			       struct mptcp_out_options *opts);
 void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb,
 			    struct tcp_options_received *opt_rx);
+void mptcp_incoming_reset(struct sock *sk, const struct sk_buff *skb);
 
 void mptcp_write_options(__be32 *ptr, struct mptcp_out_options *opts);
 
@@ -130,6 +136,11 @@ static inline bool mptcp_skb_can_collapse(const struct sk_buff *to,
 }
 
 void mptcp_seq_show(struct seq_file *seq);
+int mptcp_subflow_init_cookie_req(struct request_sock *req,
+				  const struct sock *sk_listener,
+				  struct sk_buff *skb);
+
+extern struct request_sock_ops mptcp_subflow_request_sock_ops;
 #else
 
 static inline void mptcp_init(void)
@@ -186,6 +197,11 @@ static inline void mptcp_incoming_options(struct sock *sk,
 {
 }
 
+static inline void mptcp_incoming_reset(struct sock *sk,
+					const struct sk_buff *skb)
+{
+}
+
 static inline void mptcp_skb_ext_move(struct sk_buff *to,
 				      const struct sk_buff *from)
 {
@@ -198,7 +214,22 @@ static inline bool mptcp_skb_can_collapse(const struct sk_buff *to,
 }
 
 static inline void mptcp_space(const struct sock *ssk, int *s, int *fs) { }
+
+static inline struct sock *mptcp_reuseport_select_sock(struct sock *sk,
+							struct sk_buff *skb,
+							int doff)
+{
+	return NULL;
+}
+
 static inline void mptcp_seq_show(struct seq_file *seq) { }
+
+static inline int mptcp_subflow_init_cookie_req(struct request_sock *req,
+						const struct sock *sk_listener,
+						struct sk_buff *skb)
+{
+	return 0; /* TCP fallback */
+}
 #endif /* CONFIG_MPTCP */
 
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
@@ -1208,7 +1208,8 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 	case SO_ZEROCOPY:
 		if (sk->sk_family == PF_INET || sk->sk_family == PF_INET6) {
 			if (!((sk->sk_type == SOCK_STREAM &&
-			       sk->sk_protocol == IPPROTO_TCP) ||
+			       (sk->sk_protocol == IPPROTO_TCP ||
+				sk->sk_protocol == IPPROTO_MPTCP)) ||
 			      (sk->sk_type == SOCK_DGRAM &&
 			       sk->sk_protocol == IPPROTO_UDP)))
 				ret = -ENOTSUPP;
@@ -273,6 +273,11 @@ static struct sock *inet_lhash2_lookup(struct net *net,
 				      dif, sdif, exact_dif);
 		if (score > hiscore) {
 			if (sk->sk_reuseport) {
+				result = mptcp_reuseport_select_sock(sk, skb,
+								     doff);
+				if (result)
+					return result;
+
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
 				result = reuseport_select_sock(sk, phash,
@@ -212,6 +212,13 @@ struct sock *tcp_get_cookie_sock(struct sock *sk, struct sk_buff *skb,
 		refcount_set(&req->rsk_refcnt, 1);
 		tcp_sk(child)->tsoffset = tsoff;
 		sock_rps_save_rxhash(child, skb);
+
+		/* MP_JOIN subflows are not queued to the listener */
+		if (rsk_drop_req(req)) {
+			reqsk_put(req);
+			return child;
+		}
+
 		if (inet_csk_reqsk_queue_add(sk, req, child))
 			return child;
 
@@ -224,6 +231,47 @@ struct sock *tcp_get_cookie_sock(struct sock *sk, struct sk_buff *skb,
 }
 EXPORT_SYMBOL(tcp_get_cookie_sock);
 
+/**
+ * cookie_tcp_reqsk_alloc - allocate a request socket for a valid cookie ACK
+ * @ops: the request sock ops of the address family
+ * @sk: the listener
+ * @skb: the ACK carrying the cookie
+ *
+ * MPTCP listeners need the larger MPTCP request socket, whose state is
+ * rebuilt from the options carried by the ACK.
+ */
+struct request_sock *cookie_tcp_reqsk_alloc(const struct request_sock_ops *ops,
+					    struct sock *sk,
+					    struct sk_buff *skb)
+{
+	struct tcp_request_sock *treq;
+	struct request_sock *req;
+
+#if IS_ENABLED(CONFIG_MPTCP)
+	if (sk_is_mptcp(sk))
+		ops = &mptcp_subflow_request_sock_ops;
+#endif
+
+	req = inet_reqsk_alloc(ops, sk, false);
+	if (!req)
+		return NULL;
+
+	treq = tcp_rsk(req);
+	treq->syncookie = 1;
+#if IS_ENABLED(CONFIG_MPTCP)
+	treq->is_mptcp = sk_is_mptcp(sk);
+	treq->drop_req = false;
+	if (treq->is_mptcp &&
+	    mptcp_subflow_init_cookie_req(req, sk, skb)) {
+		reqsk_free(req);
+		return NULL;
+	}
+#endif
+
+	return req;
+}
+EXPORT_SYMBOL_GPL(cookie_tcp_reqsk_alloc);
+
 /*
  * when syncookies are in effect and tcp timestamps are enabled we stored
  * additional tcp options in the timestamp.
@@ -326,7 +374,7 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb)
 		goto out;
 
 	ret = NULL;
-	req = inet_reqsk_alloc(&tcp_request_sock_ops, sk, false); /* for safety */
+	req = cookie_tcp_reqsk_alloc(&tcp_request_sock_ops, sk, skb);
 	if (!req)
 		goto out;
 
@@ -350,9 +398,6 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb)
 	treq->snt_synack	= 0;
 	treq->tfo_listener	= false;
 
-	if (IS_ENABLED(CONFIG_MPTCP))
-		treq->is_mptcp = 0;
-
 	if (IS_ENABLED(CONFIG_SMC))
 		ireq->smc_ok = 0;
 
@@ -5549,9 +5549,11 @@ static bool tcp_validate_incoming(struct sock *sk, struct sk_buff *skb,
 				rst_seq_match = true;
 		}
 
-		if (rst_seq_match)
+		if (rst_seq_match) {
+			if (sk_is_mptcp(sk))
+				mptcp_incoming_reset(sk, skb);
 			tcp_reset(sk);
-		else {
+		} else {
 			/* Disable TFO if RST is out-of-order
 			 * and no data has been received
 			 * for current active TFO socket
@@ -6666,6 +6668,7 @@ int tcp_conn_request(struct request_sock_ops *rsk_ops,
 
 	tcp_rsk(req)->af_specific = af_ops;
 	tcp_rsk(req)->ts_off = 0;
+	tcp_rsk(req)->syncookie = want_cookie;
 #if IS_ENABLED(CONFIG_MPTCP)
 	tcp_rsk(req)->is_mptcp = 0;
 #endif
@@ -6691,9 +6694,6 @@ int tcp_conn_request(struct request_sock_ops *rsk_ops,
 
 	af_ops->init_req(req, sk, skb);
 
-	if (IS_ENABLED(CONFIG_MPTCP) && want_cookie)
-		tcp_rsk(req)->is_mptcp = 0;
-
 	if (security_inet_conn_request(sk, skb, req))
 		goto drop_and_free;
 
@@ -19,6 +19,7 @@
 #include <net/inet6_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/mptcp.h>
 #include <net/sock_reuseport.h>
 
 u32 inet6_ehashfn(const struct net *net,
@@ -131,6 +132,11 @@ static struct sock *inet6_lhash2_lookup(struct net *net,
 				      exact_dif);
 		if (score > hiscore) {
 			if (sk->sk_reuseport) {
+				result = mptcp_reuseport_select_sock(sk, skb,
+								     doff);
+				if (result)
+					return result;
+
 				phash = inet6_ehashfn(net, daddr, hnum,
 						      saddr, sport);
 				result = reuseport_select_sock(sk, phash,
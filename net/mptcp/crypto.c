@@ -26,8 +26,6 @@
 
 #include "protocol.h"
 
-#define SHA256_DIGEST_WORDS (SHA256_DIGEST_SIZE / 4)
-
 void mptcp_crypto_key_sha(u64 key, u32 *token, u64 *idsn)
 {
 	__be32 mptcp_hashed_key[SHA256_DIGEST_WORDS];
@@ -44,49 +42,75 @@ void mptcp_crypto_key_sha(u64 key, u32 *token, u64 *idsn)
 		*idsn = be64_to_cpu(*((__be64 *)&mptcp_hashed_key[6]));
 }
 
-void mptcp_crypto_hmac_sha(u64 key1, u64 key2, u8 *msg, int len, void *hmac)
+static void mptcp_crypto_hmac_pad(struct sha256_state *state, u8 pad,
+				  const u8 *key1be, const u8 *key2be)
+{
+	u8 input[SHA256_BLOCK_SIZE];
+	int i;
+
+	memset(input, pad, SHA256_BLOCK_SIZE);
+	for (i = 0; i < 8; i++)
+		input[i] ^= key1be[i];
+	for (i = 0; i < 8; i++)
+		input[i + 8] ^= key2be[i];
+
+	sha256_init(state);
+	sha256_update(state, input, SHA256_BLOCK_SIZE);
+}
+
+/* The HMAC key is always K1 || K2, which fits a single SHA-256 block:
+ * store the state after compressing the key xored with ipad and opad, so
+ * that the hmac of each short message needs just one more compression
+ * per round.
+ */
+void mptcp_crypto_hmac_prepare(u64 key1, u64 key2, struct mptcp_hmac_key *hkey)
 {
-	u8 input[SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE];
 	struct sha256_state state;
 	u8 key1be[8];
 	u8 key2be[8];
-	int i;
-
-	if (WARN_ON_ONCE(len > SHA256_DIGEST_SIZE))
-		len = SHA256_DIGEST_SIZE;
 
 	put_unaligned_be64(key1, key1be);
 	put_unaligned_be64(key2, key2be);
 
-	/* Generate key xored with ipad */
-	memset(input, 0x36, SHA256_BLOCK_SIZE);
-	for (i = 0; i < 8; i++)
-		input[i] ^= key1be[i];
-	for (i = 0; i < 8; i++)
-		input[i + 8] ^= key2be[i];
+	mptcp_crypto_hmac_pad(&state, 0x36, key1be, key2be);
+	memcpy(hkey->istate, state.state, sizeof(hkey->istate));
 
-	memcpy(&input[SHA256_BLOCK_SIZE], msg, len);
+	mptcp_crypto_hmac_pad(&state, 0x5C, key1be, key2be);
+	memcpy(hkey->ostate, state.state, sizeof(hkey->ostate));
 
-	sha256_init(&state);
-	sha256_update(&state, input, SHA256_BLOCK_SIZE + len);
+	memzero_explicit(&state, sizeof(state));
+}
 
-	/* emit sha256(K1 || msg) on the second input block, so we can
-	 * reuse 'input' for the last hashing
-	 */
-	sha256_final(&state, &input[SHA256_BLOCK_SIZE]);
+void mptcp_crypto_hmac_sha_prepared(const struct mptcp_hmac_key *hkey,
+				    const u8 *msg, int len, void *hmac)
+{
+	u8 digest[SHA256_DIGEST_SIZE];
+	struct sha256_state state;
 
-	/* Prepare second part of hmac */
-	memset(input, 0x5C, SHA256_BLOCK_SIZE);
-	for (i = 0; i < 8; i++)
-		input[i] ^= key1be[i];
-	for (i = 0; i < 8; i++)
-		input[i + 8] ^= key2be[i];
+	if (WARN_ON_ONCE(len > SHA256_DIGEST_SIZE))
+		len = SHA256_DIGEST_SIZE;
 
-	sha256_init(&state);
-	sha256_update(&state, input, SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE);
+	memcpy(state.state, hkey->istate, sizeof(state.state));
+	state.count = SHA256_BLOCK_SIZE;
+	sha256_update(&state, msg, len);
+	sha256_final(&state, digest);
+
+	memcpy(state.state, hkey->ostate, sizeof(state.state));
+	state.count = SHA256_BLOCK_SIZE;
+	sha256_update(&state, digest, SHA256_DIGEST_SIZE);
 	sha256_final(&state, (u8 *)hmac);
 }
 
+void mptcp_crypto_hmac_sha(u64 key1, u64 key2, u8 *msg, int len, void *hmac)
+{
+	struct mptcp_hmac_key hkey;
+
+	mptcp_crypto_hmac_prepare(key1, key2, &hkey);
+	mptcp_crypto_hmac_sha_prepared(&hkey, msg, len, hmac);
+}
+
 #if IS_MODULE(CONFIG_MPTCP_KUNIT_TESTS)
 EXPORT_SYMBOL_GPL(mptcp_crypto_hmac_sha);
+EXPORT_SYMBOL_GPL(mptcp_crypto_hmac_prepare);
+EXPORT_SYMBOL_GPL(mptcp_crypto_hmac_sha_prepared);
 #endif
@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/ktime.h>
 #include <kunit/test.h>
 
 #include "protocol.h"
@@ -57,8 +58,73 @@ static void mptcp_crypto_test_basic(struct kunit *test)
 	}
 }
 
+static void mptcp_crypto_test_prepared(struct kunit *test)
+{
+	char hmac[32], hmac_hex[65];
+	struct mptcp_hmac_key hkey;
+	u64 key1, key2;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(tests); ++i) {
+		key1 = be64_to_cpu(*((__be64 *)&tests[i].key[0]));
+		key2 = be64_to_cpu(*((__be64 *)&tests[i].key[8]));
+
+		mptcp_crypto_hmac_prepare(key1, key2, &hkey);
+		mptcp_crypto_hmac_sha_prepared(&hkey, (u8 *)tests[i].msg, 8,
+					       hmac);
+		for (j = 0; j < 32; ++j)
+			sprintf(&hmac_hex[j << 1], "%02x", hmac[j] & 0xff);
+		hmac_hex[64] = 0;
+
+		KUNIT_EXPECT_STREQ(test, &hmac_hex[0], tests[i].result);
+	}
+}
+
+#define MPTCP_CRYPTO_BENCH_ITERS	100000
+
+/* compare the cost of a join hmac with and without the per msk state */
+static void mptcp_crypto_test_bench(struct kunit *test)
+{
+	u64 start, oneshot_ns, prepared_ns;
+	u8 hmac[SHA256_DIGEST_SIZE];
+	struct mptcp_hmac_key hkey;
+	u64 key1, key2;
+	u8 msg[8];
+	int i;
+
+	get_random_bytes(&key1, sizeof(key1));
+	get_random_bytes(&key2, sizeof(key2));
+	get_random_bytes(msg, sizeof(msg));
+
+	start = ktime_get_ns();
+	for (i = 0; i < MPTCP_CRYPTO_BENCH_ITERS; ++i) {
+		msg[0] = i;
+		mptcp_crypto_hmac_sha(key1, key2, msg, 8, hmac);
+	}
+	oneshot_ns = ktime_get_ns() - start;
+
+	mptcp_crypto_hmac_prepare(key1, key2, &hkey);
+	start = ktime_get_ns();
+	for (i = 0; i < MPTCP_CRYPTO_BENCH_ITERS; ++i) {
+		msg[0] = i;
+		mptcp_crypto_hmac_sha_prepared(&hkey, msg, 8, hmac);
+	}
+	prepared_ns = ktime_get_ns() - start;
+
+	kunit_info(test, "hmac one-shot %llu ns/op, prepared %llu ns/op\n",
+		   div_u64(oneshot_ns, MPTCP_CRYPTO_BENCH_ITERS),
+		   div_u64(prepared_ns, MPTCP_CRYPTO_BENCH_ITERS));
+	kunit_info(test, "hmac one-shot %llu ops/s, prepared %llu ops/s\n",
+		   div64_u64((u64)MPTCP_CRYPTO_BENCH_ITERS * NSEC_PER_SEC,
+			     max_t(u64, oneshot_ns, 1)),
+		   div64_u64((u64)MPTCP_CRYPTO_BENCH_ITERS * NSEC_PER_SEC,
+			     max_t(u64, prepared_ns, 1)));
+}
+
 static struct kunit_case mptcp_crypto_test_cases[] = {
 	KUNIT_CASE(mptcp_crypto_test_basic),
+	KUNIT_CASE(mptcp_crypto_test_prepared),
+	KUNIT_CASE(mptcp_crypto_test_bench),
 	{}
 };
 
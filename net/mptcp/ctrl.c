@@ -12,14 +12,20 @@
 #include "protocol.h"
 
 #define MPTCP_SYSCTL_PATH "net/mptcp"
+#define MPTCP_SCHED_BUF_MAX (MPTCP_SCHED_NAME_MAX * 8)
 
 static int mptcp_pernet_id;
 struct mptcp_pernet {
 	struct ctl_table_header *ctl_table_hdr;
 
 	int mptcp_enabled;
+	int pm_type;
+	unsigned int add_addr_timeout;
+	const struct mptcp_sched_ops *sched;
 };
 
+static int mptcp_pm_type_max = __MPTCP_PM_TYPE_MAX;
+
 static struct mptcp_pernet *mptcp_get_pernet(struct net *net)
 {
 	return net_generic(net, mptcp_pernet_id);
@@ -30,6 +36,78 @@ int mptcp_is_enabled(struct net *net)
 	return mptcp_get_pernet(net)->mptcp_enabled;
 }
 
+/* the returned scheduler holds a reference on its module: if the netns
+ * default is concurrently replaced and its module is going away, use the
+ * built-in one
+ */
+const struct mptcp_sched_ops *mptcp_get_sched(struct net *net)
+{
+	const struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = READ_ONCE(mptcp_get_pernet(net)->sched);
+	if (!try_module_get(sched->owner))
+		sched = mptcp_sched_default_ops();
+	rcu_read_unlock();
+
+	return sched;
+}
+
+int mptcp_get_pm_type(struct net *net)
+{
+	return READ_ONCE(mptcp_get_pernet(net)->pm_type);
+}
+
+unsigned int mptcp_get_add_addr_timeout(struct net *net)
+{
+	return READ_ONCE(mptcp_get_pernet(net)->add_addr_timeout);
+}
+
+static int proc_scheduler(struct ctl_table *ctl, int write,
+			  void *buffer, size_t *lenp, loff_t *ppos)
+{
+	const struct mptcp_sched_ops **sched = ctl->data;
+	char val[MPTCP_SCHED_NAME_MAX];
+	struct ctl_table tbl = {
+		.data = val,
+		.maxlen = MPTCP_SCHED_NAME_MAX,
+	};
+	int ret;
+
+	strlcpy(val, READ_ONCE(*sched)->name, sizeof(val));
+
+	ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+	if (write && ret == 0) {
+		const struct mptcp_sched_ops *new = mptcp_sched_find(val);
+
+		if (!new)
+			return -ENOENT;
+
+		/* the netns default keeps a reference on its module */
+		mptcp_sched_put(xchg(sched, new));
+	}
+
+	return ret;
+}
+
+static int proc_available_schedulers(struct ctl_table *ctl, int write,
+				     void *buffer, size_t *lenp,
+				     loff_t *ppos)
+{
+	struct ctl_table tbl = { .maxlen = MPTCP_SCHED_BUF_MAX, };
+	int ret;
+
+	tbl.data = kmalloc(tbl.maxlen, GFP_USER);
+	if (!tbl.data)
+		return -ENOMEM;
+
+	mptcp_sched_get_available(tbl.data, MPTCP_SCHED_BUF_MAX);
+	ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+	kfree(tbl.data);
+
+	return ret;
+}
+
 static struct ctl_table mptcp_sysctl_table[] = {
 	{
 		.procname = "enabled",
@@ -40,12 +118,43 @@ static struct ctl_table mptcp_sysctl_table[] = {
 		 */
 		.proc_handler = proc_dointvec,
 	},
+	{
+		.procname = "scheduler",
+		.maxlen = MPTCP_SCHED_NAME_MAX,
+		.mode = 0644,
+		.proc_handler = proc_scheduler,
+	},
+	{
+		.procname = "available_schedulers",
+		.maxlen = MPTCP_SCHED_BUF_MAX,
+		.mode = 0444,
+		.proc_handler = proc_available_schedulers,
+	},
+	{
+		/* 0: in-kernel path manager, 1: userspace daemon */
+		.procname = "pm_type",
+		.maxlen = sizeof(int),
+		.mode = 0644,
+		.proc_handler = proc_dointvec_minmax,
+		.extra1 = SYSCTL_ZERO,
+		.extra2 = &mptcp_pm_type_max,
+	},
+	{
+		/* ADD_ADDR retransmission interval, until the peer echoes it */
+		.procname = "add_addr_timeout",
+		.maxlen = sizeof(unsigned int),
+		.mode = 0644,
+		.proc_handler = proc_dointvec_jiffies,
+	},
 	{}
 };
 
 static void mptcp_pernet_set_defaults(struct mptcp_pernet *pernet)
 {
 	pernet->mptcp_enabled = 1;
+	pernet->pm_type = MPTCP_PM_TYPE_KERNEL;
+	pernet->add_addr_timeout = TCP_RTO_MAX;
+	pernet->sched = mptcp_sched_default_ops();
 }
 
 static int mptcp_pernet_new_table(struct net *net, struct mptcp_pernet *pernet)
@@ -61,6 +170,9 @@ static int mptcp_pernet_new_table(struct net *net, struct mptcp_pernet *pernet)
 	}
 
 	table[0].data = &pernet->mptcp_enabled;
+	table[1].data = &pernet->sched;
+	table[3].data = &pernet->pm_type;
+	table[4].data = &pernet->add_addr_timeout;
 
 	hdr = register_net_sysctl(net, MPTCP_SYSCTL_PATH, table);
 	if (!hdr)
@@ -101,6 +213,7 @@ static void __net_exit mptcp_net_exit(struct net *net)
 	struct mptcp_pernet *pernet = mptcp_get_pernet(net);
 
 	mptcp_pernet_del_table(pernet);
+	mptcp_sched_put(pernet->sched);
 }
 
 static struct pernet_operations mptcp_pernet_ops = {
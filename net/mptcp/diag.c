@@ -13,23 +13,9 @@
 #include <uapi/linux/mptcp.h>
 #include "protocol.h"
 
-static int subflow_get_info(const struct sock *sk, struct sk_buff *skb)
+u32 mptcp_diag_subflow_flags(const struct mptcp_subflow_context *sf)
 {
-	struct mptcp_subflow_context *sf;
-	struct nlattr *start;
 	u32 flags = 0;
-	int err;
-
-	start = nla_nest_start_noflag(skb, INET_ULP_INFO_MPTCP);
-	if (!start)
-		return -EMSGSIZE;
-
-	rcu_read_lock();
-	sf = rcu_dereference(inet_csk(sk)->icsk_ulp_data);
-	if (!sf) {
-		err = 0;
-		goto nla_failure;
-	}
 
 	if (sf->mp_capable)
 		flags |= MPTCP_SUBFLOW_FLAG_MCAP_REM;
@@ -50,6 +36,56 @@ static int subflow_get_info(const struct sock *sk, struct sk_buff *skb)
 	if (sf->map_valid)
 		flags |= MPTCP_SUBFLOW_FLAG_MAPVALID;
 
+	return flags;
+}
+
+/* the caller must hold the msk socket lock, possibly the fast variant */
+void mptcp_diag_fill_info(struct mptcp_sock *msk, struct mptcp_info *info)
+{
+	u32 flags = 0;
+	u8 val;
+
+	memset(info, 0, sizeof(*info));
+
+	info->mptcpi_subflows = READ_ONCE(msk->pm.subflows);
+	info->mptcpi_add_addr_signal = READ_ONCE(msk->pm.add_addr_signaled);
+	info->mptcpi_add_addr_accepted = READ_ONCE(msk->pm.add_addr_accepted);
+	info->mptcpi_subflows_max = READ_ONCE(msk->pm.subflows_max);
+	val = READ_ONCE(msk->pm.add_addr_signal_max);
+	info->mptcpi_add_addr_signal_max = val;
+	val = READ_ONCE(msk->pm.add_addr_accept_max);
+	info->mptcpi_add_addr_accepted_max = val;
+	if (test_bit(MPTCP_FALLBACK_DONE, &msk->flags))
+		flags |= MPTCP_INFO_FLAG_FALLBACK;
+	if (READ_ONCE(msk->can_ack))
+		flags |= MPTCP_INFO_FLAG_REMOTE_KEY_RECEIVED;
+	info->mptcpi_flags = flags;
+	info->mptcpi_token = READ_ONCE(msk->token);
+	info->mptcpi_write_seq = READ_ONCE(msk->write_seq);
+	info->mptcpi_snd_una = atomic64_read(&msk->snd_una);
+	info->mptcpi_rcv_nxt = READ_ONCE(msk->ack_seq);
+}
+EXPORT_SYMBOL_GPL(mptcp_diag_fill_info);
+
+static int subflow_get_info(const struct sock *sk, struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *sf;
+	struct nlattr *start;
+	u32 flags;
+	int err;
+
+	start = nla_nest_start_noflag(skb, INET_ULP_INFO_MPTCP);
+	if (!start)
+		return -EMSGSIZE;
+
+	rcu_read_lock();
+	sf = rcu_dereference(inet_csk(sk)->icsk_ulp_data);
+	if (!sf) {
+		err = 0;
+		goto nla_failure;
+	}
+
+	flags = mptcp_diag_subflow_flags(sf);
 	if (nla_put_u32(skb, MPTCP_SUBFLOW_ATTR_TOKEN_REM, sf->remote_token) ||
 	    nla_put_u32(skb, MPTCP_SUBFLOW_ATTR_TOKEN_LOC, sf->token) ||
 	    nla_put_u32(skb, MPTCP_SUBFLOW_ATTR_RELWRITE_SEQ,
@@ -11,6 +11,7 @@
 #include <net/tcp.h>
 #include <net/mptcp.h>
 #include "protocol.h"
+#include "mib.h"
 
 static bool mptcp_cap_flag_sha256(u8 flags)
 {
@@ -280,6 +281,38 @@ static void mptcp_parse_option(const struct sk_buff *skb,
 		pr_debug("RM_ADDR: id=%d", mp_opt->rm_id);
 		break;
 
+	case MPTCPOPT_MP_PRIO:
+		if (opsize != TCPOLEN_MPTCP_PRIO)
+			break;
+
+		mp_opt->mp_prio = 1;
+		mp_opt->backup = *ptr++ & MPTCP_PRIO_BKUP;
+		pr_debug("MP_PRIO: prio=%d", mp_opt->backup);
+		break;
+
+	case MPTCPOPT_MP_FASTCLOSE:
+		if (opsize != TCPOLEN_MPTCP_FASTCLOSE)
+			break;
+
+		ptr += 2;
+		mp_opt->rcvr_key = get_unaligned_be64(ptr);
+		ptr += 8;
+		mp_opt->fastclose = 1;
+		pr_debug("MP_FASTCLOSE: key=%llu", mp_opt->rcvr_key);
+		break;
+
+	case MPTCPOPT_RST:
+		if (opsize != TCPOLEN_MPTCP_RST)
+			break;
+
+		mp_opt->reset = 1;
+		flags = *ptr++;
+		mp_opt->reset_transient = flags & MPTCP_RST_TRANSIENT;
+		mp_opt->reset_reason = *ptr;
+		pr_debug("MP_RST: transient=%d reason=%d",
+			 mp_opt->reset_transient, mp_opt->reset_reason);
+		break;
+
 	default:
 		break;
 	}
@@ -297,6 +330,9 @@ void mptcp_get_options(const struct sk_buff *skb,
 	mp_opt->mp_join = 0;
 	mp_opt->add_addr = 0;
 	mp_opt->rm_addr = 0;
+	mp_opt->mp_prio = 0;
+	mp_opt->fastclose = 0;
+	mp_opt->reset = 0;
 	mp_opt->dss = 0;
 
 	length = (th->doff * 4) - sizeof(struct tcphdr);
@@ -412,6 +448,12 @@ static bool mptcp_established_options_mp(struct sock *sk, struct sk_buff *skb,
 		mpext = mptcp_get_ext(skb);
 		data_len = mpext ? mpext->data_len : 0;
 
+		/* MP_CAPABLE + data implicitly maps the first chunk of data,
+		 * which is not the case after a successful Fast Open
+		 */
+		if (data_len && mpext->subflow_seq != 1)
+			return false;
+
 		/* we will check ext_copy.data_len in mptcp_write_options() to
 		 * discriminate between TCPOLEN_MPTCP_MPC_ACK_DATA and
 		 * TCPOLEN_MPTCP_MPC_ACK
@@ -451,6 +493,11 @@ static bool mptcp_established_options_mp(struct sock *sk, struct sk_buff *skb,
 static void mptcp_write_data_fin(struct mptcp_subflow_context *subflow,
 				 struct sk_buff *skb, struct mptcp_ext *ext)
 {
+	/* write_seq has already been incremented to account for the
+	 * DATA_FIN, the actual sequence number is one less
+	 */
+	u64 data_fin_tx_seq = READ_ONCE(mptcp_sk(subflow->conn)->write_seq) - 1;
+
 	if (!ext->use_map || !skb->len) {
 		/* RFC6824 requires a DSS mapping with specific values
 		 * if DATA_FIN is set but no data payload is mapped
@@ -458,10 +505,10 @@ static void mptcp_write_data_fin(struct mptcp_subflow_context *subflow,
 		ext->data_fin = 1;
 		ext->use_map = 1;
 		ext->dsn64 = 1;
-		ext->data_seq = subflow->data_fin_tx_seq;
+		ext->data_seq = data_fin_tx_seq;
 		ext->subflow_seq = 0;
 		ext->data_len = 1;
-	} else if (ext->data_seq + ext->data_len == subflow->data_fin_tx_seq) {
+	} else if (ext->data_seq + ext->data_len == data_fin_tx_seq) {
 		/* If there's an existing DSS mapping and it is the
 		 * final mapping, DATA_FIN consumes 1 additional byte of
 		 * mapping space.
@@ -477,22 +524,17 @@ static bool mptcp_established_options_dss(struct sock *sk, struct sk_buff *skb,
 					  struct mptcp_out_options *opts)
 {
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
 	unsigned int dss_size = 0;
+	bool snd_data_fin_enable;
 	struct mptcp_ext *mpext;
-	struct mptcp_sock *msk;
 	unsigned int ack_size;
 	bool ret = false;
-	u8 tcp_fin;
 
-	if (skb) {
-		mpext = mptcp_get_ext(skb);
-		tcp_fin = TCP_SKB_CB(skb)->tcp_flags & TCPHDR_FIN;
-	} else {
-		mpext = NULL;
-		tcp_fin = 0;
-	}
+	mpext = skb ? mptcp_get_ext(skb) : NULL;
+	snd_data_fin_enable = READ_ONCE(msk->snd_data_fin_enable);
 
-	if (!skb || (mpext && mpext->use_map) || tcp_fin) {
+	if (!skb || (mpext && mpext->use_map) || snd_data_fin_enable) {
 		unsigned int map_size;
 
 		map_size = TCPOLEN_MPTCP_DSS_BASE + TCPOLEN_MPTCP_DSS_MAP64;
@@ -502,7 +544,7 @@ static bool mptcp_established_options_dss(struct sock *sk, struct sk_buff *skb,
 		if (mpext)
 			opts->ext_copy = *mpext;
 
-		if (skb && tcp_fin && subflow->data_fin_tx_enable)
+		if (skb && snd_data_fin_enable)
 			mptcp_write_data_fin(subflow, skb, &opts->ext_copy);
 		ret = true;
 	}
@@ -511,7 +553,6 @@ static bool mptcp_established_options_dss(struct sock *sk, struct sk_buff *skb,
 	 * if the first subflow may have the already the remote key handy
 	 */
 	opts->ext_copy.use_ack = 0;
-	msk = mptcp_sk(subflow->conn);
 	if (!READ_ONCE(msk->can_ack)) {
 		*size = ALIGN(dss_size, 4);
 		return ret;
@@ -538,41 +579,42 @@ static bool mptcp_established_options_dss(struct sock *sk, struct sk_buff *skb,
 	return true;
 }
 
-static u64 add_addr_generate_hmac(u64 key1, u64 key2, u8 addr_id,
-				  struct in_addr *addr)
+static u64 add_addr_generate_hmac(const struct mptcp_hmac_key *hkey,
+				  u8 addr_id, struct in_addr *addr, u16 port)
 {
 	u8 hmac[SHA256_DIGEST_SIZE];
 	u8 msg[7];
 
 	msg[0] = addr_id;
 	memcpy(&msg[1], &addr->s_addr, 4);
-	msg[5] = 0;
-	msg[6] = 0;
+	msg[5] = port >> 8;
+	msg[6] = port & 0xFF;
 
-	mptcp_crypto_hmac_sha(key1, key2, msg, 7, hmac);
+	mptcp_crypto_hmac_sha_prepared(hkey, msg, 7, hmac);
 
 	return get_unaligned_be64(&hmac[SHA256_DIGEST_SIZE - sizeof(u64)]);
 }
 
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
-static u64 add_addr6_generate_hmac(u64 key1, u64 key2, u8 addr_id,
-				   struct in6_addr *addr)
+static u64 add_addr6_generate_hmac(const struct mptcp_hmac_key *hkey,
+				   u8 addr_id, struct in6_addr *addr, u16 port)
 {
 	u8 hmac[SHA256_DIGEST_SIZE];
 	u8 msg[19];
 
 	msg[0] = addr_id;
 	memcpy(&msg[1], &addr->s6_addr, 16);
-	msg[17] = 0;
-	msg[18] = 0;
+	msg[17] = port >> 8;
+	msg[18] = port & 0xFF;
 
-	mptcp_crypto_hmac_sha(key1, key2, msg, 19, hmac);
+	mptcp_crypto_hmac_sha_prepared(hkey, msg, 19, hmac);
 
 	return get_unaligned_be64(&hmac[SHA256_DIGEST_SIZE - sizeof(u64)]);
 }
 #endif
 
 static bool mptcp_established_options_addr(struct sock *sk,
+					   struct sk_buff *skb,
 					   unsigned int *size,
 					   unsigned int remaining,
 					   struct mptcp_out_options *opts)
@@ -580,37 +622,134 @@ static bool mptcp_established_options_addr(struct sock *sk,
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
 	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
 	struct mptcp_addr_info saddr;
+	bool echo;
 	int len;
 
+	/* with a NULL skb the stack is only estimating the header size,
+	 * keep the announcement pending until it really goes on the wire
+	 */
 	if (!mptcp_pm_should_signal(msk) ||
-	    !(mptcp_pm_addr_signal(msk, remaining, &saddr)))
+	    !(mptcp_pm_addr_signal(msk, remaining, &saddr, &echo, !!skb)))
 		return false;
 
-	len = mptcp_add_addr_len(saddr.family);
+	len = mptcp_add_addr_len(saddr.family, echo, !!saddr.port);
 	if (remaining < len)
 		return false;
 
 	*size = len;
 	opts->addr_id = saddr.id;
+	opts->port = ntohs(saddr.port);
+	opts->ahmac = 0;
 	if (saddr.family == AF_INET) {
 		opts->suboptions |= OPTION_MPTCP_ADD_ADDR;
 		opts->addr = saddr.addr;
-		opts->ahmac = add_addr_generate_hmac(msk->local_key,
-						     msk->remote_key,
-						     opts->addr_id,
-						     &opts->addr);
+		if (!echo)
+			opts->ahmac = add_addr_generate_hmac(&msk->local_hmac,
+							     opts->addr_id,
+							     &opts->addr,
+							     opts->port);
 	}
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
 	else if (saddr.family == AF_INET6) {
 		opts->suboptions |= OPTION_MPTCP_ADD_ADDR6;
 		opts->addr6 = saddr.addr6;
-		opts->ahmac = add_addr6_generate_hmac(msk->local_key,
-						      msk->remote_key,
-						      opts->addr_id,
-						      &opts->addr6);
+		if (!echo)
+			opts->ahmac = add_addr6_generate_hmac(&msk->local_hmac,
+							      opts->addr_id,
+							      &opts->addr6,
+							      opts->port);
 	}
 #endif
-	pr_debug("addr_id=%d, ahmac=%llu", opts->addr_id, opts->ahmac);
+	pr_debug("addr_id=%d, ahmac=%llu, echo=%d, port=%d",
+		 opts->addr_id, opts->ahmac, echo, opts->port);
+
+	return true;
+}
+
+static bool mptcp_established_options_rm_addr(struct sock *sk,
+					      struct sk_buff *skb,
+					      unsigned int *size,
+					      unsigned int remaining,
+					      struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+	u8 rm_id;
+
+	if (!mptcp_pm_should_rm_signal(msk) ||
+	    !(mptcp_pm_rm_addr_signal(msk, remaining, &rm_id, !!skb)))
+		return false;
+
+	*size = TCPOLEN_MPTCP_RM_ADDR_BASE;
+	opts->suboptions |= OPTION_MPTCP_RM_ADDR;
+	opts->rm_id = rm_id;
+
+	pr_debug("rm_id=%d", opts->rm_id);
+
+	return true;
+}
+
+static bool mptcp_established_options_mp_prio(struct sock *sk,
+					      struct sk_buff *skb,
+					      unsigned int *size,
+					      unsigned int remaining,
+					      struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+
+	if (!subflow->send_mp_prio)
+		return false;
+
+	if (remaining < TCPOLEN_MPTCP_PRIO_ALIGN)
+		return false;
+
+	/* with a NULL skb the stack is only estimating the header size,
+	 * keep the option pending until it really goes on the wire
+	 */
+	if (skb) {
+		subflow->send_mp_prio = 0;
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPPRIOTX);
+	}
+
+	*size = TCPOLEN_MPTCP_PRIO_ALIGN;
+	opts->suboptions |= OPTION_MPTCP_PRIO;
+	opts->backup = subflow->request_bkup;
+
+	pr_debug("subflow=%p, prio=%d", subflow, opts->backup);
+
+	return true;
+}
+
+/* every RST sent by an MPTCP subflow carries MP_RST, and MP_FASTCLOSE too
+ * when the whole connection is being aborted
+ */
+static bool mptcp_established_options_rst(struct sock *sk, struct sk_buff *skb,
+					  unsigned int *size,
+					  unsigned int remaining,
+					  struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+	unsigned int len = TCPOLEN_MPTCP_RST;
+
+	if (subflow->send_fastclose)
+		len += TCPOLEN_MPTCP_FASTCLOSE;
+	if (remaining < len)
+		return false;
+
+	*size = len;
+	opts->suboptions |= OPTION_MPTCP_RST;
+	opts->reset_reason = MPTCP_RST_EUNSPEC;
+	opts->reset_transient = 0;
+	MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPRSTTX);
+
+	if (subflow->send_fastclose) {
+		opts->suboptions |= OPTION_MPTCP_FASTCLOSE;
+		opts->rcvr_key = msk->remote_key;
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPFASTCLOSETX);
+	}
+
+	pr_debug("subflow=%p fastclose=%d", subflow, subflow->send_fastclose);
 
 	return true;
 }
@@ -627,6 +766,15 @@ bool mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 	if (unlikely(mptcp_check_fallback(sk)))
 		return false;
 
+	if (unlikely(skb && TCP_SKB_CB(skb)->tcp_flags & TCPHDR_RST)) {
+		if (mptcp_established_options_rst(sk, skb, &opt_size, remaining,
+						  opts)) {
+			*size += opt_size;
+			return true;
+		}
+		return false;
+	}
+
 	if (mptcp_established_options_mp(sk, skb, &opt_size, remaining, opts))
 		ret = true;
 	else if (mptcp_established_options_dss(sk, skb, &opt_size, remaining,
@@ -641,7 +789,21 @@ bool mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 
 	*size += opt_size;
 	remaining -= opt_size;
-	if (mptcp_established_options_addr(sk, &opt_size, remaining, opts)) {
+	if (mptcp_established_options_addr(sk, skb, &opt_size, remaining,
+					   opts)) {
+		*size += opt_size;
+		remaining -= opt_size;
+		ret = true;
+	}
+	if (mptcp_established_options_rm_addr(sk, skb, &opt_size, remaining,
+					      opts)) {
+		*size += opt_size;
+		remaining -= opt_size;
+		ret = true;
+	}
+
+	if (mptcp_established_options_mp_prio(sk, skb, &opt_size, remaining,
+					      opts)) {
 		*size += opt_size;
 		remaining -= opt_size;
 		ret = true;
@@ -699,12 +861,15 @@ static bool check_fully_established(struct mptcp_sock *msk, struct sock *sk,
 	}
 
 	/* we should process OoO packets before the first subflow is fully
-	 * established, but not expected for MP_JOIN subflows
+	 * established, but not expected for MP_JOIN subflows. On passive
+	 * Fast Open subflows the SYN data precedes the third ack.
 	 */
-	if (TCP_SKB_CB(skb)->seq != subflow->ssn_offset + 1)
+	if (TCP_SKB_CB(skb)->seq !=
+	    subflow->ssn_offset + 1 + subflow->syn_data_len)
 		return subflow->mp_capable;
 
-	if (mp_opt->dss && mp_opt->use_ack) {
+	/* the peer key is still unknown after a Fast Open handshake */
+	if (mp_opt->dss && mp_opt->use_ack && !subflow->syn_data_len) {
 		/* subflows are fully established as soon as we get any
 		 * additional ack.
 		 */
@@ -726,6 +891,10 @@ static bool check_fully_established(struct mptcp_sock *msk, struct sock *sk,
 		pr_warn_once("bogus mpc option on established client sk");
 	mptcp_subflow_fully_established(subflow, mp_opt);
 
+	/* the Fast Open SYN data can now be mapped */
+	if (subflow->syn_data_len)
+		sk->sk_data_ready(sk);
+
 fully_established:
 	if (likely(subflow->pm_notified))
 		return true;
@@ -735,7 +904,7 @@ static bool check_fully_established(struct mptcp_sock *msk, struct sock *sk,
 		clear_3rdack_retransmission(sk);
 		mptcp_pm_subflow_established(msk, subflow);
 	} else {
-		mptcp_pm_fully_established(msk);
+		mptcp_pm_fully_established(msk, sk);
 	}
 	return true;
 }
@@ -755,6 +924,22 @@ static u64 expand_ack(u64 old_ack, u64 cur_ack, bool use_64bit)
 	return cur_ack;
 }
 
+bool mptcp_update_rcv_data_fin(struct mptcp_sock *msk, u64 data_fin_seq,
+			       bool use_64bit)
+{
+	/* Skip if DATA_FIN was already received, or if the msk has not
+	 * yet a valid ack_seq to expand 32 bits sequence numbers against
+	 */
+	if (READ_ONCE(msk->rcv_data_fin) || !READ_ONCE(msk->can_ack))
+		return false;
+
+	WRITE_ONCE(msk->rcv_data_fin_seq,
+		   expand_ack(READ_ONCE(msk->ack_seq), data_fin_seq, use_64bit));
+	WRITE_ONCE(msk->rcv_data_fin, 1);
+	pr_debug("msk=%p data_fin_seq=%llu", msk, msk->rcv_data_fin_seq);
+	return true;
+}
+
 static void update_una(struct mptcp_sock *msk,
 		       struct mptcp_options_received *mp_opt)
 {
@@ -791,14 +976,14 @@ static bool add_addr_hmac_valid(struct mptcp_sock *msk,
 		return true;
 
 	if (mp_opt->family == MPTCP_ADDR_IPVERSION_4)
-		hmac = add_addr_generate_hmac(msk->remote_key,
-					      msk->local_key,
-					      mp_opt->addr_id, &mp_opt->addr);
+		hmac = add_addr_generate_hmac(&msk->remote_hmac,
+					      mp_opt->addr_id, &mp_opt->addr,
+					      mp_opt->port);
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
 	else
-		hmac = add_addr6_generate_hmac(msk->remote_key,
-					       msk->local_key,
-					       mp_opt->addr_id, &mp_opt->addr6);
+		hmac = add_addr6_generate_hmac(&msk->remote_hmac,
+					       mp_opt->addr_id, &mp_opt->addr6,
+					       mp_opt->port);
 #endif
 
 	pr_debug("msk=%p, ahmac=%llu, mp_opt->ahmac=%llu\n",
@@ -838,11 +1023,34 @@ void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb,
 			addr.addr6 = mp_opt.addr6;
 		}
 #endif
-		if (!mp_opt.echo)
+		if (!mp_opt.echo) {
 			mptcp_pm_add_addr_received(msk, &addr);
+			MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_ADDADDR);
+		} else {
+			mptcp_pm_add_addr_echoed(msk, &addr);
+			MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_ECHOADD);
+		}
 		mp_opt.add_addr = 0;
 	}
 
+	if (mp_opt.rm_addr) {
+		mptcp_pm_rm_addr_received(msk, mp_opt.rm_id);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_RMADDR);
+		mp_opt.rm_addr = 0;
+	}
+
+	if (mp_opt.mp_prio) {
+		mptcp_pm_mp_prio_received(sk, mp_opt.backup);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPPRIORX);
+		mp_opt.mp_prio = 0;
+	}
+
+	if (mp_opt.fastclose && mp_opt.rcvr_key == msk->local_key) {
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPFASTCLOSERX);
+		mptcp_fastclose_received(msk);
+		return;
+	}
+
 	if (!mp_opt.dss)
 		return;
 
@@ -852,6 +1060,13 @@ void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb,
 	if (mp_opt.use_ack)
 		update_una(msk, &mp_opt);
 
+	/* a DATA_FIN with no payload is usually carried by a pure ack,
+	 * which never reaches the subflow receive queue
+	 */
+	if (mp_opt.use_map && mp_opt.data_fin && mp_opt.data_len == 1 &&
+	    mptcp_update_rcv_data_fin(msk, mp_opt.data_seq, mp_opt.dsn64))
+		mptcp_schedule_work((struct sock *)msk);
+
 	mpext = skb_ext_add(skb, SKB_EXT_MPTCP);
 	if (!mpext)
 		return;
@@ -881,6 +1096,33 @@ void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb,
 	}
 }
 
+/* the optional port and the HMAC follow the address; when the port is
+ * present the option is padded to a 32 bit boundary with two NOPs
+ */
+static __be32 *mptcp_write_add_addr_tail(__be32 *ptr,
+					 const struct mptcp_out_options *opts)
+{
+	u8 *bptr = (u8 *)ptr;
+
+	if (!opts->port) {
+		if (opts->ahmac) {
+			put_unaligned_be64(opts->ahmac, ptr);
+			ptr += 2;
+		}
+		return ptr;
+	}
+
+	put_unaligned_be16(opts->port, bptr);
+	bptr += TCPOLEN_MPTCP_PORT_LEN;
+	if (opts->ahmac) {
+		put_unaligned_be64(opts->ahmac, bptr);
+		bptr += 8;
+	}
+	*bptr++ = TCPOPT_NOP;
+	*bptr++ = TCPOPT_NOP;
+	return (__be32 *)bptr;
+}
+
 void mptcp_write_options(__be32 *ptr, struct mptcp_out_options *opts)
 {
 	if ((OPTION_MPTCP_MPC_SYN | OPTION_MPTCP_MPC_SYNACK |
@@ -921,40 +1163,36 @@ void mptcp_write_options(__be32 *ptr, struct mptcp_out_options *opts)
 
 mp_capable_done:
 	if (OPTION_MPTCP_ADD_ADDR & opts->suboptions) {
+		u8 len = TCPOLEN_MPTCP_ADD_ADDR_BASE;
+
 		if (opts->ahmac)
-			*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR,
-					      TCPOLEN_MPTCP_ADD_ADDR, 0,
-					      opts->addr_id);
-		else
-			*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR,
-					      TCPOLEN_MPTCP_ADD_ADDR_BASE,
-					      MPTCP_ADDR_ECHO,
-					      opts->addr_id);
+			len = TCPOLEN_MPTCP_ADD_ADDR;
+		if (opts->port)
+			len += TCPOLEN_MPTCP_PORT_LEN;
+
+		*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR, len,
+				      opts->ahmac ? 0 : MPTCP_ADDR_ECHO,
+				      opts->addr_id);
 		memcpy((u8 *)ptr, (u8 *)&opts->addr.s_addr, 4);
 		ptr += 1;
-		if (opts->ahmac) {
-			put_unaligned_be64(opts->ahmac, ptr);
-			ptr += 2;
-		}
+		ptr = mptcp_write_add_addr_tail(ptr, opts);
 	}
 
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
 	if (OPTION_MPTCP_ADD_ADDR6 & opts->suboptions) {
+		u8 len = TCPOLEN_MPTCP_ADD_ADDR6_BASE;
+
 		if (opts->ahmac)
-			*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR,
-					      TCPOLEN_MPTCP_ADD_ADDR6, 0,
-					      opts->addr_id);
-		else
-			*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR,
-					      TCPOLEN_MPTCP_ADD_ADDR6_BASE,
-					      MPTCP_ADDR_ECHO,
-					      opts->addr_id);
+			len = TCPOLEN_MPTCP_ADD_ADDR6;
+		if (opts->port)
+			len += TCPOLEN_MPTCP_PORT_LEN;
+
+		*ptr++ = mptcp_option(MPTCPOPT_ADD_ADDR, len,
+				      opts->ahmac ? 0 : MPTCP_ADDR_ECHO,
+				      opts->addr_id);
 		memcpy((u8 *)ptr, opts->addr6.s6_addr, 16);
 		ptr += 4;
-		if (opts->ahmac) {
-			put_unaligned_be64(opts->ahmac, ptr);
-			ptr += 2;
-		}
+		ptr = mptcp_write_add_addr_tail(ptr, opts);
 	}
 #endif
 
@@ -964,6 +1202,25 @@ void mptcp_write_options(__be32 *ptr, struct mptcp_out_options *opts)
 				      0, opts->rm_id);
 	}
 
+	if (OPTION_MPTCP_FASTCLOSE & opts->suboptions) {
+		*ptr++ = mptcp_option(MPTCPOPT_MP_FASTCLOSE,
+				      TCPOLEN_MPTCP_FASTCLOSE, 0, 0);
+		put_unaligned_be64(opts->rcvr_key, ptr);
+		ptr += 2;
+	}
+
+	if (OPTION_MPTCP_RST & opts->suboptions) {
+		*ptr++ = mptcp_option(MPTCPOPT_RST, TCPOLEN_MPTCP_RST,
+				      opts->reset_transient,
+				      opts->reset_reason);
+	}
+
+	if (OPTION_MPTCP_PRIO & opts->suboptions) {
+		*ptr++ = mptcp_option(MPTCPOPT_MP_PRIO,
+				      TCPOLEN_MPTCP_PRIO,
+				      opts->backup, TCPOPT_NOP);
+	}
+
 	if (OPTION_MPTCP_MPJ_SYN & opts->suboptions) {
 		*ptr++ = mptcp_option(MPTCPOPT_MP_JOIN,
 				      TCPOLEN_MPTCP_MPJ_SYN,
@@ -1039,3 +1296,26 @@ void mptcp_write_options(__be32 *ptr, struct mptcp_out_options *opts)
 		}
 	}
 }
+
+/* called by the TCP stack on in-window RST, before resetting the subflow */
+void mptcp_incoming_reset(struct sock *sk, const struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+	struct mptcp_options_received mp_opt;
+
+	if (__mptcp_check_fallback(msk))
+		return;
+
+	mptcp_get_options(skb, &mp_opt);
+	if (mp_opt.reset) {
+		pr_debug("subflow=%p transient=%d reason=%d", subflow,
+			 mp_opt.reset_transient, mp_opt.reset_reason);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPRSTRX);
+	}
+
+	if (mp_opt.fastclose && mp_opt.rcvr_key == msk->local_key) {
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_MPFASTCLOSERX);
+		mptcp_fastclose_received(msk);
+	}
+}
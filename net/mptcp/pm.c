@@ -12,13 +12,23 @@
 
 /* path manager command handlers */
 
+/* called with the PM lock held */
 int mptcp_pm_announce_addr(struct mptcp_sock *msk,
-			   const struct mptcp_addr_info *addr)
+			   const struct mptcp_addr_info *addr,
+			   bool echo)
 {
-	pr_debug("msk=%p, local_id=%d", msk, addr->id);
-
-	msk->pm.local = *addr;
-	WRITE_ONCE(msk->pm.addr_signal, true);
+	u8 add_addr = READ_ONCE(msk->pm.addr_signal);
+
+	pr_debug("msk=%p, local_id=%d echo=%d", msk, addr->id, echo);
+
+	if (echo) {
+		msk->pm.remote = *addr;
+		add_addr |= MPTCP_ADD_ADDR_ECHO;
+	} else {
+		msk->pm.local = *addr;
+		add_addr |= MPTCP_ADD_ADDR_SIGNAL;
+	}
+	WRITE_ONCE(msk->pm.addr_signal, add_addr);
 	return 0;
 }
 
@@ -34,13 +44,15 @@ int mptcp_pm_remove_subflow(struct mptcp_sock *msk, u8 remote_id)
 
 /* path manager event handlers */
 
-void mptcp_pm_new_connection(struct mptcp_sock *msk, int server_side)
+void mptcp_pm_new_connection(struct mptcp_sock *msk, const struct sock *ssk,
+			     int server_side)
 {
 	struct mptcp_pm_data *pm = &msk->pm;
 
 	pr_debug("msk=%p, token=%u side=%d", msk, msk->token, server_side);
 
 	WRITE_ONCE(pm->server_side, server_side);
+	mptcp_event(MPTCP_EVENT_CREATED, msk, ssk, GFP_ATOMIC);
 }
 
 bool mptcp_pm_allow_new_subflow(struct mptcp_sock *msk)
@@ -81,12 +93,15 @@ static bool mptcp_pm_schedule_work(struct mptcp_sock *msk,
 	return true;
 }
 
-void mptcp_pm_fully_established(struct mptcp_sock *msk)
+void mptcp_pm_fully_established(struct mptcp_sock *msk,
+				const struct sock *ssk)
 {
 	struct mptcp_pm_data *pm = &msk->pm;
 
 	pr_debug("msk=%p", msk);
 
+	mptcp_event(MPTCP_EVENT_ESTABLISHED, msk, ssk, GFP_ATOMIC);
+
 	/* try to avoid acquiring the lock below */
 	if (!READ_ONCE(pm->work_pending))
 		return;
@@ -102,6 +117,8 @@ void mptcp_pm_fully_established(struct mptcp_sock *msk)
 void mptcp_pm_connection_closed(struct mptcp_sock *msk)
 {
 	pr_debug("msk=%p", msk);
+
+	mptcp_event(MPTCP_EVENT_CLOSED, msk, NULL, GFP_KERNEL);
 }
 
 void mptcp_pm_subflow_established(struct mptcp_sock *msk,
@@ -127,6 +144,15 @@ void mptcp_pm_subflow_closed(struct mptcp_sock *msk, u8 id)
 	pr_debug("msk=%p", msk);
 }
 
+/* called under the subflow socket lock, from the TCP input path */
+void mptcp_pm_mp_prio_received(struct sock *ssk, u8 bkup)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+
+	pr_debug("subflow=%p backup=%d->%d", subflow, subflow->backup, bkup);
+	subflow->backup = bkup;
+}
+
 void mptcp_pm_add_addr_received(struct mptcp_sock *msk,
 				const struct mptcp_addr_info *addr)
 {
@@ -135,25 +161,66 @@ void mptcp_pm_add_addr_received(struct mptcp_sock *msk,
 	pr_debug("msk=%p remote_id=%d accept=%d", msk, addr->id,
 		 READ_ONCE(pm->accept_addr));
 
-	/* avoid acquiring the lock if there is no room for fouther addresses */
-	if (!READ_ONCE(pm->accept_addr))
-		return;
+	mptcp_event_addr_announced(msk, addr);
 
 	spin_lock_bh(&pm->lock);
 
-	/* be sure there is something to signal re-checking under PM lock */
-	if (READ_ONCE(pm->accept_addr) &&
-	    mptcp_pm_schedule_work(msk, MPTCP_PM_ADD_ADDR_RECEIVED))
+	/* if there is no room for fourther addresses, just echo the
+	 * announcement, otherwise the echo is sent after the new subflows
+	 * have been created
+	 */
+	if (!READ_ONCE(pm->accept_addr)) {
+		mptcp_pm_announce_addr(msk, addr, true);
+		mptcp_pm_add_addr_send_ack(msk);
+	} else if (mptcp_pm_schedule_work(msk, MPTCP_PM_ADD_ADDR_RECEIVED)) {
 		pm->remote = *addr;
+	}
 
 	spin_unlock_bh(&pm->lock);
 }
 
+void mptcp_pm_add_addr_echoed(struct mptcp_sock *msk,
+			      const struct mptcp_addr_info *addr)
+{
+	pr_debug("msk=%p local_id=%d", msk, addr->id);
+
+	mptcp_pm_del_add_timer(msk, addr);
+}
+
+/* called with the PM lock held */
+void mptcp_pm_add_addr_send_ack(struct mptcp_sock *msk)
+{
+	if (!mptcp_pm_should_signal(msk) && !mptcp_pm_should_rm_signal(msk))
+		return;
+
+	mptcp_pm_schedule_work(msk, MPTCP_PM_ADD_ADDR_SEND_ACK);
+}
+
+void mptcp_pm_rm_addr_received(struct mptcp_sock *msk, u8 rm_id)
+{
+	struct mptcp_pm_data *pm = &msk->pm;
+
+	pr_debug("msk=%p remote_id=%d", msk, rm_id);
+
+	mptcp_event_addr_removed(msk, rm_id);
+
+	spin_lock_bh(&pm->lock);
+	__set_bit(rm_id, pm->rm_ids_rcv);
+	mptcp_pm_schedule_work(msk, MPTCP_PM_RM_ADDR_RECEIVED);
+	spin_unlock_bh(&pm->lock);
+}
+
 /* path manager helpers */
 
+/* echoes and announcements are sent one at a time, echoes first. The
+ * pending signal is cleared only if @consume is set, that is, when the
+ * option is really going to be written on the wire.
+ */
 bool mptcp_pm_addr_signal(struct mptcp_sock *msk, unsigned int remaining,
-			  struct mptcp_addr_info *saddr)
+			  struct mptcp_addr_info *saddr, bool *echo,
+			  bool consume)
 {
+	u8 add_addr;
 	int ret = false;
 
 	spin_lock_bh(&msk->pm.lock);
@@ -162,11 +229,43 @@ bool mptcp_pm_addr_signal(struct mptcp_sock *msk, unsigned int remaining,
 	if (!mptcp_pm_should_signal(msk))
 		goto out_unlock;
 
-	if (remaining < mptcp_add_addr_len(msk->pm.local.family))
+	add_addr = READ_ONCE(msk->pm.addr_signal);
+	*echo = !!(add_addr & MPTCP_ADD_ADDR_ECHO);
+	*saddr = *echo ? msk->pm.remote : msk->pm.local;
+	if (remaining < mptcp_add_addr_len(saddr->family, *echo,
+					   !!saddr->port))
+		goto out_unlock;
+
+	if (consume) {
+		add_addr &= *echo ? ~MPTCP_ADD_ADDR_ECHO :
+				    ~MPTCP_ADD_ADDR_SIGNAL;
+		WRITE_ONCE(msk->pm.addr_signal, add_addr);
+	}
+	ret = true;
+
+out_unlock:
+	spin_unlock_bh(&msk->pm.lock);
+	return ret;
+}
+
+bool mptcp_pm_rm_addr_signal(struct mptcp_sock *msk, unsigned int remaining,
+			     u8 *rm_id, bool consume)
+{
+	int ret = false;
+
+	spin_lock_bh(&msk->pm.lock);
+
+	if (!mptcp_pm_should_rm_signal(msk))
+		goto out_unlock;
+
+	if (remaining < TCPOLEN_MPTCP_RM_ADDR_BASE)
 		goto out_unlock;
 
-	*saddr = msk->pm.local;
-	WRITE_ONCE(msk->pm.addr_signal, false);
+	*rm_id = msk->pm.rm_id;
+	if (consume)
+		WRITE_ONCE(msk->pm.addr_signal,
+			   READ_ONCE(msk->pm.addr_signal) &
+			   ~MPTCP_RM_ADDR_SIGNAL);
 	ret = true;
 
 out_unlock:
@@ -186,12 +285,14 @@ void mptcp_pm_data_init(struct mptcp_sock *msk)
 	msk->pm.local_addr_used = 0;
 	msk->pm.subflows = 0;
 	WRITE_ONCE(msk->pm.work_pending, false);
-	WRITE_ONCE(msk->pm.addr_signal, false);
+	WRITE_ONCE(msk->pm.addr_signal, 0);
 	WRITE_ONCE(msk->pm.accept_addr, false);
 	WRITE_ONCE(msk->pm.accept_subflow, false);
 	msk->pm.status = 0;
+	bitmap_zero(msk->pm.rm_ids_rcv, MPTCP_PM_MAX_ADDR_ID + 1);
 
 	spin_lock_init(&msk->pm.lock);
+	INIT_LIST_HEAD(&msk->pm.anno_list);
 
 	mptcp_pm_nl_data_init(msk);
 }
@@ -15,6 +15,7 @@
 #include <uapi/linux/mptcp.h>
 
 #include "protocol.h"
+#include "mib.h"
 
 /* forward declaration */
 static struct genl_family mptcp_genl_family;
@@ -27,6 +28,15 @@ struct mptcp_pm_addr_entry {
 	int			ifindex;
 	struct mptcp_addr_info	addr;
 	struct rcu_head		rcu;
+	struct socket		*lsk;	/* listener for signaled ports */
+};
+
+struct mptcp_pm_add_entry {
+	struct list_head	list;
+	struct mptcp_addr_info	addr;
+	struct timer_list	add_timer;
+	struct mptcp_sock	*sock;
+	u8			retrans_times;
 };
 
 struct pm_nl_pernet {
@@ -37,11 +47,16 @@ struct pm_nl_pernet {
 	unsigned int		add_addr_signal_max;
 	unsigned int		add_addr_accept_max;
 	unsigned int		local_addr_max;
+	unsigned int		local_addr_ndiffports;
 	unsigned int		subflows_max;
 	unsigned int		next_id;
 };
 
 #define MPTCP_PM_ADDR_MAX	8
+#define ADD_ADDR_RETRANS_MAX	3
+
+#define MPTCP_PM_ADDR_FLAG_SUBFLOW_ONLY	(MPTCP_PM_ADDR_FLAG_FULLMESH | \
+					 MPTCP_PM_ADDR_FLAG_NDIFFPORTS)
 
 static bool addresses_equal(const struct mptcp_addr_info *a,
 			    struct mptcp_addr_info *b, bool use_port)
@@ -110,12 +125,55 @@ static bool lookup_subflow_by_saddr(const struct list_head *list,
 	return false;
 }
 
+static bool lookup_subflow_by_addrs(const struct list_head *list,
+				    struct mptcp_addr_info *saddr,
+				    struct mptcp_addr_info *daddr)
+{
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_addr_info cur;
+	struct sock_common *skc;
+
+	list_for_each_entry(subflow, list, node) {
+		skc = (struct sock_common *)mptcp_subflow_tcp_sock(subflow);
+
+		local_address(skc, &cur);
+		if (!addresses_equal(&cur, saddr, false))
+			continue;
+
+		remote_address(skc, &cur);
+		if (addresses_equal(&cur, daddr, false))
+			return true;
+	}
+
+	return false;
+}
+
+/* fullmesh endpoints are in use only once connected to the initial remote
+ * address, the ADD_ADDR handling takes care of the other ones
+ */
+static bool local_address_in_use(struct mptcp_sock *msk,
+				 struct mptcp_pm_addr_entry *entry)
+{
+	struct mptcp_addr_info remote;
+
+	if (!(entry->flags & MPTCP_PM_ADDR_FLAG_FULLMESH))
+		return lookup_subflow_by_saddr(&msk->conn_list, &entry->addr) ||
+		       lookup_subflow_by_saddr(&msk->join_list, &entry->addr);
+
+	remote_address((struct sock_common *)msk, &remote);
+	return lookup_subflow_by_addrs(&msk->conn_list, &entry->addr,
+				       &remote) ||
+	       lookup_subflow_by_addrs(&msk->join_list, &entry->addr, &remote);
+}
+
 static struct mptcp_pm_addr_entry *
 select_local_address(const struct pm_nl_pernet *pernet,
-		     struct mptcp_sock *msk)
+		     struct mptcp_sock *msk, bool *reuse)
 {
 	struct mptcp_pm_addr_entry *entry, *ret = NULL;
+	int family = ((struct sock *)msk)->sk_family;
 
+	*reuse = false;
 	rcu_read_lock();
 	spin_lock_bh(&msk->join_list_lock);
 	list_for_each_entry_rcu(entry, &pernet->local_addr_list, list) {
@@ -125,18 +183,96 @@ select_local_address(const struct pm_nl_pernet *pernet,
 		/* avoid any address already in use by subflows and
 		 * pending join
 		 */
-		if (entry->addr.family == ((struct sock *)msk)->sk_family &&
-		    !lookup_subflow_by_saddr(&msk->conn_list, &entry->addr) &&
-		    !lookup_subflow_by_saddr(&msk->join_list, &entry->addr)) {
+		if (entry->addr.family == family &&
+		    !local_address_in_use(msk, entry)) {
 			ret = entry;
 			break;
 		}
 	}
 	spin_unlock_bh(&msk->join_list_lock);
+
+	/* all the endpoints are in use, ndiffports ones can open additional
+	 * subflows on the same path, with a different source port
+	 */
+	if (!ret && msk->pm.ndiffports) {
+		list_for_each_entry_rcu(entry, &pernet->local_addr_list, list) {
+			if ((entry->flags & MPTCP_PM_ADDR_FLAG_NDIFFPORTS) &&
+			    entry->addr.family == family) {
+				*reuse = true;
+				ret = entry;
+				break;
+			}
+		}
+	}
 	rcu_read_unlock();
 	return ret;
 }
 
+/* Collect the distinct remote addresses in use by the msk subflows, starting
+ * with the initial one, skipping the ones already reached from the given
+ * local address. Called with the msk socket lock and the PM lock held, so
+ * only conn_list is walked: the msk worker flushes the join list before
+ * running the PM.
+ */
+static unsigned int fill_remote_addresses_vec(struct mptcp_sock *msk,
+					      struct mptcp_addr_info *local,
+					      struct mptcp_addr_info *addrs)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_addr_info remote;
+	unsigned int i, nr = 0;
+
+	remote_address((struct sock_common *)sk, &addrs[nr++]);
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		remote_address((struct sock_common *)ssk, &remote);
+		if (lookup_subflow_by_addrs(&msk->conn_list, local, &remote))
+			continue;
+
+		for (i = 0; i < nr; i++) {
+			if (addresses_equal(&addrs[i], &remote, true))
+				break;
+		}
+		if (i < nr)
+			continue;
+
+		addrs[nr++] = remote;
+		if (nr == MPTCP_PM_ADDR_MAX)
+			break;
+	}
+
+	return nr;
+}
+
+/* Collect the fullmesh endpoints usable towards the given remote address */
+static unsigned int fill_local_addresses_vec(struct mptcp_sock *msk,
+					     const struct mptcp_addr_info *remote,
+					     struct mptcp_pm_addr_entry *entries)
+{
+	struct mptcp_pm_addr_entry *entry;
+	struct pm_nl_pernet *pernet;
+	unsigned int nr = 0;
+
+	pernet = net_generic(sock_net((struct sock *)msk), pm_nl_pernet_id);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(entry, &pernet->local_addr_list, list) {
+		if (!(entry->flags & MPTCP_PM_ADDR_FLAG_FULLMESH) ||
+		    entry->addr.family != remote->family)
+			continue;
+
+		entries[nr++] = *entry;
+		if (nr == MPTCP_PM_ADDR_MAX)
+			break;
+	}
+	rcu_read_unlock();
+
+	return nr;
+}
+
 static struct mptcp_pm_addr_entry *
 select_signal_address(struct pm_nl_pernet *pernet, unsigned int pos)
 {
@@ -161,20 +297,171 @@ select_signal_address(struct pm_nl_pernet *pernet, unsigned int pos)
 	return ret;
 }
 
+static struct mptcp_pm_add_entry *
+lookup_anno_list_by_saddr(const struct mptcp_sock *msk,
+			  const struct mptcp_addr_info *addr)
+{
+	struct mptcp_pm_add_entry *entry;
+
+	list_for_each_entry(entry, &msk->pm.anno_list, list) {
+		if (addresses_equal(&entry->addr, (struct mptcp_addr_info *)addr,
+				    true))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void mptcp_pm_add_timer(struct timer_list *timer)
+{
+	struct mptcp_pm_add_entry *entry = from_timer(entry, timer, add_timer);
+	struct mptcp_sock *msk = entry->sock;
+	struct sock *sk = (struct sock *)msk;
+
+	pr_debug("msk=%p id=%d retrans=%d", msk, entry->addr.id,
+		 entry->retrans_times);
+
+	if (inet_sk_state_load(sk) == TCP_CLOSE)
+		goto out;
+
+	spin_lock_bh(&msk->pm.lock);
+
+	/* echoed, or removed, in the meantime */
+	if (entry->retrans_times >= ADD_ADDR_RETRANS_MAX)
+		goto out_unlock;
+
+	/* don't clobber another pending announcement, retry shortly */
+	if (READ_ONCE(msk->pm.addr_signal) & MPTCP_ADD_ADDR_SIGNAL) {
+		sk_reset_timer(sk, timer, jiffies + TCP_RTO_MAX / 8);
+		goto out_unlock;
+	}
+
+	mptcp_pm_announce_addr(msk, &entry->addr, false);
+	mptcp_pm_add_addr_send_ack(msk);
+	MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_ADDADDRTX);
+
+	if (++entry->retrans_times < ADD_ADDR_RETRANS_MAX)
+		sk_reset_timer(sk, timer,
+			       jiffies +
+			       mptcp_get_add_addr_timeout(sock_net(sk)));
+
+out_unlock:
+	spin_unlock_bh(&msk->pm.lock);
+out:
+	sock_put(sk);
+}
+
+/* track an announced address, retransmitting it until the peer echoes it.
+ * Announcing an already tracked address restarts its retransmissions.
+ * Called with the PM lock held.
+ */
+static void mptcp_pm_add_anno_entry(struct mptcp_sock *msk,
+				    const struct mptcp_addr_info *addr)
+{
+	struct mptcp_pm_add_entry *entry;
+	struct sock *sk = (struct sock *)msk;
+
+	entry = lookup_anno_list_by_saddr(msk, addr);
+	if (!entry) {
+		entry = kmalloc(sizeof(*entry), GFP_ATOMIC);
+		if (!entry)
+			return;
+
+		entry->addr = *addr;
+		entry->sock = msk;
+		timer_setup(&entry->add_timer, mptcp_pm_add_timer, 0);
+		list_add(&entry->list, &msk->pm.anno_list);
+	}
+
+	entry->retrans_times = 0;
+	sk_reset_timer(sk, &entry->add_timer,
+		       jiffies + mptcp_get_add_addr_timeout(sock_net(sk)));
+}
+
+/* the peer echoed the announcement: stop the retransmissions. The timer
+ * callback re-checks retrans_times under the PM lock, no need to wait for it
+ */
+void mptcp_pm_del_add_timer(struct mptcp_sock *msk,
+			    const struct mptcp_addr_info *addr)
+{
+	struct mptcp_pm_add_entry *entry;
+	struct sock *sk = (struct sock *)msk;
+
+	spin_lock_bh(&msk->pm.lock);
+	entry = lookup_anno_list_by_saddr(msk, addr);
+	if (entry) {
+		entry->retrans_times = ADD_ADDR_RETRANS_MAX;
+		sk_stop_timer(sk, &entry->add_timer);
+	}
+	spin_unlock_bh(&msk->pm.lock);
+}
+
+/* called with the msk socket lock held */
+static bool mptcp_pm_remove_anno_entry(struct mptcp_sock *msk, u8 id)
+{
+	struct mptcp_pm_add_entry *entry, *found = NULL;
+	struct sock *sk = (struct sock *)msk;
+
+	spin_lock_bh(&msk->pm.lock);
+	list_for_each_entry(entry, &msk->pm.anno_list, list) {
+		if (entry->addr.id == id) {
+			found = entry;
+			found->retrans_times = ADD_ADDR_RETRANS_MAX;
+			list_del(&found->list);
+			break;
+		}
+	}
+	spin_unlock_bh(&msk->pm.lock);
+
+	if (!found)
+		return false;
+
+	if (del_timer_sync(&found->add_timer))
+		__sock_put(sk);
+	kfree(found);
+	return true;
+}
+
+/* Pending timers hold a reference to the msk, so at destructor time none can
+ * be armed, and the last reference may have been dropped by the timer
+ * callback itself: @stop_timers must be false there.
+ */
+void mptcp_pm_free_anno_list(struct mptcp_sock *msk, bool stop_timers)
+{
+	struct mptcp_pm_add_entry *entry, *tmp;
+	struct sock *sk = (struct sock *)msk;
+	LIST_HEAD(free_list);
+
+	pr_debug("msk=%p", msk);
+
+	spin_lock_bh(&msk->pm.lock);
+	list_splice_init(&msk->pm.anno_list, &free_list);
+	spin_unlock_bh(&msk->pm.lock);
+
+	list_for_each_entry_safe(entry, tmp, &free_list, list) {
+		if (stop_timers && del_timer_sync(&entry->add_timer))
+			__sock_put(sk);
+		kfree(entry);
+	}
+}
+
 static void check_work_pending(struct mptcp_sock *msk)
 {
 	if (msk->pm.add_addr_signaled == msk->pm.add_addr_signal_max &&
-	    (msk->pm.local_addr_used == msk->pm.local_addr_max ||
+	    ((msk->pm.local_addr_used == msk->pm.local_addr_max &&
+	      !msk->pm.ndiffports) ||
 	     msk->pm.subflows == msk->pm.subflows_max))
 		WRITE_ONCE(msk->pm.work_pending, false);
 }
 
 static void mptcp_pm_create_subflow_or_signal_addr(struct mptcp_sock *msk)
 {
+	struct mptcp_addr_info remotes[MPTCP_PM_ADDR_MAX];
 	struct sock *sk = (struct sock *)msk;
 	struct mptcp_pm_addr_entry *local;
-	struct mptcp_addr_info remote;
 	struct pm_nl_pernet *pernet;
+	unsigned int i, nr;
+	bool reuse;
 
 	pernet = net_generic(sock_net((struct sock *)msk), pm_nl_pernet_id);
 
@@ -190,7 +477,9 @@ static void mptcp_pm_create_subflow_or_signal_addr(struct mptcp_sock *msk)
 
 		if (local) {
 			msk->pm.add_addr_signaled++;
-			mptcp_pm_announce_addr(msk, &local->addr);
+			mptcp_pm_announce_addr(msk, &local->addr, false);
+			mptcp_pm_add_anno_entry(msk, &local->addr);
+			mptcp_pm_add_addr_send_ack(msk);
 		} else {
 			/* pick failed, avoid fourther attempts later */
 			msk->pm.local_addr_used = msk->pm.add_addr_signal_max;
@@ -200,24 +489,42 @@ static void mptcp_pm_create_subflow_or_signal_addr(struct mptcp_sock *msk)
 	}
 
 	/* check if should create a new subflow */
-	if (msk->pm.local_addr_used < msk->pm.local_addr_max &&
+	if ((msk->pm.local_addr_used < msk->pm.local_addr_max ||
+	     msk->pm.ndiffports) &&
 	    msk->pm.subflows < msk->pm.subflows_max) {
-		remote_address((struct sock_common *)sk, &remote);
-
-		local = select_local_address(pernet, msk);
+		local = select_local_address(pernet, msk, &reuse);
 		if (local) {
-			msk->pm.local_addr_used++;
-			msk->pm.subflows++;
+			/* fullmesh endpoints connect to every known remote
+			 * address, the others only to the initial one
+			 */
+			if (local->flags & MPTCP_PM_ADDR_FLAG_FULLMESH) {
+				nr = fill_remote_addresses_vec(msk, &local->addr,
+							       remotes);
+			} else {
+				remote_address((struct sock_common *)sk,
+					       &remotes[0]);
+				nr = 1;
+			}
+			nr = min_t(unsigned int, nr,
+				   msk->pm.subflows_max - msk->pm.subflows);
+
+			if (!reuse)
+				msk->pm.local_addr_used++;
+			msk->pm.subflows += nr;
 			check_work_pending(msk);
 			spin_unlock_bh(&msk->pm.lock);
-			__mptcp_subflow_connect(sk, local->ifindex,
-						&local->addr, &remote);
+			for (i = 0; i < nr; i++)
+				__mptcp_subflow_connect(sk, local->ifindex,
+							&local->addr,
+							&remotes[i],
+							local->flags);
 			spin_lock_bh(&msk->pm.lock);
 			return;
 		}
 
 		/* lookup failed, avoid fourther attempts later */
 		msk->pm.local_addr_used = msk->pm.local_addr_max;
+		msk->pm.ndiffports = false;
 		check_work_pending(msk);
 	}
 }
@@ -234,31 +541,116 @@ void mptcp_pm_nl_subflow_established(struct mptcp_sock *msk)
 
 void mptcp_pm_nl_add_addr_received(struct mptcp_sock *msk)
 {
+	struct mptcp_pm_addr_entry locals[MPTCP_PM_ADDR_MAX];
+	struct mptcp_addr_info remote, announced;
 	struct sock *sk = (struct sock *)msk;
-	struct mptcp_addr_info remote;
-	struct mptcp_addr_info local;
+	unsigned int i, nr;
 
 	pr_debug("accepted %d:%d remote family %d",
 		 msk->pm.add_addr_accepted, msk->pm.add_addr_accept_max,
 		 msk->pm.remote.family);
+
+	announced = msk->pm.remote;
+	remote = announced;
+	if (!remote.port)
+		remote.port = sk->sk_dport;
+
+	/* connect to the specified remote address from every fullmesh
+	 * endpoint, or else using whatever local address the routing
+	 * configuration will pick.
+	 */
+	nr = fill_local_addresses_vec(msk, &remote, locals);
+	if (!nr) {
+		memset(&locals[0], 0, sizeof(locals[0]));
+		locals[0].addr.family = remote.family;
+		nr = 1;
+	}
+	nr = min_t(unsigned int, nr, msk->pm.subflows_max - msk->pm.subflows);
+
 	msk->pm.add_addr_accepted++;
-	msk->pm.subflows++;
+	msk->pm.subflows += nr;
 	if (msk->pm.add_addr_accepted >= msk->pm.add_addr_accept_max ||
 	    msk->pm.subflows >= msk->pm.subflows_max)
 		WRITE_ONCE(msk->pm.accept_addr, false);
 
-	/* connect to the specified remote address, using whatever
-	 * local address the routing configuration will pick.
-	 */
-	remote = msk->pm.remote;
-	if (!remote.port)
-		remote.port = sk->sk_dport;
-	memset(&local, 0, sizeof(local));
-	local.family = remote.family;
-
 	spin_unlock_bh(&msk->pm.lock);
-	__mptcp_subflow_connect((struct sock *)msk, 0, &local, &remote);
+	for (i = 0; i < nr; i++)
+		__mptcp_subflow_connect(sk, locals[i].ifindex, &locals[i].addr,
+					&remote, locals[i].flags);
 	spin_lock_bh(&msk->pm.lock);
+
+	mptcp_pm_announce_addr(msk, &announced, true);
+	mptcp_pm_add_addr_send_ack(msk);
+}
+
+/* close the subflows using the address @id, local or remote according to
+ * @local; the initial subflow is owned by the msk and is never closed here.
+ * Data not acked at the MPTCP level yet is reinjected on the other subflows.
+ * Called with the msk socket lock held, and the PM lock not held.
+ */
+static unsigned int mptcp_pm_nl_close_subflows(struct mptcp_sock *msk, u8 id,
+					       bool local)
+{
+	struct mptcp_subflow_context *subflow, *tmp;
+	struct sock *sk = (struct sock *)msk;
+	unsigned int removed = 0;
+
+	__mptcp_flush_join_list(msk);
+	list_for_each_entry_safe(subflow, tmp, &msk->conn_list, node) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		if ((local ? subflow->local_id : subflow->remote_id) != id)
+			continue;
+		if (ssk == msk->first)
+			continue;
+
+		pr_debug("msk=%p subflow=%p id=%d local=%d", msk, subflow, id,
+			 local);
+		__mptcp_close_ssk(sk, ssk, subflow, 0);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_RMSUBFLOW);
+		removed++;
+	}
+
+	if (removed) {
+		set_bit(MPTCP_WORK_RTX, &msk->flags);
+		mptcp_schedule_work(sk);
+	}
+	return removed;
+}
+
+/* called with the PM lock held, from the msk worker */
+void mptcp_pm_nl_rm_addr_received(struct mptcp_sock *msk)
+{
+	DECLARE_BITMAP(ids, MPTCP_PM_MAX_ADDR_ID + 1);
+	struct sock *sk = (struct sock *)msk;
+	unsigned int removed = 0, addrs = 0;
+	struct mptcp_pm_data *pm = &msk->pm;
+	unsigned int id, nr;
+
+	bitmap_copy(ids, pm->rm_ids_rcv, MPTCP_PM_MAX_ADDR_ID + 1);
+	bitmap_zero(pm->rm_ids_rcv, MPTCP_PM_MAX_ADDR_ID + 1);
+
+	spin_unlock_bh(&pm->lock);
+	for_each_set_bit(id, ids, MPTCP_PM_MAX_ADDR_ID + 1) {
+		nr = mptcp_pm_nl_close_subflows(msk, id, false);
+		if (nr) {
+			removed += nr;
+			addrs++;
+		}
+	}
+	spin_lock_bh(&pm->lock);
+
+	if (!removed)
+		return;
+
+	pm->subflows -= min_t(unsigned int, pm->subflows, removed);
+	pm->add_addr_accepted -= min_t(unsigned int, pm->add_addr_accepted,
+				       addrs);
+	WRITE_ONCE(pm->accept_subflow, pm->subflows < pm->subflows_max);
+	if (mptcp_get_pm_type(sock_net(sk)) == MPTCP_PM_TYPE_KERNEL)
+		WRITE_ONCE(pm->accept_addr,
+			   pm->add_addr_accepted < pm->add_addr_accept_max &&
+			   pm->subflows < pm->subflows_max);
 }
 
 static bool address_use_port(struct mptcp_pm_addr_entry *entry)
@@ -297,6 +689,8 @@ static int mptcp_pm_nl_append_new_local_addr(struct pm_nl_pernet *pernet,
 		pernet->add_addr_signal_max++;
 	if (entry->flags & MPTCP_PM_ADDR_FLAG_SUBFLOW)
 		pernet->local_addr_max++;
+	if (entry->flags & MPTCP_PM_ADDR_FLAG_NDIFFPORTS)
+		pernet->local_addr_ndiffports++;
 
 	entry->addr.id = pernet->next_id++;
 	pernet->addrs++;
@@ -323,7 +717,7 @@ int mptcp_pm_nl_get_local_id(struct mptcp_sock *msk, struct sock_common *skc)
 	 * addr
 	 */
 	local_address((struct sock_common *)msk, &msk_local);
-	local_address((struct sock_common *)msk, &skc_local);
+	local_address(skc, &skc_local);
 	if (addresses_equal(&msk_local, &skc_local, false))
 		return 0;
 
@@ -346,6 +740,8 @@ int mptcp_pm_nl_get_local_id(struct mptcp_sock *msk, struct sock_common *skc)
 		return -ENOMEM;
 
 	entry->flags = 0;
+	entry->ifindex = 0;
+	entry->lsk = NULL;
 	entry->addr = skc_local;
 	ret = mptcp_pm_nl_append_new_local_addr(pernet, entry);
 	if (ret < 0)
@@ -366,17 +762,29 @@ void mptcp_pm_nl_data_init(struct mptcp_sock *msk)
 	pm->add_addr_accept_max = READ_ONCE(pernet->add_addr_accept_max);
 	pm->local_addr_max = READ_ONCE(pernet->local_addr_max);
 	pm->subflows_max = READ_ONCE(pernet->subflows_max);
+	pm->ndiffports = !!READ_ONCE(pernet->local_addr_ndiffports);
 	subflows = !!pm->subflows_max;
+	WRITE_ONCE(pm->accept_subflow, subflows);
+
+	/* a userspace daemon owns announcements and outgoing subflows,
+	 * driven by the netlink events; only incoming MP_JOINs are still
+	 * accepted here, according to the limits
+	 */
+	if (mptcp_get_pm_type(sock_net((struct sock *)msk)) ==
+	    MPTCP_PM_TYPE_USERSPACE)
+		return;
+
 	WRITE_ONCE(pm->work_pending, (!!pm->local_addr_max && subflows) ||
 		   !!pm->add_addr_signal_max);
 	WRITE_ONCE(pm->accept_addr, !!pm->add_addr_accept_max && subflows);
-	WRITE_ONCE(pm->accept_subflow, subflows);
 }
 
 #define MPTCP_PM_CMD_GRP_OFFSET	0
+#define MPTCP_PM_EV_GRP_OFFSET	1
 
 static const struct genl_multicast_group mptcp_pm_mcgrps[] = {
 	[MPTCP_PM_CMD_GRP_OFFSET]	= { .name = MPTCP_PM_CMD_GRP_NAME, },
+	[MPTCP_PM_EV_GRP_OFFSET]	= { .name = MPTCP_PM_EV_GRP_NAME, },
 };
 
 static const struct nla_policy
@@ -396,6 +804,9 @@ static const struct nla_policy mptcp_pm_policy[MPTCP_PM_ATTR_MAX + 1] = {
 					NLA_POLICY_NESTED(mptcp_pm_addr_policy),
 	[MPTCP_PM_ATTR_RCV_ADD_ADDRS]	= { .type	= NLA_U32,	},
 	[MPTCP_PM_ATTR_SUBFLOWS]	= { .type	= NLA_U32,	},
+	[MPTCP_PM_ATTR_TOKEN]		= { .type	= NLA_U32,	},
+	[MPTCP_PM_ATTR_ADDR_REMOTE]	=
+					NLA_POLICY_NESTED(mptcp_pm_addr_policy),
 };
 
 static int mptcp_pm_family_to_addr(int family)
@@ -460,6 +871,9 @@ static int mptcp_pm_parse_addr(struct nlattr *attr, struct genl_info *info,
 		entry->addr.addr.s_addr = nla_get_in_addr(tb[addr_addr]);
 
 skip_family:
+	if (tb[MPTCP_PM_ADDR_ATTR_PORT])
+		entry->addr.port = htons(nla_get_u16(tb[MPTCP_PM_ADDR_ATTR_PORT]));
+
 	if (tb[MPTCP_PM_ADDR_ATTR_IF_IDX])
 		entry->ifindex = nla_get_s32(tb[MPTCP_PM_ADDR_ATTR_IF_IDX]);
 
@@ -477,6 +891,44 @@ static struct pm_nl_pernet *genl_info_pm_nl(struct genl_info *info)
 	return net_generic(genl_info_net(info), pm_nl_pernet_id);
 }
 
+/* MP_JOIN requests towards a signaled port need a listener bound to it: the
+ * joined subflows are attached to their msk, looked up by token, and never
+ * land in this socket accept queue. Nobody accepts from it, so any other
+ * SYN is refused.
+ */
+static int mptcp_pm_nl_create_listen_socket(struct net *net,
+					    struct mptcp_pm_addr_entry *entry)
+{
+	int addrlen = sizeof(struct sockaddr_in);
+	struct sockaddr_storage addr;
+	int backlog = 1024;
+	int err;
+
+	err = sock_create_kern(net, entry->addr.family, SOCK_STREAM,
+			       IPPROTO_MPTCP, &entry->lsk);
+	if (err)
+		return err;
+
+#if IS_ENABLED(CONFIG_MPTCP_IPV6)
+	if (entry->addr.family == AF_INET6)
+		addrlen = sizeof(struct sockaddr_in6);
+#endif
+	mptcp_info2sockaddr(&entry->addr, &addr);
+	err = kernel_bind(entry->lsk, (struct sockaddr *)&addr, addrlen);
+	if (!err) {
+		struct socket *ssock = mptcp_sk(entry->lsk->sk)->subflow;
+
+		mptcp_subflow_ctx(ssock->sk)->join_only = 1;
+		err = kernel_listen(entry->lsk, backlog);
+	}
+	if (err) {
+		sock_release(entry->lsk);
+		entry->lsk = NULL;
+	}
+
+	return err;
+}
+
 static int mptcp_nl_cmd_add_addr(struct sk_buff *skb, struct genl_info *info)
 {
 	struct nlattr *attr = info->attrs[MPTCP_PM_ATTR_ADDR];
@@ -488,6 +940,17 @@ static int mptcp_nl_cmd_add_addr(struct sk_buff *skb, struct genl_info *info)
 	if (ret < 0)
 		return ret;
 
+	if ((addr.flags & MPTCP_PM_ADDR_FLAG_SUBFLOW_ONLY) &&
+	    !(addr.flags & MPTCP_PM_ADDR_FLAG_SUBFLOW)) {
+		GENL_SET_ERR_MSG(info, "flags fullmesh and ndiffports require subflow");
+		return -EINVAL;
+	}
+
+	if (addr.addr.port && !address_use_port(&addr)) {
+		GENL_SET_ERR_MSG(info, "port requires the signal flag only");
+		return -EINVAL;
+	}
+
 	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
 	if (!entry) {
 		GENL_SET_ERR_MSG(info, "can't allocate addr");
@@ -495,9 +958,21 @@ static int mptcp_nl_cmd_add_addr(struct sk_buff *skb, struct genl_info *info)
 	}
 
 	*entry = addr;
+	if (entry->addr.port) {
+		ret = mptcp_pm_nl_create_listen_socket(genl_info_net(info),
+						       entry);
+		if (ret) {
+			GENL_SET_ERR_MSG(info, "can't create the listener socket");
+			kfree(entry);
+			return ret;
+		}
+	}
+
 	ret = mptcp_pm_nl_append_new_local_addr(pernet, entry);
 	if (ret < 0) {
 		GENL_SET_ERR_MSG(info, "too many addresses or duplicate one");
+		if (entry->lsk)
+			sock_release(entry->lsk);
 		kfree(entry);
 		return ret;
 	}
@@ -517,11 +992,61 @@ __lookup_addr_by_id(struct pm_nl_pernet *pernet, unsigned int id)
 	return NULL;
 }
 
+/* withdraw the address @id from @msk: send RM_ADDR if the peer knows about
+ * it, because it was announced or used by some subflow, and close such
+ * subflows. Called with the msk socket lock held.
+ */
+static void mptcp_pm_nl_rm_addr(struct mptcp_sock *msk, u8 id)
+{
+	struct mptcp_pm_data *pm = &msk->pm;
+	unsigned int removed;
+	bool announced;
+
+	announced = mptcp_pm_remove_anno_entry(msk, id);
+	removed = mptcp_pm_nl_close_subflows(msk, id, true);
+	if (!announced && !removed)
+		return;
+
+	spin_lock_bh(&pm->lock);
+	if (removed) {
+		pm->subflows -= min_t(unsigned int, pm->subflows, removed);
+		if (pm->local_addr_used)
+			pm->local_addr_used--;
+		WRITE_ONCE(pm->accept_subflow, pm->subflows < pm->subflows_max);
+	}
+	pm->rm_id = id;
+	WRITE_ONCE(pm->addr_signal,
+		   READ_ONCE(pm->addr_signal) | MPTCP_RM_ADDR_SIGNAL);
+	spin_unlock_bh(&pm->lock);
+
+	mptcp_pm_nl_addr_send_ack(msk);
+}
+
+static void mptcp_nl_remove_addr(struct net *net, u8 id)
+{
+	long s_slot = 0, s_num = 0;
+	struct mptcp_sock *msk;
+
+	while ((msk = mptcp_token_iter_next(net, &s_slot, &s_num)) != NULL) {
+		struct sock *sk = (struct sock *)msk;
+
+		if (!__mptcp_check_fallback(msk)) {
+			lock_sock(sk);
+			mptcp_pm_nl_rm_addr(msk, id);
+			release_sock(sk);
+		}
+
+		sock_put(sk);
+		cond_resched();
+	}
+}
+
 static int mptcp_nl_cmd_del_addr(struct sk_buff *skb, struct genl_info *info)
 {
 	struct nlattr *attr = info->attrs[MPTCP_PM_ATTR_ADDR];
 	struct pm_nl_pernet *pernet = genl_info_pm_nl(info);
 	struct mptcp_pm_addr_entry addr, *entry;
+	struct socket *lsk;
 	int ret;
 
 	ret = mptcp_pm_parse_addr(attr, info, false, &addr);
@@ -531,33 +1056,51 @@ static int mptcp_nl_cmd_del_addr(struct sk_buff *skb, struct genl_info *info)
 	spin_lock_bh(&pernet->lock);
 	entry = __lookup_addr_by_id(pernet, addr.addr.id);
 	if (!entry) {
+		spin_unlock_bh(&pernet->lock);
 		GENL_SET_ERR_MSG(info, "address not found");
-		ret = -EINVAL;
-		goto out;
+		return -EINVAL;
 	}
 	if (entry->flags & MPTCP_PM_ADDR_FLAG_SIGNAL)
 		pernet->add_addr_signal_max--;
 	if (entry->flags & MPTCP_PM_ADDR_FLAG_SUBFLOW)
 		pernet->local_addr_max--;
+	if (entry->flags & MPTCP_PM_ADDR_FLAG_NDIFFPORTS)
+		pernet->local_addr_ndiffports--;
 
 	pernet->addrs--;
 	list_del_rcu(&entry->list);
+	lsk = entry->lsk;
 	kfree_rcu(entry, rcu);
-out:
 	spin_unlock_bh(&pernet->lock);
-	return ret;
+
+	mptcp_nl_remove_addr(genl_info_net(info), addr.addr.id);
+	if (lsk)
+		sock_release(lsk);
+	return 0;
 }
 
-static void __flush_addrs(struct pm_nl_pernet *pernet)
+/* unlink all the endpoints, saving their ids and listeners: both must be
+ * disposed of outside the pernet lock
+ */
+static unsigned int __flush_addrs(struct pm_nl_pernet *pernet, u8 *ids,
+				  struct socket **lsks)
 {
+	unsigned int nr = 0;
+
 	while (!list_empty(&pernet->local_addr_list)) {
 		struct mptcp_pm_addr_entry *cur;
 
 		cur = list_entry(pernet->local_addr_list.next,
 				 struct mptcp_pm_addr_entry, list);
 		list_del_rcu(&cur->list);
+		if (!WARN_ON_ONCE(nr >= MPTCP_PM_ADDR_MAX)) {
+			ids[nr] = cur->addr.id;
+			lsks[nr++] = cur->lsk;
+		}
 		kfree_rcu(cur, rcu);
 	}
+
+	return nr;
 }
 
 static void __reset_counters(struct pm_nl_pernet *pernet)
@@ -565,17 +1108,27 @@ static void __reset_counters(struct pm_nl_pernet *pernet)
 	pernet->add_addr_signal_max = 0;
 	pernet->add_addr_accept_max = 0;
 	pernet->local_addr_max = 0;
+	pernet->local_addr_ndiffports = 0;
 	pernet->addrs = 0;
 }
 
 static int mptcp_nl_cmd_flush_addrs(struct sk_buff *skb, struct genl_info *info)
 {
 	struct pm_nl_pernet *pernet = genl_info_pm_nl(info);
+	struct socket *lsks[MPTCP_PM_ADDR_MAX];
+	u8 ids[MPTCP_PM_ADDR_MAX];
+	unsigned int i, nr;
 
 	spin_lock_bh(&pernet->lock);
-	__flush_addrs(pernet);
+	nr = __flush_addrs(pernet, ids, lsks);
 	__reset_counters(pernet);
 	spin_unlock_bh(&pernet->lock);
+
+	for (i = 0; i < nr; i++) {
+		mptcp_nl_remove_addr(genl_info_net(info), ids[i]);
+		if (lsks[i])
+			sock_release(lsks[i]);
+	}
 	return 0;
 }
 
@@ -595,6 +1148,9 @@ static int mptcp_nl_fill_addr(struct sk_buff *skb,
 		goto nla_put_failure;
 	if (nla_put_u32(skb, MPTCP_PM_ADDR_ATTR_FLAGS, entry->flags))
 		goto nla_put_failure;
+	if (addr->port &&
+	    nla_put_u16(skb, MPTCP_PM_ADDR_ATTR_PORT, ntohs(addr->port)))
+		goto nla_put_failure;
 	if (entry->ifindex &&
 	    nla_put_s32(skb, MPTCP_PM_ADDR_ATTR_IF_IDX, entry->ifindex))
 		goto nla_put_failure;
@@ -776,6 +1332,520 @@ mptcp_nl_cmd_get_limits(struct sk_buff *skb, struct genl_info *info)
 	return -EMSGSIZE;
 }
 
+static struct mptcp_pm_addr_entry *
+__lookup_addr(struct pm_nl_pernet *pernet, struct mptcp_addr_info *info)
+{
+	struct mptcp_pm_addr_entry *entry;
+
+	list_for_each_entry(entry, &pernet->local_addr_list, list) {
+		if (addresses_equal(&entry->addr, info, false))
+			return entry;
+	}
+	return NULL;
+}
+
+/* update the backup status of all the subflows of @msk bound to @addr and
+ * let the peer know via MP_PRIO; called with the msk socket lock held
+ */
+static void mptcp_pm_nl_mp_prio_send(struct mptcp_sock *msk,
+				     struct mptcp_addr_info *addr, u8 bkup)
+{
+	struct mptcp_subflow_context *subflow;
+
+	__mptcp_flush_join_list(msk);
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		struct mptcp_addr_info local;
+
+		local_address((struct sock_common *)ssk, &local);
+		if (!addresses_equal(&local, addr, false))
+			continue;
+
+		lock_sock(ssk);
+		if (subflow->request_bkup != bkup) {
+			pr_debug("subflow=%p backup=%d", subflow, bkup);
+			subflow->request_bkup = bkup;
+			subflow->send_mp_prio = 1;
+			tcp_send_ack(ssk);
+		}
+		release_sock(ssk);
+	}
+}
+
+static void mptcp_nl_addr_backup(struct net *net,
+				 struct mptcp_addr_info *addr, u8 bkup)
+{
+	long s_slot = 0, s_num = 0;
+	struct mptcp_sock *msk;
+
+	while ((msk = mptcp_token_iter_next(net, &s_slot, &s_num)) != NULL) {
+		struct sock *sk = (struct sock *)msk;
+
+		if (!__mptcp_check_fallback(msk)) {
+			lock_sock(sk);
+			mptcp_pm_nl_mp_prio_send(msk, addr, bkup);
+			release_sock(sk);
+		}
+
+		sock_put(sk);
+		cond_resched();
+	}
+}
+
+static int mptcp_nl_cmd_set_flags(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *attr = info->attrs[MPTCP_PM_ATTR_ADDR];
+	struct pm_nl_pernet *pernet = genl_info_pm_nl(info);
+	struct mptcp_pm_addr_entry addr, *entry;
+	struct net *net = sock_net(skb->sk);
+	struct mptcp_addr_info local;
+	u8 bkup;
+	int ret;
+
+	ret = mptcp_pm_parse_addr(attr, info, false, &addr);
+	if (ret < 0)
+		return ret;
+
+	bkup = !!(addr.flags & MPTCP_PM_ADDR_FLAG_BACKUP);
+
+	spin_lock_bh(&pernet->lock);
+	if (addr.addr.family)
+		entry = __lookup_addr(pernet, &addr.addr);
+	else
+		entry = __lookup_addr_by_id(pernet, addr.addr.id);
+	if (!entry) {
+		spin_unlock_bh(&pernet->lock);
+		GENL_SET_ERR_MSG(info, "address not found");
+		return -EINVAL;
+	}
+
+	if (bkup)
+		entry->flags |= MPTCP_PM_ADDR_FLAG_BACKUP;
+	else
+		entry->flags &= ~MPTCP_PM_ADDR_FLAG_BACKUP;
+	local = entry->addr;
+	spin_unlock_bh(&pernet->lock);
+
+	mptcp_nl_addr_backup(net, &local, bkup);
+	return 0;
+}
+
+/* the caller must release the reference on the returned msk */
+static struct mptcp_sock *mptcp_nl_get_msk(struct genl_info *info)
+{
+	struct nlattr *token = info->attrs[MPTCP_PM_ATTR_TOKEN];
+	struct mptcp_sock *msk;
+
+	if (!token) {
+		GENL_SET_ERR_MSG(info, "missing token");
+		return ERR_PTR(-EINVAL);
+	}
+
+	msk = mptcp_token_get_sock(genl_info_net(info), nla_get_u32(token));
+	if (!msk) {
+		NL_SET_ERR_MSG_ATTR(info->extack, token, "invalid token");
+		return ERR_PTR(-ENOENT);
+	}
+
+	return msk;
+}
+
+/* let the pending ADD_ADDR and RM_ADDR out on the first subflow, without
+ * waiting for the next data packet; called with the msk socket lock held
+ */
+void mptcp_pm_nl_addr_send_ack(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct sock *ssk;
+
+	__mptcp_flush_join_list(msk);
+	subflow = list_first_entry_or_null(&msk->conn_list,
+					   struct mptcp_subflow_context, node);
+	if (!subflow)
+		return;
+
+	ssk = mptcp_subflow_tcp_sock(subflow);
+	lock_sock(ssk);
+	tcp_send_ack(ssk);
+
+	/* an echo and an announcement are never sent in the same packet */
+	if (mptcp_pm_should_signal(msk))
+		tcp_send_ack(ssk);
+	release_sock(ssk);
+}
+
+static int mptcp_nl_cmd_announce(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *attr = info->attrs[MPTCP_PM_ATTR_ADDR];
+	struct mptcp_pm_addr_entry addr;
+	struct mptcp_sock *msk;
+	struct sock *sk;
+	int ret;
+
+	ret = mptcp_pm_parse_addr(attr, info, true, &addr);
+	if (ret < 0)
+		return ret;
+
+	if (!addr.addr.id) {
+		GENL_SET_ERR_MSG(info, "invalid addr id");
+		return -EINVAL;
+	}
+
+	msk = mptcp_nl_get_msk(info);
+	if (IS_ERR(msk))
+		return PTR_ERR(msk);
+
+	sk = (struct sock *)msk;
+	lock_sock(sk);
+	if (__mptcp_check_fallback(msk) ||
+	    inet_sk_state_load(sk) != TCP_ESTABLISHED) {
+		GENL_SET_ERR_MSG(info, "connection not established");
+		ret = -ENOTCONN;
+		goto out;
+	}
+
+	spin_lock_bh(&msk->pm.lock);
+	if (mptcp_pm_should_signal(msk)) {
+		GENL_SET_ERR_MSG(info, "announce already pending");
+		ret = -EBUSY;
+	} else {
+		ret = mptcp_pm_announce_addr(msk, &addr.addr, false);
+		mptcp_pm_add_anno_entry(msk, &addr.addr);
+	}
+	spin_unlock_bh(&msk->pm.lock);
+
+	if (!ret)
+		mptcp_pm_nl_addr_send_ack(msk);
+
+out:
+	release_sock(sk);
+	sock_put(sk);
+	return ret;
+}
+
+static int mptcp_nl_parse_addrs(struct genl_info *info,
+				struct mptcp_pm_addr_entry *local,
+				struct mptcp_pm_addr_entry *remote)
+{
+	int ret;
+
+	ret = mptcp_pm_parse_addr(info->attrs[MPTCP_PM_ATTR_ADDR], info, true,
+				  local);
+	if (ret < 0)
+		return ret;
+
+	ret = mptcp_pm_parse_addr(info->attrs[MPTCP_PM_ATTR_ADDR_REMOTE], info,
+				  true, remote);
+	if (ret < 0)
+		return ret;
+
+	if (local->addr.family != remote->addr.family) {
+		GENL_SET_ERR_MSG(info, "address families do not match");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int mptcp_nl_cmd_sf_create(struct sk_buff *skb, struct genl_info *info)
+{
+	struct mptcp_pm_addr_entry local, remote;
+	struct mptcp_sock *msk;
+	struct sock *sk;
+	int ret;
+
+	ret = mptcp_nl_parse_addrs(info, &local, &remote);
+	if (ret < 0)
+		return ret;
+
+	msk = mptcp_nl_get_msk(info);
+	if (IS_ERR(msk))
+		return PTR_ERR(msk);
+
+	sk = (struct sock *)msk;
+	lock_sock(sk);
+	if (__mptcp_check_fallback(msk)) {
+		GENL_SET_ERR_MSG(info, "connection fell back to TCP");
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (inet_sk_state_load(sk) != TCP_ESTABLISHED) {
+		GENL_SET_ERR_MSG(info, "connection not established");
+		ret = -ENOTCONN;
+		goto out;
+	}
+
+	/* reserve the subflow slot before connecting, as the in-kernel PM
+	 * does, so that concurrent joins can't exceed the limit
+	 */
+	spin_lock_bh(&msk->pm.lock);
+	if (msk->pm.subflows >= msk->pm.subflows_max) {
+		spin_unlock_bh(&msk->pm.lock);
+		GENL_SET_ERR_MSG(info, "subflows limit reached");
+		ret = -EBUSY;
+		goto out;
+	}
+	msk->pm.subflows++;
+	spin_unlock_bh(&msk->pm.lock);
+
+	if (!remote.addr.port)
+		remote.addr.port = sk->sk_dport;
+
+	ret = __mptcp_subflow_connect(sk, local.ifindex, &local.addr,
+				      &remote.addr, local.flags);
+	if (ret == -EINPROGRESS)
+		ret = 0;
+	if (ret) {
+		spin_lock_bh(&msk->pm.lock);
+		msk->pm.subflows--;
+		spin_unlock_bh(&msk->pm.lock);
+	}
+
+out:
+	release_sock(sk);
+	sock_put(sk);
+	return ret;
+}
+
+static struct mptcp_subflow_context *
+mptcp_nl_find_subflow(struct mptcp_sock *msk, struct mptcp_addr_info *local,
+		      struct mptcp_addr_info *remote)
+{
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_addr_info cur;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		local_address((struct sock_common *)ssk, &cur);
+		cur.port = inet_sk(ssk)->inet_sport;
+		if (!addresses_equal(&cur, local, true))
+			continue;
+
+		remote_address((struct sock_common *)ssk, &cur);
+		if (addresses_equal(&cur, remote, true))
+			return subflow;
+	}
+
+	return NULL;
+}
+
+static int mptcp_nl_cmd_sf_destroy(struct sk_buff *skb, struct genl_info *info)
+{
+	struct mptcp_pm_addr_entry local, remote;
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_sock *msk;
+	struct sock *sk, *ssk;
+	int ret;
+
+	ret = mptcp_nl_parse_addrs(info, &local, &remote);
+	if (ret < 0)
+		return ret;
+
+	if (!local.addr.port || !remote.addr.port) {
+		GENL_SET_ERR_MSG(info, "missing local or remote port");
+		return -EINVAL;
+	}
+
+	msk = mptcp_nl_get_msk(info);
+	if (IS_ERR(msk))
+		return PTR_ERR(msk);
+
+	sk = (struct sock *)msk;
+	lock_sock(sk);
+	__mptcp_flush_join_list(msk);
+	subflow = mptcp_nl_find_subflow(msk, &local.addr, &remote.addr);
+	if (!subflow) {
+		GENL_SET_ERR_MSG(info, "subflow not found");
+		ret = -ESRCH;
+		goto out;
+	}
+
+	/* the initial subflow socket is owned by the msk itself */
+	ssk = mptcp_subflow_tcp_sock(subflow);
+	if (ssk == msk->first) {
+		GENL_SET_ERR_MSG(info, "can't destroy the initial subflow");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	__mptcp_close_ssk(sk, ssk, subflow, 0);
+
+	spin_lock_bh(&msk->pm.lock);
+	if (msk->pm.subflows)
+		msk->pm.subflows--;
+	spin_unlock_bh(&msk->pm.lock);
+
+out:
+	release_sock(sk);
+	sock_put(sk);
+	return ret;
+}
+
+static int mptcp_event_put_token_and_ssk(struct sk_buff *skb,
+					 const struct mptcp_sock *msk,
+					 const struct sock *ssk)
+{
+	struct mptcp_subflow_context *sf = mptcp_subflow_ctx(ssk);
+	const struct inet_sock *issk = inet_sk(ssk);
+
+	if (nla_put_u32(skb, MPTCP_ATTR_TOKEN, msk->token))
+		return -EMSGSIZE;
+
+	if (nla_put_u16(skb, MPTCP_ATTR_FAMILY, ssk->sk_family))
+		return -EMSGSIZE;
+
+	switch (ssk->sk_family) {
+	case AF_INET:
+		if (nla_put_in_addr(skb, MPTCP_ATTR_SADDR4, issk->inet_saddr))
+			return -EMSGSIZE;
+		if (nla_put_in_addr(skb, MPTCP_ATTR_DADDR4, issk->inet_daddr))
+			return -EMSGSIZE;
+		break;
+#if IS_ENABLED(CONFIG_MPTCP_IPV6)
+	case AF_INET6:
+		if (nla_put_in6_addr(skb, MPTCP_ATTR_SADDR6,
+				     &ssk->sk_v6_rcv_saddr))
+			return -EMSGSIZE;
+		if (nla_put_in6_addr(skb, MPTCP_ATTR_DADDR6,
+				     &ssk->sk_v6_daddr))
+			return -EMSGSIZE;
+		break;
+#endif
+	default:
+		WARN_ON_ONCE(1);
+		return -EMSGSIZE;
+	}
+
+	if (nla_put_be16(skb, MPTCP_ATTR_SPORT, issk->inet_sport))
+		return -EMSGSIZE;
+	if (nla_put_be16(skb, MPTCP_ATTR_DPORT, issk->inet_dport))
+		return -EMSGSIZE;
+	if (nla_put_u8(skb, MPTCP_ATTR_LOC_ID, sf->local_id))
+		return -EMSGSIZE;
+	if (nla_put_u8(skb, MPTCP_ATTR_REM_ID, sf->remote_id))
+		return -EMSGSIZE;
+	if (nla_put_u8(skb, MPTCP_ATTR_BACKUP, mptcp_subflow_is_backup(sf)))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+static struct sk_buff *mptcp_event_new(const struct mptcp_sock *msk,
+				       enum mptcp_event_type type, gfp_t gfp,
+				       struct nlmsghdr **nlh)
+{
+	struct net *net = sock_net((const struct sock *)msk);
+	struct sk_buff *skb;
+
+	/* the common case is nobody listening, don't build the message */
+	if (!genl_has_listeners(&mptcp_genl_family, net,
+				MPTCP_PM_EV_GRP_OFFSET))
+		return NULL;
+
+	skb = nlmsg_new(NLMSG_DEFAULT_SIZE, gfp);
+	if (!skb)
+		return NULL;
+
+	*nlh = genlmsg_put(skb, 0, 0, &mptcp_genl_family, 0, type);
+	if (!*nlh) {
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	return skb;
+}
+
+static void mptcp_event_send(const struct mptcp_sock *msk, struct sk_buff *skb,
+			     struct nlmsghdr *nlh, gfp_t gfp)
+{
+	struct net *net = sock_net((const struct sock *)msk);
+
+	genlmsg_end(skb, nlh);
+	genlmsg_multicast_netns(&mptcp_genl_family, net, skb, 0,
+				MPTCP_PM_EV_GRP_OFFSET, gfp);
+}
+
+void mptcp_event(enum mptcp_event_type type, const struct mptcp_sock *msk,
+		 const struct sock *ssk, gfp_t gfp)
+{
+	struct nlmsghdr *nlh;
+	struct sk_buff *skb;
+
+	skb = mptcp_event_new(msk, type, gfp, &nlh);
+	if (!skb)
+		return;
+
+	if (type == MPTCP_EVENT_CLOSED) {
+		if (nla_put_u32(skb, MPTCP_ATTR_TOKEN, msk->token))
+			goto nla_put_failure;
+	} else if (mptcp_event_put_token_and_ssk(skb, msk, ssk) < 0) {
+		goto nla_put_failure;
+	}
+
+	mptcp_event_send(msk, skb, nlh, gfp);
+	return;
+
+nla_put_failure:
+	kfree_skb(skb);
+}
+
+/* called from the TCP input path, under the subflow socket lock */
+void mptcp_event_addr_announced(const struct mptcp_sock *msk,
+				const struct mptcp_addr_info *info)
+{
+	struct nlmsghdr *nlh;
+	struct sk_buff *skb;
+
+	skb = mptcp_event_new(msk, MPTCP_EVENT_ANNOUNCED, GFP_ATOMIC, &nlh);
+	if (!skb)
+		return;
+
+	if (nla_put_u32(skb, MPTCP_ATTR_TOKEN, msk->token))
+		goto nla_put_failure;
+	if (nla_put_u8(skb, MPTCP_ATTR_REM_ID, info->id))
+		goto nla_put_failure;
+	if (nla_put_u16(skb, MPTCP_ATTR_FAMILY, info->family))
+		goto nla_put_failure;
+	if (info->port && nla_put_be16(skb, MPTCP_ATTR_DPORT, info->port))
+		goto nla_put_failure;
+
+	if (info->family == AF_INET &&
+	    nla_put_in_addr(skb, MPTCP_ATTR_DADDR4, info->addr.s_addr))
+		goto nla_put_failure;
+#if IS_ENABLED(CONFIG_MPTCP_IPV6)
+	else if (info->family == AF_INET6 &&
+		 nla_put_in6_addr(skb, MPTCP_ATTR_DADDR6, &info->addr6))
+		goto nla_put_failure;
+#endif
+
+	mptcp_event_send(msk, skb, nlh, GFP_ATOMIC);
+	return;
+
+nla_put_failure:
+	kfree_skb(skb);
+}
+
+/* called from the TCP input path, under the subflow socket lock */
+void mptcp_event_addr_removed(const struct mptcp_sock *msk, u8 id)
+{
+	struct nlmsghdr *nlh;
+	struct sk_buff *skb;
+
+	skb = mptcp_event_new(msk, MPTCP_EVENT_REMOVED, GFP_ATOMIC, &nlh);
+	if (!skb)
+		return;
+
+	if (nla_put_u32(skb, MPTCP_ATTR_TOKEN, msk->token) ||
+	    nla_put_u8(skb, MPTCP_ATTR_REM_ID, id)) {
+		kfree_skb(skb);
+		return;
+	}
+
+	mptcp_event_send(msk, skb, nlh, GFP_ATOMIC);
+}
+
 static struct genl_ops mptcp_pm_ops[] = {
 	{
 		.cmd    = MPTCP_PM_CMD_ADD_ADDR,
@@ -806,6 +1876,26 @@ static struct genl_ops mptcp_pm_ops[] = {
 		.cmd    = MPTCP_PM_CMD_GET_LIMITS,
 		.doit   = mptcp_nl_cmd_get_limits,
 	},
+	{
+		.cmd    = MPTCP_PM_CMD_SET_FLAGS,
+		.doit   = mptcp_nl_cmd_set_flags,
+		.flags  = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd    = MPTCP_PM_CMD_ANNOUNCE,
+		.doit   = mptcp_nl_cmd_announce,
+		.flags  = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd    = MPTCP_PM_CMD_SUBFLOW_CREATE,
+		.doit   = mptcp_nl_cmd_sf_create,
+		.flags  = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd    = MPTCP_PM_CMD_SUBFLOW_DESTROY,
+		.doit   = mptcp_nl_cmd_sf_destroy,
+		.flags  = GENL_ADMIN_PERM,
+	},
 };
 
 static struct genl_family mptcp_genl_family __ro_after_init = {
@@ -837,10 +1927,19 @@ static void __net_exit pm_nl_exit_net(struct list_head *net_list)
 	struct net *net;
 
 	list_for_each_entry(net, net_list, exit_list) {
+		struct socket *lsks[MPTCP_PM_ADDR_MAX];
+		u8 ids[MPTCP_PM_ADDR_MAX];
+		unsigned int i, nr;
+
 		/* net is removed from namespace list, can't race with
 		 * other modifiers
 		 */
-		__flush_addrs(net_generic(net, pm_nl_pernet_id));
+		nr = __flush_addrs(net_generic(net, pm_nl_pernet_id), ids,
+				   lsks);
+		for (i = 0; i < nr; i++) {
+			if (lsks[i])
+				sock_release(lsks[i]);
+		}
 	}
 }
 
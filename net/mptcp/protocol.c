@@ -10,7 +10,9 @@
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/sched/signal.h>
+#include <linux/splice.h>
 #include <linux/atomic.h>
+#include <net/busy_poll.h>
 #include <net/sock.h>
 #include <net/inet_common.h>
 #include <net/inet_hashtables.h>
@@ -20,6 +22,7 @@
 #include <net/transp_v6.h>
 #endif
 #include <net/mptcp.h>
+#include <uapi/linux/mptcp.h>
 #include "protocol.h"
 #include "mib.h"
 
@@ -33,6 +36,8 @@ struct mptcp6_sock {
 #endif
 
 struct mptcp_skb_cb {
+	u64 map_seq;
+	u64 end_seq;
 	u32 offset;
 };
 
@@ -111,37 +116,332 @@ static int __mptcp_socket_create(struct mptcp_sock *msk)
 	return 0;
 }
 
-static void __mptcp_move_skb(struct mptcp_sock *msk, struct sock *ssk,
-			     struct sk_buff *skb,
-			     unsigned int offset, size_t copy_len)
+static void mptcp_drop(struct sock *sk, struct sk_buff *skb)
+{
+	sk_drops_add(sk, skb);
+	__kfree_skb(skb);
+}
+
+static bool mptcp_try_coalesce(struct sock *sk, struct sk_buff *to,
+			       struct sk_buff *from)
+{
+	bool fragstolen;
+	int delta;
+
+	if (MPTCP_SKB_CB(from)->offset ||
+	    !skb_try_coalesce(to, from, &fragstolen, &delta))
+		return false;
+
+	pr_debug("coalesced seq %llx into %llx new len %d new end seq %llx",
+		 MPTCP_SKB_CB(from)->map_seq, MPTCP_SKB_CB(to)->map_seq,
+		 to->len, MPTCP_SKB_CB(from)->end_seq);
+	MPTCP_SKB_CB(to)->end_seq = MPTCP_SKB_CB(from)->end_seq;
+	kfree_skb_partial(from, fragstolen);
+	atomic_add(delta, &sk->sk_rmem_alloc);
+	sk_mem_charge(sk, delta);
+	return true;
+}
+
+static bool mptcp_ooo_try_coalesce(struct mptcp_sock *msk, struct sk_buff *to,
+				   struct sk_buff *from)
+{
+	if (MPTCP_SKB_CB(from)->map_seq != MPTCP_SKB_CB(to)->end_seq)
+		return false;
+
+	return mptcp_try_coalesce((struct sock *)msk, to, from);
+}
+
+/* "inspired" by tcp_data_queue_ofo(), main differences:
+ * - use mptcp seqs
+ * - don't cope with sacks
+ */
+static void mptcp_data_queue_ofo(struct mptcp_sock *msk, struct sk_buff *skb)
 {
 	struct sock *sk = (struct sock *)msk;
-	struct sk_buff *tail;
+	struct rb_node **p, *parent;
+	u64 seq, end_seq, max_seq;
+	struct sk_buff *skb1;
+	int space;
+
+	seq = MPTCP_SKB_CB(skb)->map_seq;
+	end_seq = MPTCP_SKB_CB(skb)->end_seq;
+	space = tcp_space(sk);
+	max_seq = space > 0 ? space + msk->ack_seq : msk->ack_seq;
+
+	pr_debug("msk=%p seq=%llx limit=%llx empty=%d", msk, seq, max_seq,
+		 RB_EMPTY_ROOT(&msk->out_of_order_queue));
+	if (after64(seq, max_seq)) {
+		/* out of window */
+		mptcp_drop(sk, skb);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_NODSSWINDOW);
+		return;
+	}
 
-	__skb_unlink(skb, &ssk->sk_receive_queue);
+	p = &msk->out_of_order_queue.rb_node;
+	MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OFOQUEUE);
+	if (RB_EMPTY_ROOT(&msk->out_of_order_queue)) {
+		rb_link_node(&skb->rbnode, NULL, p);
+		rb_insert_color(&skb->rbnode, &msk->out_of_order_queue);
+		msk->ooo_last_skb = skb;
+		goto end;
+	}
 
-	skb_ext_reset(skb);
-	skb_orphan(skb);
-	msk->ack_seq += copy_len;
+	/* with 2 subflows, adding at end of ooo queue is quite likely
+	 * Use of ooo_last_skb avoids the O(Log(N)) rbtree lookup.
+	 */
+	if (mptcp_ooo_try_coalesce(msk, msk->ooo_last_skb, skb)) {
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OFOMERGE);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OFOQUEUETAIL);
+		return;
+	}
 
-	tail = skb_peek_tail(&sk->sk_receive_queue);
-	if (offset == 0 && tail) {
-		bool fragstolen;
-		int delta;
-
-		if (skb_try_coalesce(tail, skb, &fragstolen, &delta)) {
-			kfree_skb_partial(skb, fragstolen);
-			atomic_add(delta, &sk->sk_rmem_alloc);
-			sk_mem_charge(sk, delta);
+	/* Can avoid an rbtree lookup if we are adding skb after ooo_last_skb */
+	if (!before64(seq, MPTCP_SKB_CB(msk->ooo_last_skb)->end_seq)) {
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OFOQUEUETAIL);
+		parent = &msk->ooo_last_skb->rbnode;
+		p = &parent->rb_right;
+		goto insert;
+	}
+
+	/* Find place to insert this segment. Handle overlaps on the way. */
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		skb1 = rb_to_skb(parent);
+		if (before64(seq, MPTCP_SKB_CB(skb1)->map_seq)) {
+			p = &parent->rb_left;
+			continue;
+		}
+		if (before64(seq, MPTCP_SKB_CB(skb1)->end_seq)) {
+			if (!after64(end_seq, MPTCP_SKB_CB(skb1)->end_seq)) {
+				/* All the bits are present. Drop. */
+				mptcp_drop(sk, skb);
+				MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_DUPDATA);
+				return;
+			}
+			if (after64(seq, MPTCP_SKB_CB(skb1)->map_seq)) {
+				/* partial overlap:
+				 *     |     skb      |
+				 *  |     skb1    |
+				 * continue traversing
+				 */
+			} else {
+				/* skb's seq == skb1's seq and skb covers skb1.
+				 * Replace skb1 with skb.
+				 */
+				rb_replace_node(&skb1->rbnode, &skb->rbnode,
+						&msk->out_of_order_queue);
+				mptcp_drop(sk, skb1);
+				MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_DUPDATA);
+				goto merge_right;
+			}
+		} else if (mptcp_ooo_try_coalesce(msk, skb1, skb)) {
+			MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OFOMERGE);
 			return;
 		}
+		p = &parent->rb_right;
+	}
+
+insert:
+	/* Insert segment into RB tree. */
+	rb_link_node(&skb->rbnode, parent, p);
+	rb_insert_color(&skb->rbnode, &msk->out_of_order_queue);
+
+merge_right:
+	/* Remove other segments covered by skb. */
+	while ((skb1 = skb_rb_next(skb)) != NULL) {
+		if (before64(end_seq, MPTCP_SKB_CB(skb1)->end_seq))
+			break;
+		rb_erase(&skb1->rbnode, &msk->out_of_order_queue);
+		mptcp_drop(sk, skb1);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_DUPDATA);
 	}
+	/* If there is no skb after us, we are the last_skb ! */
+	if (!skb1)
+		msk->ooo_last_skb = skb;
 
+end:
+	skb_condense(skb);
 	skb_set_owner_r(skb, sk);
-	__skb_queue_tail(&sk->sk_receive_queue, skb);
+}
+
+/* move to the receive queue the out of order skbs that became in-sequence
+ * with the last msk->ack_seq update
+ */
+static void mptcp_ofo_queue(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct sk_buff *skb, *tail;
+	struct rb_node *p;
+	u64 end_seq;
+
+	p = rb_first(&msk->out_of_order_queue);
+	pr_debug("msk=%p empty=%d", msk, RB_EMPTY_ROOT(&msk->out_of_order_queue));
+	while (p) {
+		skb = rb_to_skb(p);
+		if (after64(MPTCP_SKB_CB(skb)->map_seq, msk->ack_seq))
+			break;
+
+		p = rb_next(p);
+		rb_erase(&skb->rbnode, &msk->out_of_order_queue);
+
+		if (unlikely(!after64(MPTCP_SKB_CB(skb)->end_seq,
+				      msk->ack_seq))) {
+			mptcp_drop(sk, skb);
+			MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_DUPDATA);
+			continue;
+		}
+
+		end_seq = MPTCP_SKB_CB(skb)->end_seq;
+		tail = skb_peek_tail(&sk->sk_receive_queue);
+		if (!tail || !mptcp_ooo_try_coalesce(msk, tail, skb)) {
+			int delta = msk->ack_seq - MPTCP_SKB_CB(skb)->map_seq;
+
+			/* skip overlapping data, if any */
+			pr_debug("uncoalesced seq=%llx ack seq=%llx delta=%d",
+				 MPTCP_SKB_CB(skb)->map_seq, msk->ack_seq,
+				 delta);
+			MPTCP_SKB_CB(skb)->offset += delta;
+			MPTCP_SKB_CB(skb)->map_seq += delta;
+			__skb_queue_tail(&sk->sk_receive_queue, skb);
+		}
+		msk->ack_seq = end_seq;
+	}
+}
+
+/* detach the skb from the subflow, recording its MPTCP-level mapping.
+ * Only the subflow socket lock is required.
+ */
+static void mptcp_detach_skb(struct sock *ssk, struct sk_buff *skb,
+			     unsigned int offset, size_t copy_len)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	u64 map_seq;
+
+	__skb_unlink(skb, &ssk->sk_receive_queue);
+
+	skb_ext_reset(skb);
+	skb_orphan(skb);
+
+	/* the skb map_seq accounts for the skb offset:
+	 * mptcp_subflow_get_mapped_dsn() is based on the current
+	 * tp->copied_seq value
+	 */
+	map_seq = mptcp_subflow_get_mapped_dsn(subflow);
+	MPTCP_SKB_CB(skb)->map_seq = map_seq;
+	MPTCP_SKB_CB(skb)->end_seq = map_seq + copy_len;
 	MPTCP_SKB_CB(skb)->offset = offset;
 }
 
+/* move a detached skb into the msk receive queue, or into the out of
+ * order queue if its mapping is ahead of msk->ack_seq
+ */
+static void __mptcp_queue_skb(struct mptcp_sock *msk, struct sk_buff *skb)
+{
+	u64 map_seq = MPTCP_SKB_CB(skb)->map_seq;
+	struct sock *sk = (struct sock *)msk;
+	struct sk_buff *tail;
+
+	if (after64(map_seq, msk->ack_seq)) {
+		mptcp_data_queue_ofo(msk, skb);
+		return;
+	}
+
+	if (!after64(MPTCP_SKB_CB(skb)->end_seq, msk->ack_seq)) {
+		/* old data, the sender retransmitted it on another subflow */
+		mptcp_drop(sk, skb);
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_DUPDATA);
+		return;
+	}
+
+	/* in sequence, possibly with some already received data ahead */
+	MPTCP_SKB_CB(skb)->offset += msk->ack_seq - map_seq;
+	MPTCP_SKB_CB(skb)->map_seq = msk->ack_seq;
+	msk->ack_seq = MPTCP_SKB_CB(skb)->end_seq;
+
+	tail = skb_peek_tail(&sk->sk_receive_queue);
+	if (!tail || !mptcp_try_coalesce(sk, tail, skb)) {
+		skb_set_owner_r(skb, sk);
+		__skb_queue_tail(&sk->sk_receive_queue, skb);
+	}
+
+	if (!RB_EMPTY_ROOT(&msk->out_of_order_queue))
+		mptcp_ofo_queue(msk);
+}
+
+/* the skb stays charged to the msk receive memory while on the handoff
+ * list, so that the rcvbuf checks and the announced window account for it
+ */
+static void mptcp_handoff_skb(struct mptcp_sock *msk, struct sock *ssk,
+			      struct sk_buff *skb, unsigned int offset,
+			      size_t copy_len)
+{
+	struct sock *sk = (struct sock *)msk;
+
+	struct sk_buff *first;
+
+	mptcp_detach_skb(ssk, skb, offset, copy_len);
+	atomic_add(skb->truesize, &sk->sk_rmem_alloc);
+
+	/* lockless push, as llist_add() does: subflows of the same msk can
+	 * run concurrently on different CPUs
+	 */
+	do {
+		skb->next = first = READ_ONCE(msk->rx_handoff);
+	} while (cmpxchg(&msk->rx_handoff, first, skb) != first);
+}
+
+/* grab all the handed off skbs, in arrival order */
+static struct sk_buff *mptcp_handoff_del_all(struct mptcp_sock *msk)
+{
+	struct sk_buff *skb = xchg(&msk->rx_handoff, NULL);
+	struct sk_buff *head = NULL, *next;
+
+	while (skb) {
+		next = skb->next;
+		skb->next = head;
+		head = skb;
+		skb = next;
+	}
+	return head;
+}
+
+/* splice the skbs handed off by the subflows into the msk queues. Called
+ * by the msk socket owner, or with the msk spinlock held while the socket
+ * is not owned.
+ */
+static bool __mptcp_splice_handoff(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+	u64 old_ack = msk->ack_seq;
+	struct sk_buff *skb, *next;
+
+	if (!READ_ONCE(msk->rx_handoff))
+		return false;
+
+	skb = mptcp_handoff_del_all(msk);
+	for (; skb; skb = next) {
+		next = skb->next;
+		skb_mark_not_on_list(skb);
+		atomic_sub(skb->truesize, &sk->sk_rmem_alloc);
+		__mptcp_queue_skb(msk, skb);
+	}
+
+	return msk->ack_seq != old_ack;
+}
+
+static void mptcp_purge_handoff(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct sk_buff *skb, *next;
+
+	for (skb = xchg(&msk->rx_handoff, NULL); skb; skb = next) {
+		next = skb->next;
+		atomic_sub(skb->truesize, &sk->sk_rmem_alloc);
+		__kfree_skb(skb);
+	}
+}
+
 /* both sockets must be locked */
 static bool mptcp_subflow_dsn_valid(const struct mptcp_sock *msk,
 				    struct sock *ssk)
@@ -154,32 +454,37 @@ static bool mptcp_subflow_dsn_valid(const struct mptcp_sock *msk,
 	 * mptcp_subflow_data_available() is usually called
 	 * without msk lock.  Its unlikely (but possible)
 	 * that msk->ack_seq has been advanced since the last
-	 * call found in-sequence data.
+	 * call found in-sequence or future data.
 	 */
-	if (likely(dsn == msk->ack_seq))
+	if (likely(!before64(dsn, msk->ack_seq)))
 		return true;
 
 	subflow->data_avail = 0;
 	return mptcp_subflow_data_available(ssk);
 }
 
+/* @handoff: called from the subflow rx path without the msk socket lock,
+ * queue the data on the msk handoff list instead of the msk queues
+ */
 static bool __mptcp_move_skbs_from_subflow(struct mptcp_sock *msk,
 					   struct sock *ssk,
-					   unsigned int *bytes)
+					   unsigned int *bytes,
+					   bool handoff)
 {
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct tcp_sock *tp = tcp_sk(ssk);
 	struct sock *sk = (struct sock *)msk;
-	unsigned int moved = 0;
+	u32 old_copied = tp->copied_seq;
+	u64 old_ack = msk->ack_seq;
 	bool more_data_avail;
-	struct tcp_sock *tp;
 	bool done = false;
 
-	if (!mptcp_subflow_dsn_valid(msk, ssk)) {
-		*bytes = 0;
+	/* the handoff path does not own msk->ack_seq: stale data is dropped
+	 * when the skbs are spliced into the msk
+	 */
+	if (!handoff && !mptcp_subflow_dsn_valid(msk, ssk))
 		return false;
-	}
 
-	tp = tcp_sk(ssk);
 	do {
 		u32 map_remaining, offset;
 		u32 seq = tp->copied_seq;
@@ -216,9 +521,13 @@ static bool __mptcp_move_skbs_from_subflow(struct mptcp_sock *msk,
 			if (tp->urg_data)
 				done = true;
 
-			__mptcp_move_skb(msk, ssk, skb, offset, len);
+			if (handoff) {
+				mptcp_handoff_skb(msk, ssk, skb, offset, len);
+			} else {
+				mptcp_detach_skb(ssk, skb, offset, len);
+				__mptcp_queue_skb(msk, skb);
+			}
 			seq += len;
-			moved += len;
 
 			if (WARN_ON_ONCE(map_remaining < len))
 				break;
@@ -237,63 +546,95 @@ static bool __mptcp_move_skbs_from_subflow(struct mptcp_sock *msk,
 		}
 	} while (more_data_avail);
 
-	*bytes = moved;
+	/* in-sequence data, including the one pulled from the ooo queue */
+	if (handoff)
+		*bytes += tp->copied_seq - old_copied;
+	else
+		*bytes += msk->ack_seq - old_ack;
 
 	return done;
 }
 
-/* In most cases we will be able to lock the mptcp socket.  If its already
- * owned, we need to defer to the work queue to avoid ABBA deadlock.
+/* true if a DATA_FIN has been received and all the data preceding it has
+ * been queued on the msk
  */
-static bool move_skbs_to_msk(struct mptcp_sock *msk, struct sock *ssk)
+static bool mptcp_pending_data_fin(struct sock *sk, u64 *seq)
 {
-	struct sock *sk = (struct sock *)msk;
-	unsigned int moved = 0;
+	struct mptcp_sock *msk = mptcp_sk(sk);
 
-	if (READ_ONCE(sk->sk_lock.owned))
-		return false;
+	if (READ_ONCE(msk->rcv_data_fin) &&
+	    ((1 << inet_sk_state_load(sk)) &
+	     (TCPF_ESTABLISHED | TCPF_FIN_WAIT1 | TCPF_FIN_WAIT2))) {
+		u64 rcv_data_fin_seq = READ_ONCE(msk->rcv_data_fin_seq);
 
-	if (unlikely(!spin_trylock_bh(&sk->sk_lock.slock)))
-		return false;
+		if (READ_ONCE(msk->ack_seq) == rcv_data_fin_seq) {
+			if (seq)
+				*seq = rcv_data_fin_seq;
+
+			return true;
+		}
+	}
 
-	/* must re-check after taking the lock */
-	if (!READ_ONCE(sk->sk_lock.owned))
-		__mptcp_move_skbs_from_subflow(msk, ssk, &moved);
+	return false;
+}
 
-	spin_unlock_bh(&sk->sk_lock.slock);
+/* The packets reach the msk through the subflows: let busy polling on
+ * the msk spin on the NAPI context that delivered data last.
+ */
+static void mptcp_mark_napi_id(struct sock *sk, const struct sock *ssk)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int napi_id = READ_ONCE(ssk->sk_napi_id);
 
-	return moved > 0;
+	if (napi_id >= MIN_NAPI_ID && READ_ONCE(sk->sk_napi_id) != napi_id)
+		WRITE_ONCE(sk->sk_napi_id, napi_id);
+#endif
 }
 
+/* Called by the subflow rx path with the subflow socket lock held. The
+ * subflow data is detached onto the msk handoff list without touching the
+ * msk lock. The msk spinlock is then held just long enough to splice the
+ * list into the msk queues. If the msk is owned, the owner does it in
+ * release_cb.
+ */
 void mptcp_data_ready(struct sock *sk, struct sock *ssk)
 {
 	struct mptcp_sock *msk = mptcp_sk(sk);
+	unsigned int moved = 0;
 
-	set_bit(MPTCP_DATA_READY, &msk->flags);
+	mptcp_mark_napi_id(sk, ssk);
 
-	if (atomic_read(&sk->sk_rmem_alloc) < READ_ONCE(sk->sk_rcvbuf) &&
-	    move_skbs_to_msk(msk, ssk))
+	/* don't pull more data if mptcp sk is (still) over limit, the reader
+	 * will get it from the subflow later
+	 */
+	if (atomic_read(&sk->sk_rmem_alloc) > READ_ONCE(sk->sk_rcvbuf))
 		goto wake;
 
-	/* don't schedule if mptcp sk is (still) over limit */
-	if (atomic_read(&sk->sk_rmem_alloc) > READ_ONCE(sk->sk_rcvbuf))
+	__mptcp_move_skbs_from_subflow(msk, ssk, &moved, true);
+	if (!moved)
 		goto wake;
 
-	/* mptcp socket is owned, release_cb should retry */
-	if (!test_and_set_bit(TCP_DELACK_TIMER_DEFERRED,
-			      &sk->sk_tsq_flags)) {
+	spin_lock_bh(&sk->sk_lock.slock);
+	if (!sock_owned_by_user(sk))
+		__mptcp_splice_handoff(msk);
+	else if (!test_and_set_bit(TCP_DELACK_TIMER_DEFERRED,
+				   &sk->sk_tsq_flags))
 		sock_hold(sk);
+	spin_unlock_bh(&sk->sk_lock.slock);
+
+	/* the DATA_FIN state transition needs the msk lock */
+	if (unlikely(mptcp_pending_data_fin(sk, NULL)))
+		mptcp_schedule_work(sk);
 
-		/* need to try again, its possible release_cb() has already
-		 * been called after the test_and_set_bit() above.
-		 */
-		move_skbs_to_msk(msk, ssk);
-	}
 wake:
+	/* set only now, so that a reader clearing it after finding the msk
+	 * queues empty cannot miss the data handed off above
+	 */
+	set_bit(MPTCP_DATA_READY, &msk->flags);
 	sk->sk_data_ready(sk);
 }
 
-static void __mptcp_flush_join_list(struct mptcp_sock *msk)
+void __mptcp_flush_join_list(struct mptcp_sock *msk)
 {
 	if (likely(list_empty(&msk->join_list)))
 		return;
@@ -330,13 +671,20 @@ static void mptcp_reset_timer(struct sock *sk)
 	sk_reset_timer(sk, &icsk->icsk_retransmit_timer, jiffies + tout);
 }
 
+void mptcp_schedule_work(struct sock *sk)
+{
+	if (schedule_work(&mptcp_sk(sk)->work))
+		sock_hold(sk);
+}
+
 void mptcp_data_acked(struct sock *sk)
 {
 	mptcp_reset_timer(sk);
 
-	if (!sk_stream_is_writeable(sk) &&
-	    schedule_work(&mptcp_sk(sk)->work))
-		sock_hold(sk);
+	/* the worker also completes the DATA_FIN handshake */
+	if (!sk_stream_is_writeable(sk) ||
+	    READ_ONCE(mptcp_sk(sk)->snd_data_fin_enable))
+		mptcp_schedule_work(sk);
 }
 
 void mptcp_subflow_eof(struct sock *sk)
@@ -367,6 +715,25 @@ static void mptcp_check_for_eof(struct mptcp_sock *msk)
 		set_bit(MPTCP_DATA_READY, &msk->flags);
 		sk->sk_data_ready(sk);
 	}
+
+	if (receivers)
+		return;
+
+	/* no more data can reach us, whatever the DATA_FIN status */
+	switch (sk->sk_state) {
+	case TCP_ESTABLISHED:
+		inet_sk_state_store(sk, TCP_CLOSE_WAIT);
+		break;
+	case TCP_FIN_WAIT1:
+		inet_sk_state_store(sk, TCP_CLOSING);
+		break;
+	case TCP_FIN_WAIT2:
+		inet_sk_state_store(sk, TCP_CLOSE);
+		break;
+	default:
+		return;
+	}
+	sk->sk_state_change(sk);
 }
 
 static void mptcp_stop_timer(struct sock *sk)
@@ -377,6 +744,173 @@ static void mptcp_stop_timer(struct sock *sk)
 	mptcp_sk(sk)->timer_ival = 0;
 }
 
+/* the peer aborted the whole MPTCP connection; the actual cleanup is
+ * deferred to the worker, as we are in the subflow rx path here
+ */
+void mptcp_fastclose_received(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+
+	if (!test_and_set_bit(MPTCP_WORK_FASTCLOSE, &msk->flags) &&
+	    schedule_work(&msk->work))
+		sock_hold(sk);
+}
+
+/* reset the subflow immediately, discarding any pending data; if
+ * @fastclose is set the RST carries MP_FASTCLOSE, too
+ */
+static void mptcp_subflow_reset(struct sock *ssk, bool fastclose)
+{
+	lock_sock(ssk);
+	if (fastclose)
+		mptcp_subflow_ctx(ssk)->send_fastclose = 1;
+	tcp_disconnect(ssk, O_NONBLOCK);
+	release_sock(ssk);
+}
+
+/* send a pure ack on every connected subflow, carrying the current
+ * DATA_ACK and the DATA_FIN, if pending
+ */
+static void mptcp_send_ack(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		lock_sock(ssk);
+		if (!((1 << ssk->sk_state) &
+		      (TCPF_SYN_SENT | TCPF_SYN_RECV | TCPF_LISTEN | TCPF_CLOSE)))
+			tcp_send_ack(ssk);
+		release_sock(ssk);
+	}
+}
+
+/* Called with the msk lock held: act on a received DATA_FIN, once all
+ * the data preceding it has been queued
+ */
+static void mptcp_check_data_fin(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	u64 rcv_data_fin_seq;
+
+	if (__mptcp_check_fallback(msk) ||
+	    !mptcp_pending_data_fin(sk, &rcv_data_fin_seq))
+		return;
+
+	pr_debug("msk=%p data_fin_seq=%llu state=%d", msk, rcv_data_fin_seq,
+		 sk->sk_state);
+
+	/* the DATA_FIN takes one byte of sequence space */
+	WRITE_ONCE(msk->ack_seq, rcv_data_fin_seq + 1);
+	WRITE_ONCE(msk->rcv_data_fin, 0);
+
+	sk->sk_shutdown |= RCV_SHUTDOWN;
+	smp_mb__before_atomic(); /* SHUTDOWN must be visible first */
+	set_bit(MPTCP_DATA_READY, &msk->flags);
+
+	switch (sk->sk_state) {
+	case TCP_ESTABLISHED:
+		inet_sk_state_store(sk, TCP_CLOSE_WAIT);
+		break;
+	case TCP_FIN_WAIT1:
+		inet_sk_state_store(sk, TCP_CLOSING);
+		break;
+	case TCP_FIN_WAIT2:
+		/* the subflows TIME_WAIT already protect against stale
+		 * segments, no need for an MPTCP-level one
+		 */
+		inet_sk_state_store(sk, TCP_CLOSE);
+		break;
+	default:
+		WARN_ON_ONCE(1);
+		break;
+	}
+
+	mptcp_send_ack(msk);
+	sk->sk_state_change(sk);
+}
+
+/* Called with the msk lock held: complete the local close sequence when
+ * the peer acked our DATA_FIN
+ */
+static void mptcp_check_data_fin_ack(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	if (__mptcp_check_fallback(msk) || !msk->snd_data_fin_enable ||
+	    atomic64_read(&msk->snd_una) != msk->write_seq)
+		return;
+
+	pr_debug("msk=%p DATA_FIN acked state=%d", msk, sk->sk_state);
+	WRITE_ONCE(msk->snd_data_fin_enable, 0);
+	mptcp_stop_timer(sk);
+
+	switch (sk->sk_state) {
+	case TCP_FIN_WAIT1:
+		inet_sk_state_store(sk, TCP_FIN_WAIT2);
+		break;
+	case TCP_CLOSING:
+	case TCP_LAST_ACK:
+		inet_sk_state_store(sk, TCP_CLOSE);
+		break;
+	default:
+		return;
+	}
+	sk->sk_state_change(sk);
+}
+
+static const unsigned char new_state[16] = {
+	/* current state:     new state:      action:	*/
+	[0 /* (Invalid) */] = TCP_CLOSE,
+	[TCP_ESTABLISHED]   = TCP_FIN_WAIT1 | TCP_ACTION_FIN,
+	[TCP_SYN_SENT]      = TCP_CLOSE,
+	[TCP_SYN_RECV]      = TCP_FIN_WAIT1 | TCP_ACTION_FIN,
+	[TCP_FIN_WAIT1]     = TCP_FIN_WAIT1,
+	[TCP_FIN_WAIT2]     = TCP_FIN_WAIT2,
+	[TCP_TIME_WAIT]     = TCP_CLOSE,	/* should not happen ! */
+	[TCP_CLOSE]         = TCP_CLOSE,
+	[TCP_CLOSE_WAIT]    = TCP_LAST_ACK  | TCP_ACTION_FIN,
+	[TCP_LAST_ACK]      = TCP_LAST_ACK,
+	[TCP_LISTEN]        = TCP_CLOSE,
+	[TCP_CLOSING]       = TCP_CLOSING,
+	[TCP_NEW_SYN_RECV]  = TCP_CLOSE,	/* should not happen ! */
+};
+
+/* mirrors tcp_close_state(): returns true if a DATA_FIN must be sent */
+static bool mptcp_close_state(struct sock *sk)
+{
+	int next = (int)new_state[sk->sk_state];
+	int ns = next & TCP_STATE_MASK;
+
+	inet_sk_state_store(sk, ns);
+
+	return next & TCP_ACTION_FIN;
+}
+
+/* Queue the DATA_FIN: it takes one byte of data sequence space and is
+ * carried by the DSS option of the next packet on every subflow, until
+ * acked. No subflow level FIN is sent, so that the subflows can be closed
+ * independently.
+ */
+static void __mptcp_wr_shutdown(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	pr_debug("msk=%p write_seq=%llu", msk, msk->write_seq);
+
+	WRITE_ONCE(msk->write_seq, msk->write_seq + 1);
+	WRITE_ONCE(msk->snd_data_fin_enable, 1);
+
+	__mptcp_flush_join_list(msk);
+	mptcp_send_ack(msk);
+
+	/* the DATA_FIN is retransmitted by the msk timer, too */
+	mptcp_set_timeout(sk, NULL);
+	if (!mptcp_timer_pending(sk))
+		mptcp_reset_timer(sk);
+}
+
 static bool mptcp_ext_cache_refill(struct mptcp_sock *msk)
 {
 	const struct sock *sk = (const struct sock *)msk;
@@ -402,22 +936,59 @@ static struct sock *mptcp_subflow_recv_lookup(const struct mptcp_sock *msk)
 	return NULL;
 }
 
-static bool mptcp_skb_can_collapse_to(u64 write_seq,
-				      const struct sk_buff *skb,
-				      const struct mptcp_ext *mpext)
+/* leave room for the DATA_FIN, which may consume one more byte of the
+ * last mapping
+ */
+#define MPTCP_MAX_MAP_LEN	(U16_MAX - 1)
+
+/* Look up the DSS mapping the next write on @ssk can extend, if any.
+ *
+ * The mapping is carried by the first skb it covers only: TCP already
+ * transmits the other fragments of a split skb without any extension, and
+ * the receiver accepts them as long as they are in-sequence with the
+ * current map. Building the write queue the same way allows a single
+ * mapping, and a single extension, to span several skbs when size_goal
+ * is small, e.g. when the subflow can't use TSO.
+ *
+ * Such mapping must still be entirely on the write queue - i.e. not
+ * transmitted yet, even partially - and must end exactly at the current
+ * MPTCP-level and subflow-level sequence numbers.
+ */
+static struct mptcp_ext *mptcp_tx_open_map(const struct sock *ssk,
+					   u64 write_seq)
 {
-	if (!tcp_skb_can_collapse_to(skb))
-		return false;
+	u32 rel_write_seq = mptcp_subflow_ctx(ssk)->rel_write_seq;
+	struct sk_buff *skb = tcp_write_queue_tail(ssk);
+	struct mptcp_ext *mpext;
+	unsigned int len = 0;
+
+	while (skb) {
+		mpext = skb_ext_find(skb, SKB_EXT_MPTCP);
+		if (mpext) {
+			if (!mpext->use_map ||
+			    mpext->data_len >= MPTCP_MAX_MAP_LEN ||
+			    mpext->data_seq + mpext->data_len != write_seq ||
+			    mpext->subflow_seq + mpext->data_len != rel_write_seq)
+				return NULL;
+			return mpext;
+		}
 
-	/* can collapse only if MPTCP level sequence is in order */
-	return mpext && mpext->data_seq + mpext->data_len == write_seq;
+		len += skb->len;
+		if (len >= MPTCP_MAX_MAP_LEN || skb == tcp_write_queue_head(ssk))
+			return NULL;
+		skb = skb_queue_prev(&ssk->sk_write_queue, skb);
+	}
+	return NULL;
 }
 
+/* zerocopy dfrags reference pages outside the msk page_frag, and carry
+ * their own completion: never extend them, nor collapse new data into them
+ */
 static bool mptcp_frag_can_collapse_to(const struct mptcp_sock *msk,
 				       const struct page_frag *pfrag,
 				       const struct mptcp_data_frag *df)
 {
-	return df && pfrag->page == df->page &&
+	return df && !df->zc && pfrag->page == df->page &&
 		df->data_seq + df->data_len == msk->write_seq;
 }
 
@@ -427,12 +998,43 @@ static void dfrag_uncharge(struct sock *sk, int len)
 	sk_wmem_queued_add(sk, -len);
 }
 
-static void dfrag_clear(struct sock *sk, struct mptcp_data_frag *dfrag)
+static void dfrag_free_zc(struct mptcp_data_frag *dfrag)
 {
-	int len = dfrag->data_len + dfrag->overhead;
+	/* the MSG_ZEROCOPY notification is generated when the last dfrag
+	 * referencing the user pages is acked at MPTCP level
+	 */
+	if (dfrag->uarg)
+		sock_zerocopy_put(dfrag->uarg);
+	put_page(dfrag->page);
+	kfree(dfrag);
+}
+
+/* the dfrag holds a reference to the last subflow carrying it, so that
+ * the subflow memory can't be reused by a new one while they are compared
+ */
+static void dfrag_set_ssk(struct mptcp_data_frag *dfrag, struct sock *ssk)
+{
+	sock_hold(ssk);
+	if (dfrag->ssk)
+		sock_put(dfrag->ssk);
+	dfrag->ssk = ssk;
+}
+
+static void dfrag_clear(struct sock *sk, struct mptcp_data_frag *dfrag)
+{
+	int len = dfrag->data_len + dfrag->overhead;
+	struct sock *ssk = dfrag->ssk;
 
 	list_del(&dfrag->list);
 	dfrag_uncharge(sk, len);
+	if (ssk)
+		sock_put(ssk);
+	if (dfrag->zc) {
+		dfrag_free_zc(dfrag);
+		return;
+	}
+
+	/* carved dfrags live inside the page itself */
 	put_page(dfrag->page);
 }
 
@@ -481,6 +1083,8 @@ static void mptcp_clean_una(struct sock *sk)
 		if (test_bit(MPTCP_SEND_SPACE, &msk->flags))
 			sk_stream_write_space(sk);
 	}
+
+	mptcp_check_data_fin_ack(sk);
 }
 
 /* ensure we get enough memory for the frag hdr, beyond some minimal amount of
@@ -509,13 +1113,52 @@ mptcp_carve_data_frag(const struct mptcp_sock *msk, struct page_frag *pfrag,
 	dfrag->data_seq = msk->write_seq;
 	dfrag->overhead = offset - orig_offset + sizeof(struct mptcp_data_frag);
 	dfrag->offset = offset + sizeof(struct mptcp_data_frag);
+	dfrag->zc = false;
 	dfrag->page = pfrag->page;
+	dfrag->uarg = NULL;
+	dfrag->ssk = NULL;
+
+	return dfrag;
+}
+
+/* reference the next chunk of the user (MSG_ZEROCOPY) or page cache
+ * (sendpage) data instead of copying it into the msk page_frag
+ */
+static struct mptcp_data_frag *
+mptcp_zc_data_frag(struct sock *sk, struct msghdr *msg, size_t max,
+		   size_t *psize)
+{
+	struct mptcp_data_frag *dfrag;
+	struct page *page;
+	size_t start;
+	ssize_t len;
+
+	dfrag = kmalloc(sizeof(*dfrag), sk->sk_allocation);
+	if (!dfrag)
+		return ERR_PTR(-ENOMEM);
+
+	len = iov_iter_get_pages(&msg->msg_iter, &page, max, 1, &start);
+	if (len <= 0) {
+		kfree(dfrag);
+		return ERR_PTR(len ? : -EFAULT);
+	}
+
+	dfrag->data_len = 0;
+	dfrag->data_seq = mptcp_sk(sk)->write_seq;
+	dfrag->overhead = sizeof(struct mptcp_data_frag);
+	dfrag->offset = start;
+	dfrag->zc = true;
+	dfrag->page = page;
+	dfrag->uarg = NULL;
+	dfrag->ssk = NULL;
+	*psize = len;
 
 	return dfrag;
 }
 
 static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 			      struct msghdr *msg, struct mptcp_data_frag *dfrag,
+			      bool zc, struct ubuf_info *uarg,
 			      long *timeo, int *pmss_now,
 			      int *ps_goal)
 {
@@ -524,8 +1167,8 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	struct mptcp_sock *msk = mptcp_sk(sk);
 	struct mptcp_ext *mpext = NULL;
 	bool retransmission = !!dfrag;
-	struct sk_buff *skb, *tail;
 	struct page_frag *pfrag;
+	struct sk_buff *skb;
 	struct page *page;
 	u64 *write_seq;
 	size_t psize;
@@ -551,7 +1194,7 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	avail_size = size_goal;
 	skb = tcp_write_queue_tail(ssk);
 	if (skb) {
-		mpext = skb_ext_find(skb, SKB_EXT_MPTCP);
+		mpext = mptcp_tx_open_map(ssk, *write_seq);
 
 		/* Limit the write to the size available in the
 		 * current skb, if any, so that we create at most a new skb.
@@ -559,15 +1202,37 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 		 * queue management operation, to avoid breaking the ext <->
 		 * SSN association set here
 		 */
-		can_collapse = (size_goal - skb->len > 0) &&
-			      mptcp_skb_can_collapse_to(*write_seq, skb, mpext);
+		can_collapse = (size_goal - skb->len > 0) && mpext &&
+			       tcp_skb_can_collapse_to(skb);
 		if (!can_collapse)
 			TCP_SKB_CB(skb)->eor = 1;
 		else
 			avail_size = size_goal - skb->len;
+
+		/* the open mapping, if any, is extended even if a new skb
+		 * is needed, but its length must fit the DSS option
+		 */
+		if (mpext)
+			avail_size = min_t(int, avail_size,
+					   MPTCP_MAX_MAP_LEN - mpext->data_len);
 	}
 
-	if (!retransmission) {
+	if (!retransmission && zc) {
+		dfrag = mptcp_zc_data_frag(sk, msg,
+					   min_t(size_t, msg_data_left(msg),
+						 avail_size), &psize);
+		if (IS_ERR(dfrag))
+			return PTR_ERR(dfrag);
+
+		dfrag_collapsed = false;
+		frag_truesize = dfrag->overhead;
+		offset = dfrag->offset;
+		page = dfrag->page;
+		if (!sk_wmem_schedule(sk, psize + dfrag->overhead)) {
+			dfrag_free_zc(dfrag);
+			return -ENOMEM;
+		}
+	} else if (!retransmission) {
 		/* reuse tail pfrag, if possible, or carve a new one from the
 		 * page allocator
 		 */
@@ -603,20 +1268,34 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	 */
 	ret = do_tcp_sendpages(ssk, page, offset, psize,
 			       msg->msg_flags | MSG_SENDPAGE_NOTLAST | MSG_DONTWAIT);
-	if (ret <= 0)
+	if (ret <= 0) {
+		if (!retransmission && zc)
+			dfrag_free_zc(dfrag);
 		return ret;
+	}
 
 	frag_truesize += ret;
-	if (!retransmission) {
-		if (unlikely(ret < psize))
-			iov_iter_revert(&msg->msg_iter, psize - ret);
+	if (!retransmission && zc) {
+		/* iov_iter_get_pages() does not advance the iterator */
+		iov_iter_advance(&msg->msg_iter, ret);
+		if (uarg) {
+			sock_zerocopy_get(uarg);
+			dfrag->uarg = uarg;
+		}
+	} else if (!retransmission && unlikely(ret < psize)) {
+		iov_iter_revert(&msg->msg_iter, psize - ret);
+	}
 
+	if (!retransmission) {
 		/* send successful, keep track of sent data for mptcp-level
 		 * retransmission
 		 */
 		dfrag->data_len += ret;
 		if (!dfrag_collapsed) {
-			get_page(dfrag->page);
+			/* zc dfrags already own a page reference */
+			if (!dfrag->zc)
+				get_page(dfrag->page);
+			dfrag_set_ssk(dfrag, ssk);
 			list_add_tail(&dfrag->list, &msk->rtx_queue);
 			sk_wmem_queued_add(sk, frag_truesize);
 		} else {
@@ -629,14 +1308,12 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 		sk->sk_forward_alloc -= frag_truesize;
 	}
 
-	/* if the tail skb extension is still the cached one, collapsing
-	 * really happened. Note: we can't check for 'same skb' as the sk_buff
-	 * hdr on tail can be transmitted, freed and re-allocated by the
-	 * do_tcp_sendpages() call
+	/* MSG_SENDPAGE_NOTLAST prevents do_tcp_sendpages() from pushing the
+	 * skbs touched here, so the open mapping is still on the write queue:
+	 * the new data either collapsed into the tail skb or went into a new
+	 * skb covered by the same mapping.
 	 */
-	tail = tcp_write_queue_tail(ssk);
-	if (mpext && tail && mpext == skb_ext_find(tail, SKB_EXT_MPTCP)) {
-		WARN_ON_ONCE(!can_collapse);
+	if (mpext) {
 		mpext->data_len += ret;
 		goto out;
 	}
@@ -657,7 +1334,7 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 		 mpext->dsn64);
 
 out:
-	if (!retransmission)
+	if (!retransmission && !zc)
 		pfrag->offset += frag_truesize;
 	*write_seq += ret;
 	mptcp_subflow_ctx(ssk)->rel_write_seq += ret;
@@ -665,6 +1342,70 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	return ret;
 }
 
+static void mptcp_update_sndbuf(struct sock *sk, int sndbuf)
+{
+	if (!(sk->sk_userlocks & SOCK_SNDBUF_LOCK))
+		WRITE_ONCE(sk->sk_sndbuf, max_t(int, sndbuf, SOCK_MIN_SNDBUF));
+}
+
+/* Account @ssk send buffer and not yet transmitted data at the msk level:
+ * the msk sndbuf tracks the sum of the subflows one, as sized by TCP from
+ * their cwnd, and TCP_NOTSENT_LOWAT applies to the data queued on all of
+ * them. Called under the subflow socket lock or from its write_space().
+ */
+void mptcp_subflow_update_wmem(struct sock *sk, struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	const struct tcp_sock *tp = tcp_sk(ssk);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int sndbuf = READ_ONCE(ssk->sk_sndbuf);
+	u32 notsent;
+	int sum;
+
+	notsent = READ_ONCE(tp->write_seq) - READ_ONCE(tp->snd_nxt);
+	if (notsent != subflow->cached_notsent) {
+		atomic_add(notsent - subflow->cached_notsent,
+			   &msk->wmem_notsent);
+		subflow->cached_notsent = notsent;
+	}
+
+	if (sndbuf != subflow->cached_sndbuf) {
+		sum = atomic_add_return(sndbuf - subflow->cached_sndbuf,
+					&msk->wmem_sndbuf);
+		subflow->cached_sndbuf = sndbuf;
+		mptcp_update_sndbuf(sk, sum);
+	}
+}
+
+/* the subflow is going away: drop its contribution and stop tracking it */
+static void mptcp_subflow_release_wmem(struct sock *sk, struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	lock_sock(ssk);
+	ssk->sk_write_space = subflow->tcp_write_space;
+	atomic_sub(subflow->cached_notsent, &msk->wmem_notsent);
+	subflow->cached_notsent = 0;
+	mptcp_update_sndbuf(sk, atomic_sub_return(subflow->cached_sndbuf,
+						  &msk->wmem_sndbuf));
+	subflow->cached_sndbuf = 0;
+	release_sock(ssk);
+}
+
+/* get a write_space() callback from any subflow freeing memory or
+ * transmitting queued data: they all share the msk socket, except the
+ * outgoing first subflow
+ */
+static void mptcp_set_nospace(struct sock *sk)
+{
+	struct socket *ssock = READ_ONCE(mptcp_sk(sk)->subflow);
+
+	set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+	if (ssock)
+		set_bit(SOCK_NOSPACE, &ssock->flags);
+}
+
 static void mptcp_nospace(struct mptcp_sock *msk, struct socket *sock)
 {
 	clear_bit(MPTCP_SEND_SPACE, &msk->flags);
@@ -677,42 +1418,207 @@ static void mptcp_nospace(struct mptcp_sock *msk, struct socket *sock)
 static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 {
 	struct mptcp_subflow_context *subflow;
-	struct sock *backup = NULL;
+	struct sock *ssk;
 
 	sock_owned_by_me((const struct sock *)msk);
 
 	if (!mptcp_ext_cache_refill(msk))
 		return NULL;
 
-	mptcp_for_each_subflow(msk, subflow) {
-		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+	ssk = msk->sched->get_subflow(msk);
+	if (ssk)
+		return ssk;
 
-		if (!sk_stream_memory_free(ssk)) {
-			struct socket *sock = ssk->sk_socket;
+	/* get a write_space() notification as soon as any of the
+	 * subflows frees some memory
+	 */
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *tmp = mptcp_subflow_tcp_sock(subflow);
+		struct socket *sock = READ_ONCE(tmp->sk_socket);
 
-			if (sock)
-				mptcp_nospace(msk, sock);
+		if (sock && !sk_stream_memory_free(tmp))
+			mptcp_nospace(msk, sock);
+	}
 
-			return NULL;
-		}
+	return NULL;
+}
 
-		if (subflow->backup) {
-			if (!backup)
-				backup = ssk;
+/* transmit a copy of the data in the [seq, msk->write_seq) range on all
+ * the non-backup subflows other than @ssk, as far as their send buffers
+ * allow. Anything not sent here is still covered by MPTCP-level
+ * retransmissions.
+ */
+static void mptcp_push_redundant(struct sock *sk, struct sock *ssk, u64 seq)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
 
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *tmp = mptcp_subflow_tcp_sock(subflow);
+		int mss_now = 0, size_goal = 0;
+		struct mptcp_data_frag *dfrag;
+		struct msghdr msg;
+		size_t copied = 0;
+		long timeo = 0;
+
+		if (tmp == ssk || mptcp_subflow_is_backup(subflow))
 			continue;
+
+		msg.msg_flags = MSG_DONTWAIT;
+		lock_sock(tmp);
+		list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+			struct mptcp_data_frag frag = *dfrag;
+			int ret;
+
+			if (!after64(frag.data_seq + frag.data_len, seq))
+				continue;
+
+			if (before64(frag.data_seq, seq)) {
+				int delta = seq - frag.data_seq;
+
+				frag.data_seq = seq;
+				frag.offset += delta;
+				frag.data_len -= delta;
+			}
+
+			while (frag.data_len > 0) {
+				if (!sk_stream_memory_free(tmp) ||
+				    !mptcp_ext_cache_refill(msk))
+					break;
+
+				ret = mptcp_sendmsg_frag(sk, tmp, &msg, &frag,
+							 false, NULL, &timeo,
+							 &mss_now, &size_goal);
+				if (ret <= 0)
+					break;
+
+				copied += ret;
+				frag.data_len -= ret;
+				frag.offset += ret;
+			}
+
+			if (frag.data_len > 0)
+				break;
 		}
+		if (copied)
+			tcp_push(tmp, msg.msg_flags, mss_now,
+				 tcp_sk(tmp)->nonagle, size_goal);
+		mptcp_subflow_update_wmem(sk, tmp);
+		release_sock(tmp);
+	}
+}
 
-		return ssk;
+/* push the whole @dfrag on @ssk again, leaving the rtx queue entry
+ * untouched. Called with both the msk and the subflow socket lock held.
+ */
+static size_t mptcp_retransmit_dfrag(struct sock *sk, struct sock *ssk,
+				     struct mptcp_data_frag *dfrag)
+{
+	int orig_len, orig_offset, mss_now = 0, size_goal = 0;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	u64 orig_write_seq;
+	size_t copied = 0;
+	struct msghdr msg;
+	long timeo = 0;
+
+	msg.msg_flags = MSG_DONTWAIT;
+	orig_len = dfrag->data_len;
+	orig_offset = dfrag->offset;
+	orig_write_seq = dfrag->data_seq;
+	while (dfrag->data_len > 0) {
+		int ret = mptcp_sendmsg_frag(sk, ssk, &msg, dfrag, false, NULL,
+					     &timeo, &mss_now, &size_goal);
+		if (ret < 0)
+			break;
+
+		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_RETRANSSEGS);
+		copied += ret;
+		dfrag->data_len -= ret;
+		dfrag->offset += ret;
+
+		if (!mptcp_ext_cache_refill(msk))
+			break;
 	}
+	if (copied)
+		tcp_push(ssk, msg.msg_flags, mss_now, tcp_sk(ssk)->nonagle,
+			 size_goal);
 
-	return backup;
+	dfrag->data_seq = orig_write_seq;
+	dfrag->offset = orig_offset;
+	dfrag->data_len = orig_len;
+
+	return copied;
+}
+
+/* reduce the cwnd of a subflow causing head-of-line blocking, at most once
+ * per its srtt, letting its congestion control pick the new ssthresh as on
+ * ECN congestion experienced
+ */
+static void mptcp_subflow_penalise(struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct tcp_sock *tp = tcp_sk(ssk);
+
+	lock_sock(ssk);
+	if (tcp_jiffies32 - subflow->penalty_stamp >=
+	    usecs_to_jiffies(tp->srtt_us >> 3)) {
+		tcp_enter_cwr(ssk);
+		subflow->penalty_stamp = tcp_jiffies32;
+		MPTCP_INC_STATS(sock_net(ssk), MPTCP_MIB_SUBFLOWPENALTY);
+	}
+	release_sock(ssk);
+}
+
+/* The MPTCP-level send buffer is full and the peer is not acking the rtx
+ * queue head: the following data likely reached it on faster subflows and
+ * is sitting in its out-of-order queue. Instead of waiting for the
+ * MPTCP-level RTO, reinject the head on @ssk if that is faster than the
+ * subflow still carrying it, and penalise the latter.
+ */
+static void mptcp_opportunistic_rtx(struct sock *sk, struct sock *ssk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_data_frag *dfrag;
+	struct sock *slow = NULL;
+	size_t copied;
+
+	dfrag = mptcp_rtx_head(sk);
+	if (!dfrag || dfrag->ssk == ssk)
+		return;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		if (mptcp_subflow_tcp_sock(subflow) == dfrag->ssk) {
+			slow = dfrag->ssk;
+			break;
+		}
+	}
+
+	if (slow && tcp_sk(ssk)->srtt_us >= tcp_sk(slow)->srtt_us)
+		return;
+
+	if (!sk_stream_memory_free(ssk) || !mptcp_ext_cache_refill(msk))
+		return;
+
+	lock_sock(ssk);
+	copied = mptcp_retransmit_dfrag(sk, ssk, dfrag);
+	release_sock(ssk);
+	if (!copied)
+		return;
+
+	pr_debug("msk=%p reinjected seq=%llu on ssk=%p", msk, dfrag->data_seq,
+		 ssk);
+	MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_OPPORTUNISTICRTX);
+	dfrag_set_ssk(dfrag, ssk);
+	if (slow)
+		mptcp_subflow_penalise(slow);
 }
 
 static void ssk_check_wmem(struct mptcp_sock *msk, struct sock *ssk)
 {
 	struct socket *sock;
 
+	mptcp_subflow_update_wmem((struct sock *)msk, ssk);
 	if (likely(sk_stream_is_writeable(ssk)))
 		return;
 
@@ -721,20 +1627,33 @@ static void ssk_check_wmem(struct mptcp_sock *msk, struct sock *ssk)
 		mptcp_nospace(msk, sock);
 }
 
-static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
+/* @zc: reference the pages backing msg instead of copying them, used by
+ * sendpage. MSG_ZEROCOPY sends do the same with user pages.
+ */
+static int __mptcp_sendmsg(struct sock *sk, struct msghdr *msg, bool zc)
 {
 	int mss_now = 0, size_goal = 0, ret = 0;
 	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct ubuf_info *uarg = NULL;
 	struct page_frag *pfrag;
 	size_t copied = 0;
 	struct sock *ssk;
+	u64 start_seq;
 	bool tx_ok;
 	long timeo;
 
-	if (msg->msg_flags & ~(MSG_MORE | MSG_DONTWAIT | MSG_NOSIGNAL))
-		return -EOPNOTSUPP;
-
 	lock_sock(sk);
+	start_seq = msk->write_seq;
+
+	if ((msg->msg_flags & MSG_ZEROCOPY) && msg_data_left(msg) &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		uarg = sock_zerocopy_realloc(sk, msg_data_left(msg), NULL);
+		if (!uarg) {
+			ret = -ENOBUFS;
+			goto out;
+		}
+		zc = true;
+	}
 
 	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
 
@@ -753,7 +1672,7 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 	ssk = mptcp_subflow_get_send(msk);
 	while (!sk_stream_memory_free(sk) ||
 	       !ssk ||
-	       !mptcp_page_frag_refill(ssk, pfrag)) {
+	       (!zc && !mptcp_page_frag_refill(ssk, pfrag))) {
 		if (ssk) {
 			/* make sure retransmit timer is
 			 * running before we wait for memory.
@@ -765,8 +1684,13 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 			mptcp_set_timeout(sk, ssk);
 			if (!mptcp_timer_pending(sk))
 				mptcp_reset_timer(sk);
+
+			if (READ_ONCE(sk->sk_wmem_queued) >=
+			    READ_ONCE(sk->sk_sndbuf))
+				mptcp_opportunistic_rtx(sk, ssk);
 		}
 
+		mptcp_set_nospace(sk);
 		ret = sk_stream_wait_memory(sk, &timeo);
 		if (ret)
 			goto out;
@@ -785,8 +1709,8 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 	lock_sock(ssk);
 	tx_ok = msg_data_left(msg);
 	while (tx_ok) {
-		ret = mptcp_sendmsg_frag(sk, ssk, msg, NULL, &timeo, &mss_now,
-					 &size_goal);
+		ret = mptcp_sendmsg_frag(sk, ssk, msg, NULL, zc, uarg, &timeo,
+					 &mss_now, &size_goal);
 		if (ret < 0) {
 			if (ret == -EAGAIN && timeo > 0) {
 				mptcp_set_timeout(sk, ssk);
@@ -797,13 +1721,14 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 		}
 
 		copied += ret;
+		mptcp_subflow_update_wmem(sk, ssk);
 
 		tx_ok = msg_data_left(msg);
 		if (!tx_ok)
 			break;
 
 		if (!sk_stream_memory_free(ssk) ||
-		    !mptcp_page_frag_refill(ssk, pfrag) ||
+		    (!zc && !mptcp_page_frag_refill(ssk, pfrag)) ||
 		    !mptcp_ext_cache_refill(msk)) {
 			set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
 			tcp_push(ssk, msg->msg_flags, mss_now,
@@ -829,6 +1754,7 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 		if (unlikely(!sk_stream_memory_free(sk))) {
 			tcp_push(ssk, msg->msg_flags, mss_now,
 				 tcp_sk(ssk)->nonagle, size_goal);
+			mptcp_subflow_update_wmem(sk, ssk);
 			mptcp_clean_una(sk);
 			if (!sk_stream_memory_free(sk)) {
 				/* can't send more for now, need to wait for
@@ -856,69 +1782,286 @@ static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 
 	ssk_check_wmem(msk, ssk);
 	release_sock(ssk);
+
+	if (copied && (msk->sched->flags & MPTCP_SCHED_FLAG_REDUNDANT))
+		mptcp_push_redundant(sk, ssk, start_seq);
 out:
+	if (uarg) {
+		/* the dfrags hold their own references */
+		if (copied)
+			sock_zerocopy_put(uarg);
+		else
+			sock_zerocopy_put_abort(uarg, true);
+	}
 	release_sock(sk);
 	return ret;
 }
 
-static void mptcp_wait_data(struct sock *sk, long *timeo)
+static void mptcp_subflow_early_fallback(struct mptcp_sock *msk,
+					 struct mptcp_subflow_context *subflow)
 {
-	DEFINE_WAIT_FUNC(wait, woken_wake_function);
-	struct mptcp_sock *msk = mptcp_sk(sk);
-
-	add_wait_queue(sk_sleep(sk), &wait);
-	sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	subflow->request_mptcp = 0;
+	__mptcp_do_fallback(msk);
+}
 
-	sk_wait_event(sk, timeo,
-		      test_and_clear_bit(MPTCP_DATA_READY, &msk->flags), &wait);
+/* prepare the first subflow for the active open, before the SYN is sent */
+static void mptcp_connect_init(struct mptcp_sock *msk, struct socket *ssock)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssock->sk);
 
-	sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
-	remove_wait_queue(sk_sleep(sk), &wait);
+	mptcp_token_destroy(msk);
+	inet_sk_state_store((struct sock *)msk, TCP_SYN_SENT);
+#ifdef CONFIG_TCP_MD5SIG
+	/* no MPTCP if MD5SIG is enabled on this socket or we may run out of
+	 * TCP option space.
+	 */
+	if (rcu_access_pointer(tcp_sk(ssock->sk)->md5sig_info))
+		mptcp_subflow_early_fallback(msk, subflow);
+#endif
+	if (subflow->request_mptcp && mptcp_token_new_connect(ssock->sk))
+		mptcp_subflow_early_fallback(msk, subflow);
 }
 
-static int __mptcp_recvmsg_mskq(struct mptcp_sock *msk,
-				struct msghdr *msg,
-				size_t len)
+/* The data carried by the SYN is the first chunk of the MPTCP stream, and
+ * is implicitly mapped by the MP_CAPABLE handshake. Still attach an
+ * explicit mapping to the skb, as TCP will send the data again after the
+ * handshake if the peer did not accept it with the SYN, and in such case
+ * it must carry MP_CAPABLE + data.
+ */
+static void mptcp_fastopen_map_syn_data(struct sock *ssk, int len)
 {
-	struct sock *sk = (struct sock *)msk;
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct mptcp_ext *mpext;
 	struct sk_buff *skb;
-	int copied = 0;
-
-	while ((skb = skb_peek(&sk->sk_receive_queue)) != NULL) {
-		u32 offset = MPTCP_SKB_CB(skb)->offset;
-		u32 data_len = skb->len - offset;
-		u32 count = min_t(size_t, len - copied, data_len);
-		int err;
 
-		err = skb_copy_datagram_msg(skb, offset, msg, count);
-		if (unlikely(err < 0)) {
-			if (!copied)
-				return err;
-			break;
-		}
-
-		copied += count;
+	if (!subflow->request_mptcp)
+		return;
 
-		if (count < data_len) {
-			MPTCP_SKB_CB(skb)->offset += count;
-			break;
-		}
+	/* write_seq and rel_write_seq are initialized at SYN-ACK time */
+	subflow->syn_data_len = len;
 
-		__skb_unlink(skb, &sk->sk_receive_queue);
-		__kfree_skb(skb);
+	/* sent data sits in the rtx queue, right after the SYN */
+	if (tcp_sk(ssk)->syn_data)
+		skb = tcp_rtx_queue_tail(ssk);
+	else
+		skb = tcp_write_queue_tail(ssk);
+	if (WARN_ON_ONCE(!skb || skb->len != len))
+		return;
 
-		if (copied >= len)
-			break;
-	}
+	/* on allocation failure the peer will fall back to plain TCP
+	 * if it has to receive this data again
+	 */
+	mpext = skb_ext_add(skb, SKB_EXT_MPTCP);
+	if (!mpext)
+		return;
 
-	return copied;
+	memset(mpext, 0, sizeof(*mpext));
+	mpext->data_seq = subflow->idsn + 1;
+	mpext->subflow_seq = 1;
+	mpext->data_len = len;
+	mpext->use_map = 1;
+	mpext->dsn64 = 1;
 }
 
-/* receive buffer autotuning.  See tcp_rcv_space_adjust for more information.
- *
- * Only difference: Use highest rtt estimate of the subflows in use.
- */
-static void mptcp_rcv_space_adjust(struct mptcp_sock *msk, int copied)
+static void mptcp_copy_inaddrs(struct sock *msk, const struct sock *ssk);
+
+static int mptcp_sendmsg_fastopen(struct sock *sk, struct msghdr *msg,
+				  size_t len, int *copied_syn)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	unsigned int saved_flags;
+	struct socket *ssock;
+	struct sock *ssk;
+	int ret;
+
+	lock_sock(sk);
+	ssock = __mptcp_nmpc_socket(msk);
+	if (!ssock) {
+		ret = -EISCONN;
+		goto unlock;
+	}
+
+	if (ssock->state == SS_UNCONNECTED)
+		mptcp_connect_init(msk, ssock);
+
+	/* the blocking part of the connect, if any, is performed at the
+	 * MPTCP level, by __mptcp_sendmsg()
+	 */
+	ssk = ssock->sk;
+	saved_flags = msg->msg_flags;
+	msg->msg_flags |= MSG_DONTWAIT;
+	lock_sock(ssk);
+	ret = tcp_sendmsg_fastopen(ssk, msg, copied_syn, len, NULL);
+	if (*copied_syn > 0)
+		mptcp_fastopen_map_syn_data(ssk, *copied_syn);
+	release_sock(ssk);
+	msg->msg_flags = saved_flags;
+
+	sk->sk_socket->state = ssock->state;
+	if (!ret || ret == -EINPROGRESS)
+		mptcp_copy_inaddrs(sk, ssk);
+	else
+		inet_sk_state_store(sk, inet_sk_state_load(ssk));
+
+unlock:
+	release_sock(sk);
+	return ret;
+}
+
+static bool mptcp_want_fastopen(const struct sock *sk,
+				const struct msghdr *msg)
+{
+	const struct sock *ssk = READ_ONCE(mptcp_sk(sk)->first);
+
+	return (msg->msg_flags & MSG_FASTOPEN) ||
+	       (ssk && inet_sk(ssk)->defer_connect);
+}
+
+static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
+{
+	int copied_syn = 0;
+	int ret;
+
+	if (msg->msg_flags & ~(MSG_MORE | MSG_DONTWAIT | MSG_NOSIGNAL |
+			       MSG_ZEROCOPY | MSG_FASTOPEN))
+		return -EOPNOTSUPP;
+
+	if (unlikely(mptcp_want_fastopen(sk, msg))) {
+		ret = mptcp_sendmsg_fastopen(sk, msg, len, &copied_syn);
+
+		/* same semantic of plain TCP: blocking callers wait for
+		 * the connection to complete and send the remaining data
+		 */
+		if (ret == -EINPROGRESS && !(msg->msg_flags & MSG_DONTWAIT))
+			ret = 0;
+		if (ret == -EINPROGRESS && copied_syn > 0)
+			return copied_syn;
+		if (ret)
+			return ret;
+		if (!msg_data_left(msg))
+			return copied_syn;
+	}
+
+	ret = __mptcp_sendmsg(sk, msg, false);
+	if (ret < 0)
+		return copied_syn ? : ret;
+	return ret + copied_syn;
+}
+
+static int mptcp_sendpage(struct sock *sk, struct page *page, int offset,
+			  size_t size, int flags)
+{
+	struct bio_vec bvec = {
+		.bv_page = page,
+		.bv_offset = offset,
+		.bv_len = size,
+	};
+	struct msghdr msg = {};
+
+	if (flags & MSG_SENDPAGE_NOTLAST)
+		flags |= MSG_MORE;
+	msg.msg_flags = flags & (MSG_MORE | MSG_DONTWAIT | MSG_NOSIGNAL);
+	iov_iter_bvec(&msg.msg_iter, WRITE, &bvec, 1, size);
+
+	return __mptcp_sendmsg(sk, &msg, true);
+}
+
+static void mptcp_wait_data(struct sock *sk, long *timeo)
+{
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	add_wait_queue(sk_sleep(sk), &wait);
+	sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+
+	sk_wait_event(sk, timeo,
+		      test_and_clear_bit(MPTCP_DATA_READY, &msk->flags), &wait);
+
+	sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	remove_wait_queue(sk_sleep(sk), &wait);
+}
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* sk_busy_loop_end() counterpart: the data is handed to the msk by the
+ * subflows, possibly while the msk is owned by the busy polling reader
+ */
+static bool mptcp_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct sock *sk = p;
+
+	return test_bit(MPTCP_DATA_READY, &mptcp_sk(sk)->flags) ||
+	       sk_busy_loop_timeout(sk, start_time);
+}
+#endif
+
+/* let RFS steer the packets of all the subflows to the CPU running the
+ * reader, see sock_rps_record_flow()
+ */
+static void mptcp_rps_record_subflows(const struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow)
+		sock_rps_record_flow(mptcp_subflow_tcp_sock(subflow));
+}
+
+static void mptcp_busy_loop(struct sock *sk, int nonblock)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int napi_id = READ_ONCE(sk->sk_napi_id);
+
+	if (napi_id < MIN_NAPI_ID || !sk_can_busy_loop(sk) ||
+	    test_bit(MPTCP_DATA_READY, &mptcp_sk(sk)->flags) ||
+	    inet_sk_state_load(sk) != TCP_ESTABLISHED)
+		return;
+
+	napi_busy_loop(napi_id, nonblock ? NULL : mptcp_busy_loop_end, sk);
+#endif
+}
+
+static int __mptcp_recvmsg_mskq(struct mptcp_sock *msk,
+				struct msghdr *msg,
+				size_t len)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct sk_buff *skb;
+	int copied = 0;
+
+	while ((skb = skb_peek(&sk->sk_receive_queue)) != NULL) {
+		u32 offset = MPTCP_SKB_CB(skb)->offset;
+		u32 data_len = skb->len - offset;
+		u32 count = min_t(size_t, len - copied, data_len);
+		int err;
+
+		err = skb_copy_datagram_msg(skb, offset, msg, count);
+		if (unlikely(err < 0)) {
+			if (!copied)
+				return err;
+			break;
+		}
+
+		copied += count;
+
+		if (count < data_len) {
+			MPTCP_SKB_CB(skb)->offset += count;
+			break;
+		}
+
+		__skb_unlink(skb, &sk->sk_receive_queue);
+		__kfree_skb(skb);
+
+		if (copied >= len)
+			break;
+	}
+
+	return copied;
+}
+
+/* receive buffer autotuning.  See tcp_rcv_space_adjust for more information.
+ *
+ * Only difference: Use highest rtt estimate of the subflows in use.
+ */
+static void mptcp_rcv_space_adjust(struct mptcp_sock *msk, int copied)
 {
 	struct mptcp_subflow_context *subflow;
 	struct sock *sk = (struct sock *)msk;
@@ -1008,123 +2151,551 @@ static void mptcp_rcv_space_adjust(struct mptcp_sock *msk, int copied)
 	msk->rcvq_space.time = mstamp;
 }
 
-static bool __mptcp_move_skbs(struct mptcp_sock *msk)
+/* tcp_cleanup_rbuf() counterpart. The receive window is shared: each
+ * subflow advertises the msk free space, see mptcp_space(), but only when
+ * it sends an ACK. After a read that freed a lot of msk space, send a
+ * window update, carrying the current DATA_ACK, on the subflows whose
+ * window opens significantly, instead of waiting for new data on them.
+ */
+static void mptcp_cleanup_rbuf(struct mptcp_sock *msk, int copied)
+{
+	struct mptcp_subflow_context *subflow;
+
+	if (copied <= 0)
+		return;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		const struct tcp_sock *tp = tcp_sk(ssk);
+
+		/* lockless pre-check, tcp_cleanup_rbuf() re-evaluates it */
+		if (!inet_csk_ack_scheduled(ssk) &&
+		    2 * tcp_receive_window(tp) > READ_ONCE(tp->window_clamp))
+			continue;
+
+		lock_sock(ssk);
+		if (!((1 << ssk->sk_state) &
+		      (TCPF_SYN_SENT | TCPF_SYN_RECV | TCPF_LISTEN | TCPF_CLOSE)))
+			tcp_cleanup_rbuf(ssk, copied);
+		release_sock(ssk);
+	}
+}
+
+static bool __mptcp_move_skbs(struct mptcp_sock *msk)
+{
+	unsigned int moved = 0;
+	bool done;
+
+	/* the data handed off by the subflows needs no ssk lock */
+	if (__mptcp_splice_handoff(msk))
+		return true;
+
+	do {
+		struct sock *ssk = mptcp_subflow_recv_lookup(msk);
+
+		if (!ssk)
+			break;
+
+		lock_sock(ssk);
+		done = __mptcp_move_skbs_from_subflow(msk, ssk, &moved, false);
+		release_sock(ssk);
+	} while (!done);
+
+	/* the subflow release_sock() above may have handed off more data */
+	if (__mptcp_splice_handoff(msk))
+		moved++;
+
+	return moved > 0;
+}
+
+static void mptcp_sync_data_ready(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+
+	if (skb_queue_empty(&sk->sk_receive_queue)) {
+		/* entire backlog drained, clear DATA_READY. */
+		clear_bit(MPTCP_DATA_READY, &msk->flags);
+
+		/* .. race-breaker: ssk might have gotten new data
+		 * after last __mptcp_move_skbs() returned false.
+		 */
+		if (unlikely(__mptcp_move_skbs(msk)))
+			set_bit(MPTCP_DATA_READY, &msk->flags);
+	} else if (unlikely(!test_bit(MPTCP_DATA_READY, &msk->flags))) {
+		/* data to read but mptcp_wait_data() cleared DATA_READY */
+		set_bit(MPTCP_DATA_READY, &msk->flags);
+	}
+}
+
+static int mptcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			 int nonblock, int flags, int *addr_len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int copied = 0;
+	int target;
+	long timeo;
+
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return inet_recv_error(sk, msg, len, addr_len);
+
+	if (msg->msg_flags & ~(MSG_WAITALL | MSG_DONTWAIT))
+		return -EOPNOTSUPP;
+
+	mptcp_busy_loop(sk, nonblock);
+
+	lock_sock(sk);
+	timeo = sock_rcvtimeo(sk, nonblock);
+
+	len = min_t(size_t, len, INT_MAX);
+	target = sock_rcvlowat(sk, flags & MSG_WAITALL, len);
+	__mptcp_flush_join_list(msk);
+	mptcp_rps_record_subflows(msk);
+
+	while (len > (size_t)copied) {
+		int bytes_read;
+
+		bytes_read = __mptcp_recvmsg_mskq(msk, msg, len - copied);
+		if (unlikely(bytes_read < 0)) {
+			if (!copied)
+				copied = bytes_read;
+			goto out_err;
+		}
+
+		copied += bytes_read;
+
+		if (skb_queue_empty(&sk->sk_receive_queue) &&
+		    __mptcp_move_skbs(msk))
+			continue;
+
+		/* only the master socket status is relevant here. The exit
+		 * conditions mirror closely tcp_recvmsg()
+		 */
+		if (copied >= target)
+			break;
+
+		if (copied) {
+			if (sk->sk_err ||
+			    sk->sk_state == TCP_CLOSE ||
+			    (sk->sk_shutdown & RCV_SHUTDOWN) ||
+			    !timeo ||
+			    signal_pending(current))
+				break;
+		} else {
+			if (sk->sk_err) {
+				copied = sock_error(sk);
+				break;
+			}
+
+			mptcp_check_data_fin(sk);
+			if (test_and_clear_bit(MPTCP_WORK_EOF, &msk->flags))
+				mptcp_check_for_eof(msk);
+
+			if (sk->sk_shutdown & RCV_SHUTDOWN)
+				break;
+
+			if (sk->sk_state == TCP_CLOSE) {
+				copied = -ENOTCONN;
+				break;
+			}
+
+			if (!timeo) {
+				copied = -EAGAIN;
+				break;
+			}
+
+			if (signal_pending(current)) {
+				copied = sock_intr_errno(timeo);
+				break;
+			}
+		}
+
+		pr_debug("block timeout %ld", timeo);
+		mptcp_wait_data(sk, &timeo);
+	}
+
+	mptcp_sync_data_ready(msk);
+out_err:
+	mptcp_rcv_space_adjust(msk, copied);
+	mptcp_cleanup_rbuf(msk, copied);
+
+	release_sock(sk);
+	return copied;
+}
+
+/* tcp_read_sock() counterpart: hand the skbs in the msk receive queue to
+ * @recv_actor, pulling more data from the subflows as needed.
+ * Called with the msk socket lock held.
+ */
+static int mptcp_read_sock(struct sock *sk, read_descriptor_t *desc,
+			   sk_read_actor_t recv_actor)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct sk_buff *skb;
+	int copied = 0;
+
+	if (sk->sk_state == TCP_LISTEN)
+		return -ENOTCONN;
+
+	__mptcp_flush_join_list(msk);
+	while (desc->count) {
+		u32 offset, len;
+		int used;
+
+		skb = skb_peek(&sk->sk_receive_queue);
+		if (!skb) {
+			if (__mptcp_move_skbs(msk))
+				continue;
+			break;
+		}
+
+		offset = MPTCP_SKB_CB(skb)->offset;
+		len = skb->len - offset;
+		used = recv_actor(desc, skb, offset, len);
+		if (used <= 0) {
+			if (!copied)
+				copied = used;
+			break;
+		}
+
+		if (WARN_ON_ONCE(used > len))
+			used = len;
+		copied += used;
+
+		if (used < len) {
+			MPTCP_SKB_CB(skb)->offset += used;
+			continue;
+		}
+
+		__skb_unlink(skb, &sk->sk_receive_queue);
+		__kfree_skb(skb);
+	}
+
+	mptcp_sync_data_ready(msk);
+	if (copied > 0) {
+		mptcp_rcv_space_adjust(msk, copied);
+		mptcp_cleanup_rbuf(msk, copied);
+	}
+
+	return copied;
+}
+
+struct mptcp_splice_state {
+	struct pipe_inode_info *pipe;
+	size_t len;
+	unsigned int flags;
+};
+
+static int mptcp_splice_data_recv(read_descriptor_t *rd_desc,
+				  struct sk_buff *skb, unsigned int offset,
+				  size_t len)
+{
+	struct mptcp_splice_state *mss = rd_desc->arg.data;
+	int ret;
+
+	ret = skb_splice_bits(skb, skb->sk, offset, mss->pipe,
+			      min(rd_desc->count, len), mss->flags);
+	if (ret > 0)
+		rd_desc->count -= ret;
+	return ret;
+}
+
+/* mirrors tcp_splice_read(), the exit conditions follow mptcp_recvmsg() */
+static ssize_t mptcp_splice_read(struct socket *sock, loff_t *ppos,
+				 struct pipe_inode_info *pipe, size_t len,
+				 unsigned int flags)
+{
+	struct mptcp_splice_state mss = {
+		.pipe = pipe,
+		.len = len,
+		.flags = flags,
+	};
+	struct sock *sk = sock->sk;
+	read_descriptor_t rd_desc;
+	ssize_t spliced = 0;
+	int ret = 0;
+	long timeo;
+
+	if (unlikely(*ppos))
+		return -ESPIPE;
+
+	lock_sock(sk);
+	timeo = sock_rcvtimeo(sk, sock->file->f_flags & O_NONBLOCK);
+	while (mss.len) {
+		rd_desc.arg.data = &mss;
+		rd_desc.count = mss.len;
+		ret = mptcp_read_sock(sk, &rd_desc, mptcp_splice_data_recv);
+		if (ret < 0)
+			break;
+
+		if (!ret) {
+			if (spliced)
+				break;
+			if (sk->sk_err) {
+				ret = sock_error(sk);
+				break;
+			}
+			mptcp_check_data_fin(sk);
+			if (test_and_clear_bit(MPTCP_WORK_EOF,
+					       &mptcp_sk(sk)->flags))
+				mptcp_check_for_eof(mptcp_sk(sk));
+			if (sk->sk_shutdown & RCV_SHUTDOWN)
+				break;
+			if (sk->sk_state == TCP_CLOSE) {
+				ret = -ENOTCONN;
+				break;
+			}
+			if (!timeo) {
+				ret = -EAGAIN;
+				break;
+			}
+			/* the pipe is full, don't spin on pending data */
+			if (!skb_queue_empty(&sk->sk_receive_queue))
+				break;
+
+			mptcp_wait_data(sk, &timeo);
+			if (signal_pending(current)) {
+				ret = sock_intr_errno(timeo);
+				break;
+			}
+			continue;
+		}
+
+		mss.len -= ret;
+		spliced += ret;
+
+		if (!timeo)
+			break;
+
+		release_sock(sk);
+		lock_sock(sk);
+
+		if (sk->sk_err || sk->sk_state == TCP_CLOSE ||
+		    (sk->sk_shutdown & RCV_SHUTDOWN) ||
+		    signal_pending(current))
+			break;
+	}
+
+	release_sock(sk);
+
+	if (spliced)
+		return spliced;
+
+	return ret;
+}
+
+#ifdef CONFIG_MMU
+#define MPTCP_ZC_BATCH	8
+
+/* bytes queued for reading at the msk level, see tcp_inq_hint() */
+static int mptcp_inq_hint(struct sock *sk)
+{
+	struct sk_buff *skb;
+	int inq = 0;
+
+	skb_queue_walk(&sk->sk_receive_queue, skb)
+		inq += skb->len - MPTCP_SKB_CB(skb)->offset;
+
+	if (inq == 0 && (sk->sk_shutdown & RCV_SHUTDOWN))
+		inq = 1;
+	return inq;
+}
+
+/* drop @len bytes, already mapped to user space, from the head of the
+ * msk receive queue
+ */
+static void mptcp_eat_rcv_queue(struct sock *sk, u32 len)
+{
+	struct sk_buff *skb;
+
+	while (len && (skb = skb_peek(&sk->sk_receive_queue)) != NULL) {
+		u32 data_len = skb->len - MPTCP_SKB_CB(skb)->offset;
+
+		if (len < data_len) {
+			MPTCP_SKB_CB(skb)->offset += len;
+			break;
+		}
+
+		len -= data_len;
+		__skb_unlink(skb, &sk->sk_receive_queue);
+		__kfree_skb(skb);
+	}
+}
+
+/* length of the run of frags, starting at @offset into frag @i, that
+ * can't be mapped and must be copied by the caller
+ */
+static u32 mptcp_zc_skip_hint(const struct sk_buff *skb, int i, u32 offset)
 {
-	unsigned int moved = 0;
-	bool done;
+	const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+	u32 skip = skb_frag_size(frag) - offset;
 
-	do {
-		struct sock *ssk = mptcp_subflow_recv_lookup(msk);
-
-		if (!ssk)
+	for (i++, frag++; i < skb_shinfo(skb)->nr_frags; i++, frag++) {
+		if (skb_frag_size(frag) == PAGE_SIZE && !skb_frag_off(frag))
 			break;
+		skip += skb_frag_size(frag);
+	}
+	return skip;
+}
 
-		lock_sock(ssk);
-		done = __mptcp_move_skbs_from_subflow(msk, ssk, &moved);
-		release_sock(ssk);
-	} while (!done);
+static int mptcp_zc_insert_batch(struct vm_area_struct *vma,
+				 struct page **pages, unsigned long nr,
+				 unsigned long address, u32 *length,
+				 struct tcp_zerocopy_receive *zc)
+{
+	unsigned long remaining = nr;
+	int ret;
 
-	return moved > 0;
+	ret = vm_insert_pages(vma, address + *length - nr * PAGE_SIZE, pages,
+			      &remaining);
+	if (ret) {
+		/* the leading part of the batch may have been mapped */
+		*length -= remaining * PAGE_SIZE;
+		zc->recv_skip_hint += remaining * PAGE_SIZE;
+	}
+	return ret;
 }
 
-static int mptcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
-			 int nonblock, int flags, int *addr_len)
+/* tcp_zerocopy_receive() counterpart: remap the page-sized, page-aligned
+ * frags found in the in-order msk receive queue into the user vma.
+ * Called with the msk socket lock held.
+ */
+static int mptcp_zerocopy_receive(struct sock *sk,
+				  struct tcp_zerocopy_receive *zc)
 {
+	unsigned long address = (unsigned long)zc->address;
 	struct mptcp_sock *msk = mptcp_sk(sk);
-	int copied = 0;
-	int target;
-	long timeo;
+	struct page *pages[MPTCP_ZC_BATCH];
+	struct vm_area_struct *vma;
+	unsigned long pg_idx = 0;
+	struct sk_buff *skb;
+	u32 length = 0;
+	u32 zap_len;
+	int ret = 0;
 
-	if (msg->msg_flags & ~(MSG_WAITALL | MSG_DONTWAIT))
-		return -EOPNOTSUPP;
+	if (address & (PAGE_SIZE - 1) || address != zc->address)
+		return -EINVAL;
 
-	lock_sock(sk);
-	timeo = sock_rcvtimeo(sk, nonblock);
+	if (sk->sk_state == TCP_LISTEN)
+		return -ENOTCONN;
 
-	len = min_t(size_t, len, INT_MAX);
-	target = sock_rcvlowat(sk, flags & MSG_WAITALL, len);
 	__mptcp_flush_join_list(msk);
+	mptcp_rps_record_subflows(msk);
+	if (skb_queue_empty(&sk->sk_receive_queue))
+		__mptcp_move_skbs(msk);
 
-	while (len > (size_t)copied) {
-		int bytes_read;
-
-		bytes_read = __mptcp_recvmsg_mskq(msk, msg, len - copied);
-		if (unlikely(bytes_read < 0)) {
-			if (!copied)
-				copied = bytes_read;
-			goto out_err;
-		}
-
-		copied += bytes_read;
+	mmap_read_lock(current->mm);
 
-		if (skb_queue_empty(&sk->sk_receive_queue) &&
-		    __mptcp_move_skbs(msk))
-			continue;
+	vma = find_vma(current->mm, address);
+	if (!vma || vma->vm_start > address || !tcp_is_zerocopy_vma(vma)) {
+		mmap_read_unlock(current->mm);
+		return -EINVAL;
+	}
+	zc->length = min_t(unsigned long, zc->length, vma->vm_end - address);
+	zc->length = min_t(u32, zc->length, mptcp_inq_hint(sk));
+	zap_len = zc->length & ~(PAGE_SIZE - 1);
+	if (zap_len)
+		zap_page_range(vma, address, zap_len);
+	zc->recv_skip_hint = 0;
+
+	skb_queue_walk(&sk->sk_receive_queue, skb) {
+		u32 offset = MPTCP_SKB_CB(skb)->offset;
+		int i;
 
-		/* only the master socket status is relevant here. The exit
-		 * conditions mirror closely tcp_recvmsg()
-		 */
-		if (copied >= target)
+		if (offset < skb_headlen(skb) || skb_has_frag_list(skb)) {
+			zc->recv_skip_hint = skb->len - offset;
 			break;
+		}
 
-		if (copied) {
-			if (sk->sk_err ||
-			    sk->sk_state == TCP_CLOSE ||
-			    (sk->sk_shutdown & RCV_SHUTDOWN) ||
-			    !timeo ||
-			    signal_pending(current))
-				break;
-		} else {
-			if (sk->sk_err) {
-				copied = sock_error(sk);
-				break;
-			}
-
-			if (test_and_clear_bit(MPTCP_WORK_EOF, &msk->flags))
-				mptcp_check_for_eof(msk);
+		offset -= skb_headlen(skb);
+		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+			const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
 
-			if (sk->sk_shutdown & RCV_SHUTDOWN)
-				break;
+			if (offset >= skb_frag_size(frag)) {
+				offset -= skb_frag_size(frag);
+				continue;
+			}
 
-			if (sk->sk_state == TCP_CLOSE) {
-				copied = -ENOTCONN;
-				break;
+			if (length + PAGE_SIZE > zc->length) {
+				zc->recv_skip_hint = zc->length - length;
+				goto insert;
 			}
 
-			if (!timeo) {
-				copied = -EAGAIN;
-				break;
+			if (offset || skb_frag_size(frag) != PAGE_SIZE ||
+			    skb_frag_off(frag)) {
+				zc->recv_skip_hint = mptcp_zc_skip_hint(skb, i,
+									offset);
+				goto insert;
 			}
 
-			if (signal_pending(current)) {
-				copied = sock_intr_errno(timeo);
-				break;
+			pages[pg_idx++] = skb_frag_page(frag);
+			length += PAGE_SIZE;
+			if (pg_idx == MPTCP_ZC_BATCH) {
+				ret = mptcp_zc_insert_batch(vma, pages, pg_idx,
+							    address, &length,
+							    zc);
+				if (ret)
+					goto out;
+				pg_idx = 0;
 			}
 		}
+	}
 
-		pr_debug("block timeout %ld", timeo);
-		mptcp_wait_data(sk, &timeo);
+insert:
+	if (pg_idx)
+		ret = mptcp_zc_insert_batch(vma, pages, pg_idx, address,
+					    &length, zc);
+out:
+	mmap_read_unlock(current->mm);
+	if (length) {
+		mptcp_eat_rcv_queue(sk, length);
+		mptcp_sync_data_ready(msk);
+		mptcp_rcv_space_adjust(msk, length);
+		mptcp_cleanup_rbuf(msk, length);
+		ret = 0;
+		if (length == zc->length)
+			zc->recv_skip_hint = 0;
+	} else {
+		if (!zc->recv_skip_hint && (sk->sk_shutdown & RCV_SHUTDOWN))
+			ret = -EIO;
 	}
+	zc->length = length;
+	return ret;
+}
 
-	if (skb_queue_empty(&sk->sk_receive_queue)) {
-		/* entire backlog drained, clear DATA_READY. */
-		clear_bit(MPTCP_DATA_READY, &msk->flags);
+static int mptcp_getsockopt_zerocopy_rcv(struct mptcp_sock *msk,
+					 char __user *optval,
+					 int __user *optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct tcp_zerocopy_receive zc;
+	int err, len;
 
-		/* .. race-breaker: ssk might have gotten new data
-		 * after last __mptcp_move_skbs() returned false.
-		 */
-		if (unlikely(__mptcp_move_skbs(msk)))
-			set_bit(MPTCP_DATA_READY, &msk->flags);
-	} else if (unlikely(!test_bit(MPTCP_DATA_READY, &msk->flags))) {
-		/* data to read but mptcp_wait_data() cleared DATA_READY */
-		set_bit(MPTCP_DATA_READY, &msk->flags);
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < offsetofend(struct tcp_zerocopy_receive, length))
+		return -EINVAL;
+	if (len > sizeof(zc)) {
+		len = sizeof(zc);
+		if (put_user(len, optlen))
+			return -EFAULT;
 	}
-out_err:
-	mptcp_rcv_space_adjust(msk, copied);
+	if (copy_from_user(&zc, optval, len))
+		return -EFAULT;
 
+	lock_sock(sk);
+	err = mptcp_zerocopy_receive(sk, &zc);
+	if (len >= offsetofend(struct tcp_zerocopy_receive, inq))
+		zc.inq = mptcp_inq_hint(sk);
 	release_sock(sk);
-	return copied;
+
+	if (len >= offsetofend(struct tcp_zerocopy_receive, err) && !err)
+		zc.err = sock_error(sk);
+
+	if (!err && copy_to_user(optval, &zc, len))
+		err = -EFAULT;
+	return err;
 }
+#endif
 
 static void mptcp_retransmit_handler(struct sock *sk)
 {
@@ -1158,8 +2729,9 @@ static void mptcp_retransmit_timer(struct timer_list *t)
 	sock_put(sk);
 }
 
-/* Find an idle subflow.  Return NULL if there is unacked data at tcp
- * level.
+/* Find an idle subflow, skipping the ones with unacked data at tcp
+ * level: those will recover by themselves, while an idle subflow can
+ * deliver the missing data right away.
  *
  * A backup subflow is returned only if that is the only kind available.
  */
@@ -1173,11 +2745,11 @@ static struct sock *mptcp_subflow_get_retrans(const struct mptcp_sock *msk)
 	mptcp_for_each_subflow(msk, subflow) {
 		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
 
-		/* still data outstanding at TCP level?  Don't retransmit. */
+		/* still data outstanding at TCP level?  skip this */
 		if (!tcp_write_queue_empty(ssk))
-			return NULL;
+			continue;
 
-		if (subflow->backup) {
+		if (mptcp_subflow_is_backup(subflow)) {
 			if (!backup)
 				backup = ssk;
 			continue;
@@ -1197,13 +2769,14 @@ static struct sock *mptcp_subflow_get_retrans(const struct mptcp_sock *msk)
  * so we need to use tcp_close() after detaching them from the mptcp
  * parent socket.
  */
-static void __mptcp_close_ssk(struct sock *sk, struct sock *ssk,
-			      struct mptcp_subflow_context *subflow,
-			      long timeout)
+void __mptcp_close_ssk(struct sock *sk, struct sock *ssk,
+		       struct mptcp_subflow_context *subflow, long timeout)
 {
 	struct socket *sock = READ_ONCE(ssk->sk_socket);
 
 	list_del(&subflow->node);
+	mptcp_event(MPTCP_EVENT_SUB_CLOSED, mptcp_sk(sk), ssk, GFP_KERNEL);
+	mptcp_subflow_release_wmem(sk, ssk);
 
 	if (sock && sock != sk->sk_socket) {
 		/* outgoing subflow */
@@ -1230,6 +2803,10 @@ static void pm_work(struct mptcp_sock *msk)
 		pm->status &= ~BIT(MPTCP_PM_ADD_ADDR_RECEIVED);
 		mptcp_pm_nl_add_addr_received(msk);
 	}
+	if (pm->status & BIT(MPTCP_PM_RM_ADDR_RECEIVED)) {
+		pm->status &= ~BIT(MPTCP_PM_RM_ADDR_RECEIVED);
+		mptcp_pm_nl_rm_addr_received(msk);
+	}
 	if (pm->status & BIT(MPTCP_PM_ESTABLISHED)) {
 		pm->status &= ~BIT(MPTCP_PM_ESTABLISHED);
 		mptcp_pm_nl_fully_established(msk);
@@ -1239,24 +2816,90 @@ static void pm_work(struct mptcp_sock *msk)
 		mptcp_pm_nl_subflow_established(msk);
 	}
 
+	/* last, so that announcements queued by the above go out, too */
+	if (pm->status & BIT(MPTCP_PM_ADD_ADDR_SEND_ACK)) {
+		pm->status &= ~BIT(MPTCP_PM_ADD_ADDR_SEND_ACK);
+		spin_unlock_bh(&msk->pm.lock);
+		mptcp_pm_nl_addr_send_ack(msk);
+		spin_lock_bh(&msk->pm.lock);
+	}
+
 	spin_unlock_bh(&msk->pm.lock);
 }
 
+static void __mptcp_clear_xmit(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dtmp, *dfrag;
+
+	sk_stop_timer(sk, &msk->sk.icsk_retransmit_timer);
+
+	list_for_each_entry_safe(dfrag, dtmp, &msk->rtx_queue, list)
+		dfrag_clear(sk, dfrag);
+}
+
+/* reset all the subflows and close all but the initial one, which is
+ * owned by the msk and released with it. Called with the msk lock held.
+ */
+static void mptcp_reset_subflows(struct mptcp_sock *msk, bool fastclose)
+{
+	struct mptcp_subflow_context *subflow, *tmp;
+	struct sock *sk = (struct sock *)msk;
+
+	__mptcp_flush_join_list(msk);
+	list_for_each_entry_safe(subflow, tmp, &msk->conn_list, node) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		mptcp_subflow_reset(ssk, fastclose);
+		if (ssk != msk->first)
+			__mptcp_close_ssk(sk, ssk, subflow, 0);
+	}
+}
+
+static void mptcp_check_fastclose(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+
+	if (sk->sk_state == TCP_CLOSE)
+		return;
+
+	mptcp_reset_subflows(msk, false);
+
+	__mptcp_clear_xmit(sk);
+	inet_sk_state_store(sk, TCP_CLOSE);
+	sk->sk_shutdown = SHUTDOWN_MASK;
+	sk->sk_err = ECONNRESET;
+
+	smp_mb__before_atomic(); /* SHUTDOWN must be visible first */
+	set_bit(MPTCP_DATA_READY, &msk->flags);
+	sk->sk_error_report(sk);
+	sk->sk_state_change(sk);
+}
+
 static void mptcp_worker(struct work_struct *work)
 {
 	struct mptcp_sock *msk = container_of(work, struct mptcp_sock, work);
 	struct sock *ssk, *sk = &msk->sk.icsk_inet.sk;
-	int orig_len, orig_offset, mss_now = 0, size_goal = 0;
+	struct mptcp_subflow_context *subflow;
 	struct mptcp_data_frag *dfrag;
-	u64 orig_write_seq;
-	size_t copied = 0;
-	struct msghdr msg;
-	long timeo = 0;
 
 	lock_sock(sk);
-	mptcp_clean_una(sk);
 	__mptcp_flush_join_list(msk);
+
+	/* passive joins are created in softirq context: replay the msk-level
+	 * socket options on them here, where we are allowed to sleep
+	 */
+	mptcp_for_each_subflow(msk, subflow)
+		mptcp_sockopt_sync(msk, mptcp_subflow_tcp_sock(subflow));
+
+	if (test_and_clear_bit(MPTCP_WORK_FASTCLOSE, &msk->flags)) {
+		mptcp_check_fastclose(msk);
+		goto unlock;
+	}
+
+	mptcp_clean_una(sk);
 	__mptcp_move_skbs(msk);
+	mptcp_check_data_fin(sk);
 
 	if (msk->pm.status)
 		pm_work(msk);
@@ -1268,8 +2911,14 @@ static void mptcp_worker(struct work_struct *work)
 		goto unlock;
 
 	dfrag = mptcp_rtx_head(sk);
-	if (!dfrag)
+	if (!dfrag) {
+		/* only the DATA_FIN is left to be acked */
+		if (msk->snd_data_fin_enable) {
+			mptcp_send_ack(msk);
+			goto reset_unlock;
+		}
 		goto unlock;
+	}
 
 	if (!mptcp_ext_cache_refill(msk))
 		goto reset_unlock;
@@ -1279,33 +2928,7 @@ static void mptcp_worker(struct work_struct *work)
 		goto reset_unlock;
 
 	lock_sock(ssk);
-
-	msg.msg_flags = MSG_DONTWAIT;
-	orig_len = dfrag->data_len;
-	orig_offset = dfrag->offset;
-	orig_write_seq = dfrag->data_seq;
-	while (dfrag->data_len > 0) {
-		int ret = mptcp_sendmsg_frag(sk, ssk, &msg, dfrag, &timeo,
-					     &mss_now, &size_goal);
-		if (ret < 0)
-			break;
-
-		MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_RETRANSSEGS);
-		copied += ret;
-		dfrag->data_len -= ret;
-		dfrag->offset += ret;
-
-		if (!mptcp_ext_cache_refill(msk))
-			break;
-	}
-	if (copied)
-		tcp_push(ssk, msg.msg_flags, mss_now, tcp_sk(ssk)->nonagle,
-			 size_goal);
-
-	dfrag->data_seq = orig_write_seq;
-	dfrag->offset = orig_offset;
-	dfrag->data_len = orig_len;
-
+	mptcp_retransmit_dfrag(sk, ssk, dfrag);
 	mptcp_set_timeout(sk, ssk);
 	release_sock(ssk);
 
@@ -1327,13 +2950,18 @@ static int __mptcp_init_sock(struct sock *sk)
 	INIT_LIST_HEAD(&msk->conn_list);
 	INIT_LIST_HEAD(&msk->join_list);
 	INIT_LIST_HEAD(&msk->rtx_queue);
+	msk->out_of_order_queue = RB_ROOT;
+	msk->rx_handoff = NULL;
 	__set_bit(MPTCP_SEND_SPACE, &msk->flags);
+	atomic_set(&msk->wmem_sndbuf, 0);
+	atomic_set(&msk->wmem_notsent, 0);
 	INIT_WORK(&msk->work, mptcp_worker);
 
 	msk->first = NULL;
 	inet_csk(sk)->icsk_sync_mss = mptcp_sync_mss;
 
 	mptcp_pm_data_init(msk);
+	mptcp_sched_data_init(msk);
 
 	/* re-use the csk retrans timer for MPTCP-level retrans */
 	timer_setup(&msk->sk.icsk_retransmit_timer, mptcp_retransmit_timer, 0);
@@ -1365,22 +2993,11 @@ static int mptcp_init_sock(struct sock *sk)
 
 	sk_sockets_allocated_inc(sk);
 	sk->sk_rcvbuf = sock_net(sk)->ipv4.sysctl_tcp_rmem[1];
-	sk->sk_sndbuf = sock_net(sk)->ipv4.sysctl_tcp_wmem[2];
+	sk->sk_sndbuf = sock_net(sk)->ipv4.sysctl_tcp_wmem[1];
 
 	return 0;
 }
 
-static void __mptcp_clear_xmit(struct sock *sk)
-{
-	struct mptcp_sock *msk = mptcp_sk(sk);
-	struct mptcp_data_frag *dtmp, *dfrag;
-
-	sk_stop_timer(sk, &msk->sk.icsk_retransmit_timer);
-
-	list_for_each_entry_safe(dfrag, dtmp, &msk->rtx_queue, list)
-		dfrag_clear(sk, dfrag);
-}
-
 static void mptcp_cancel_work(struct sock *sk)
 {
 	struct mptcp_sock *msk = mptcp_sk(sk);
@@ -1389,8 +3006,11 @@ static void mptcp_cancel_work(struct sock *sk)
 		sock_put(sk);
 }
 
-static void mptcp_subflow_shutdown(struct sock *ssk, int how,
-				   bool data_fin_tx_enable, u64 data_fin_tx_seq)
+/* Only listening and connecting subflows and fallback connections are
+ * shut down at TCP level; otherwise the shutdown happens at the MPTCP
+ * level via DATA_FIN, see __mptcp_wr_shutdown()
+ */
+static void mptcp_subflow_shutdown(struct sock *sk, struct sock *ssk, int how)
 {
 	lock_sock(ssk);
 
@@ -1403,16 +3023,10 @@ static void mptcp_subflow_shutdown(struct sock *ssk, int how,
 		tcp_disconnect(ssk, O_NONBLOCK);
 		break;
 	default:
-		if (data_fin_tx_enable) {
-			struct mptcp_subflow_context *subflow;
-
-			subflow = mptcp_subflow_ctx(ssk);
-			subflow->data_fin_tx_seq = data_fin_tx_seq;
-			subflow->data_fin_tx_enable = 1;
+		if (__mptcp_check_fallback(mptcp_sk(sk))) {
+			ssk->sk_shutdown |= how;
+			tcp_shutdown(ssk, how);
 		}
-
-		ssk->sk_shutdown |= how;
-		tcp_shutdown(ssk, how);
 		break;
 	}
 
@@ -1425,10 +3039,25 @@ static void mptcp_close(struct sock *sk, long timeout)
 	struct mptcp_subflow_context *subflow, *tmp;
 	struct mptcp_sock *msk = mptcp_sk(sk);
 	LIST_HEAD(conn_list);
-	u64 data_fin_tx_seq;
+	bool fastclose, notify;
 
 	lock_sock(sk);
+	sk->sk_shutdown = SHUTDOWN_MASK;
+	notify = msk->token && sk->sk_state != TCP_LISTEN;
+
+	/* abortive close, as per SO_LINGER with zero timeout: reset all the
+	 * subflows at once instead of the per subflow FIN handshake
+	 */
+	fastclose = sock_flag(sk, SOCK_LINGER) && !sk->sk_lingertime &&
+		    !((1 << sk->sk_state) & (TCPF_CLOSE | TCPF_LISTEN));
+
+	if (!fastclose && !__mptcp_check_fallback(msk) &&
+	    mptcp_close_state(sk)) {
+		__mptcp_wr_shutdown(sk);
 
+		/* with SO_LINGER, wait for the DATA_FIN to be acked */
+		sk_stream_wait_close(sk, timeout);
+	}
 	inet_sk_state_store(sk, TCP_CLOSE);
 
 	/* be sure to always acquire the join list lock, to sync vs
@@ -1439,8 +3068,6 @@ static void mptcp_close(struct sock *sk, long timeout)
 	spin_unlock_bh(&msk->join_list_lock);
 	list_splice_init(&msk->conn_list, &conn_list);
 
-	data_fin_tx_seq = msk->write_seq;
-
 	__mptcp_clear_xmit(sk);
 
 	release_sock(sk);
@@ -1448,11 +3075,14 @@ static void mptcp_close(struct sock *sk, long timeout)
 	list_for_each_entry_safe(subflow, tmp, &conn_list, node) {
 		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
 
-		subflow->data_fin_tx_seq = data_fin_tx_seq;
-		subflow->data_fin_tx_enable = 1;
+		if (fastclose)
+			mptcp_subflow_reset(ssk, true);
 		__mptcp_close_ssk(sk, ssk, subflow, timeout);
 	}
 
+	if (notify)
+		mptcp_pm_connection_closed(msk);
+
 	mptcp_cancel_work(sk);
 
 	__skb_queue_purge(&sk->sk_receive_queue);
@@ -1534,6 +3164,7 @@ struct sock *mptcp_sk_clone(const struct sock *sk,
 		mptcp_crypto_key_sha(msk->remote_key, NULL, &ack_seq);
 		ack_seq++;
 		msk->ack_seq = ack_seq;
+		mptcp_crypto_msk_keys_init(msk);
 	}
 
 #if !IS_ENABLED(CONFIG_KASAN)
@@ -1621,18 +3252,111 @@ static struct sock *mptcp_accept(struct sock *sk, int flags, int *err,
 				MPTCP_MIB_MPCAPABLEPASSIVEFALLBACK);
 	}
 
-	return newsk;
+	return newsk;
+}
+
+static void mptcp_destroy(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	mptcp_token_destroy(msk);
+	mptcp_pm_free_anno_list(msk, true);
+	if (msk->cached_ext)
+		__skb_ext_put(msk->cached_ext);
+
+	skb_rbtree_purge(&msk->out_of_order_queue);
+	mptcp_purge_handoff(msk);
+	mptcp_sched_release(msk);
+	sk_sockets_allocated_dec(sk);
+}
+
+static void __mptcp_sockopt_sync(struct mptcp_sock *msk, struct sock *ssk)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct tcp_sock *tp = tcp_sk(ssk);
+	bool keepalive;
+
+	if (ssk->sk_mark != sk->sk_mark) {
+		ssk->sk_mark = sk->sk_mark;
+		sk_dst_reset(ssk);
+	}
+	ssk->sk_priority = sk->sk_priority;
+
+	if (sk->sk_userlocks & SOCK_SNDBUF_LOCK)
+		WRITE_ONCE(ssk->sk_sndbuf, sk->sk_sndbuf);
+	if (sk->sk_userlocks & SOCK_RCVBUF_LOCK)
+		WRITE_ONCE(ssk->sk_rcvbuf, sk->sk_rcvbuf);
+	ssk->sk_userlocks |= sk->sk_userlocks &
+			     (SOCK_SNDBUF_LOCK | SOCK_RCVBUF_LOCK);
+
+	keepalive = sock_flag(sk, SOCK_KEEPOPEN);
+	if (sock_flag(ssk, SOCK_KEEPOPEN) != keepalive) {
+		tcp_set_keepalive(ssk, keepalive);
+		sock_valbool_flag(ssk, SOCK_KEEPOPEN, keepalive);
+	}
+
+	if (msk->nodelay && !(tp->nonagle & TCP_NAGLE_OFF)) {
+		tp->nonagle |= TCP_NAGLE_OFF | TCP_NAGLE_PUSH;
+		tcp_push_pending_frames(ssk);
+	} else if (!msk->nodelay) {
+		tp->nonagle &= ~TCP_NAGLE_OFF;
+	}
+
+	tp->notsent_lowat = msk->notsent_lowat;
+
+	/* the name has been validated, and the required capabilities
+	 * checked, when the option was set on the msk
+	 */
+	if (msk->ca_name[0] &&
+	    strcmp(inet_csk(ssk)->icsk_ca_ops->name, msk->ca_name))
+		tcp_set_congestion_control(ssk, msk->ca_name, false, true,
+					   true);
+}
+
+/* replay the msk-level socket options on @ssk, if it is not up to date.
+ * Must be called in process context, with the msk socket lock held.
+ */
+void mptcp_sockopt_sync(struct mptcp_sock *msk, struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+
+	if (subflow->setsockopt_seq == msk->setsockopt_seq)
+		return;
+
+	lock_sock(ssk);
+	__mptcp_sockopt_sync(msk, ssk);
+	subflow->setsockopt_seq = msk->setsockopt_seq;
+	release_sock(ssk);
+}
+
+static void mptcp_sockopt_sync_all(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	msk->setsockopt_seq++;
+
+	__mptcp_flush_join_list(msk);
+	mptcp_for_each_subflow(msk, subflow)
+		mptcp_sockopt_sync(msk, mptcp_subflow_tcp_sock(subflow));
 }
 
-static void mptcp_destroy(struct sock *sk)
+/* options stored on the msk by sock_setsockopt() and then propagated */
+static int mptcp_setsockopt_sol_socket_sync(struct mptcp_sock *msk,
+					    int optname, char __user *optval,
+					    unsigned int optlen)
 {
-	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct sock *sk = (struct sock *)msk;
+	int ret;
 
-	mptcp_token_destroy(msk);
-	if (msk->cached_ext)
-		__skb_ext_put(msk->cached_ext);
+	ret = sock_setsockopt(sk->sk_socket, SOL_SOCKET, optname, optval,
+			      optlen);
+	if (ret)
+		return ret;
 
-	sk_sockets_allocated_dec(sk);
+	lock_sock(sk);
+	mptcp_sockopt_sync_all(msk);
+	release_sock(sk);
+	return 0;
 }
 
 static int mptcp_setsockopt_sol_socket(struct mptcp_sock *msk, int optname,
@@ -1661,9 +3385,40 @@ static int mptcp_setsockopt_sol_socket(struct mptcp_sock *msk, int optname,
 		}
 		release_sock(sk);
 		return ret;
+	case SO_MARK:
+	case SO_PRIORITY:
+	case SO_SNDBUF:
+	case SO_SNDBUFFORCE:
+	case SO_RCVBUF:
+	case SO_RCVBUFFORCE:
+	case SO_KEEPALIVE:
+		return mptcp_setsockopt_sol_socket_sync(msk, optname, optval,
+							optlen);
+	case SO_BUSY_POLL:
+	case SO_LINGER:
+	case SO_RCVLOWAT:
+	case SO_RCVTIMEO_OLD:
+	case SO_RCVTIMEO_NEW:
+	case SO_SNDTIMEO_OLD:
+	case SO_SNDTIMEO_NEW:
+	case SO_ZEROCOPY:
+		/* only meaningful at the msk level */
+		return sock_setsockopt(sk->sk_socket, SOL_SOCKET, optname,
+				       optval, optlen);
+	}
+
+	/* the other options are passed through to the one remaining
+	 * subflow after TCP fallback, as for the other levels
+	 */
+	lock_sock(sk);
+	ssock = msk->subflow;
+	if (!ssock || ssock->sk != __mptcp_tcp_fallback(msk)) {
+		release_sock(sk);
+		return -EOPNOTSUPP;
 	}
+	release_sock(sk);
 
-	return sock_setsockopt(sk->sk_socket, SOL_SOCKET, optname, optval, optlen);
+	return sock_setsockopt(ssock, SOL_SOCKET, optname, optval, optlen);
 }
 
 static int mptcp_setsockopt_v6(struct mptcp_sock *msk, int optname,
@@ -1693,6 +3448,136 @@ static int mptcp_setsockopt_v6(struct mptcp_sock *msk, int optname,
 	return ret;
 }
 
+static int mptcp_setsockopt_sol_tcp_congestion(struct mptcp_sock *msk,
+						char __user *optval,
+						unsigned int optlen)
+{
+	struct mptcp_subflow_context *subflow;
+	struct sock *sk = (struct sock *)msk;
+	char name[TCP_CA_NAME_MAX];
+	bool cap_net_admin;
+	int ret = 0;
+
+	if (optlen < 1)
+		return -EINVAL;
+
+	ret = strncpy_from_user(name, optval,
+				min_t(long, TCP_CA_NAME_MAX - 1, optlen));
+	if (ret < 0)
+		return -EFAULT;
+	name[ret] = 0;
+	ret = 0;
+
+	cap_net_admin = ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN);
+
+	lock_sock(sk);
+	__mptcp_flush_join_list(msk);
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		int err;
+
+		lock_sock(ssk);
+		err = tcp_set_congestion_control(ssk, name, true, true,
+						 cap_net_admin);
+		release_sock(ssk);
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
+	if (!ret) {
+		strcpy(msk->ca_name, name);
+		mptcp_sockopt_sync_all(msk);
+	}
+	release_sock(sk);
+	return ret;
+}
+
+static int mptcp_setsockopt_sol_tcp(struct mptcp_sock *msk, int optname,
+				    char __user *optval, unsigned int optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	int val;
+
+	if (optname == TCP_CONGESTION)
+		return mptcp_setsockopt_sol_tcp_congestion(msk, optval, optlen);
+
+	if (optlen < sizeof(int))
+		return -EINVAL;
+
+	if (get_user(val, (int __user *)optval))
+		return -EFAULT;
+
+	lock_sock(sk);
+	switch (optname) {
+	case TCP_NODELAY:
+		msk->nodelay = !!val;
+		break;
+	case TCP_NOTSENT_LOWAT:
+		msk->notsent_lowat = val;
+		break;
+	}
+	mptcp_sockopt_sync_all(msk);
+	release_sock(sk);
+	return 0;
+}
+
+/* Fast Open only affects the handshake of the first subflow: the
+ * listener, or the initial active subflow
+ */
+static int mptcp_setsockopt_first_sf(struct mptcp_sock *msk, int level,
+				     int optname, char __user *optval,
+				     unsigned int optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct socket *ssock;
+	int ret;
+
+	lock_sock(sk);
+	ssock = __mptcp_nmpc_socket(msk);
+	if (!ssock) {
+		release_sock(sk);
+		return -EINVAL;
+	}
+
+	ret = tcp_setsockopt(ssock->sk, level, optname, optval, optlen);
+	release_sock(sk);
+	return ret;
+}
+
+static int mptcp_setsockopt_sol_mptcp(struct mptcp_sock *msk, int optname,
+				      char __user *optval, unsigned int optlen)
+{
+	const struct mptcp_sched_ops *sched;
+	struct sock *sk = (struct sock *)msk;
+	char name[MPTCP_SCHED_NAME_MAX];
+	int len;
+
+	switch (optname) {
+	case MPTCP_SCHEDULER:
+		if (optlen < 1)
+			return -EINVAL;
+
+		len = min_t(unsigned int, sizeof(name) - 1, optlen);
+		if (strncpy_from_user(name, optval, len) < 0)
+			return -EFAULT;
+		name[len] = 0;
+
+		sched = mptcp_sched_find(name);
+		if (!sched)
+			return -ENOENT;
+
+		lock_sock(sk);
+		if (sched != msk->sched)
+			mptcp_sched_set(msk, sched);
+		else
+			mptcp_sched_put(sched);
+		release_sock(sk);
+		return 0;
+	}
+
+	return -ENOPROTOOPT;
+}
+
 static int mptcp_setsockopt(struct sock *sk, int level, int optname,
 			    char __user *optval, unsigned int optlen)
 {
@@ -1704,11 +3589,28 @@ static int mptcp_setsockopt(struct sock *sk, int level, int optname,
 	if (level == SOL_SOCKET)
 		return mptcp_setsockopt_sol_socket(msk, optname, optval, optlen);
 
-	/* @@ the meaning of setsockopt() when the socket is connected and
-	 * there are multiple subflows is not yet defined. It is up to the
-	 * MPTCP-level socket to configure the subflows until the subflow
-	 * is in TCP fallback, when TCP socket options are passed through
-	 * to the one remaining subflow.
+	if (level == SOL_MPTCP)
+		return mptcp_setsockopt_sol_mptcp(msk, optname, optval, optlen);
+
+	if (level == SOL_TCP) {
+		switch (optname) {
+		case TCP_NODELAY:
+		case TCP_CONGESTION:
+		case TCP_NOTSENT_LOWAT:
+			return mptcp_setsockopt_sol_tcp(msk, optname, optval,
+							optlen);
+		case TCP_FASTOPEN:
+		case TCP_FASTOPEN_CONNECT:
+		case TCP_FASTOPEN_KEY:
+		case TCP_FASTOPEN_NO_COOKIE:
+			return mptcp_setsockopt_first_sf(msk, level, optname,
+							 optval, optlen);
+		}
+	}
+
+	/* Options not tracked at the MPTCP level have no defined meaning
+	 * when there are multiple subflows. They are passed through to the
+	 * one remaining subflow after TCP fallback.
 	 */
 	lock_sock(sk);
 	ssk = __mptcp_tcp_fallback(msk);
@@ -1722,6 +3624,241 @@ static int mptcp_setsockopt(struct sock *sk, int level, int optname,
 	return -EOPNOTSUPP;
 }
 
+static int mptcp_put_int_option(int val, char __user *optval,
+				int __user *optlen)
+{
+	int len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	len = min_t(unsigned int, len, sizeof(int));
+	if (put_user(len, optlen) || copy_to_user(optval, &val, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int mptcp_getsockopt_sol_tcp(struct mptcp_sock *msk, int optname,
+				    char __user *optval, int __user *optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	char name[TCP_CA_NAME_MAX];
+	int len;
+
+	switch (optname) {
+	case TCP_NODELAY:
+		return mptcp_put_int_option(READ_ONCE(msk->nodelay), optval,
+					    optlen);
+	case TCP_NOTSENT_LOWAT:
+		return mptcp_put_int_option(READ_ONCE(msk->notsent_lowat),
+					    optval, optlen);
+	case TCP_CONGESTION:
+		if (get_user(len, optlen))
+			return -EFAULT;
+		if (len < 0)
+			return -EINVAL;
+
+		/* report what the subflows run, if not overridden */
+		lock_sock(sk);
+		if (msk->ca_name[0])
+			strncpy(name, msk->ca_name, sizeof(name));
+		else if (msk->first)
+			strncpy(name, inet_csk(msk->first)->icsk_ca_ops->name,
+				sizeof(name));
+		else
+			name[0] = 0;
+		release_sock(sk);
+
+		len = min_t(unsigned int, len, TCP_CA_NAME_MAX);
+		if (put_user(len, optlen) || copy_to_user(optval, name, len))
+			return -EFAULT;
+		return 0;
+#ifdef CONFIG_MMU
+	case TCP_ZEROCOPY_RECEIVE:
+		return mptcp_getsockopt_zerocopy_rcv(msk, optval, optlen);
+#endif
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static void mptcp_get_sub_addrs(const struct sock *ssk,
+				struct mptcp_subflow_addrs *a)
+{
+	const struct inet_sock *inet = inet_sk(ssk);
+
+	memset(a, 0, sizeof(*a));
+
+	if (ssk->sk_family == AF_INET) {
+		a->sin_local.sin_family = AF_INET;
+		a->sin_local.sin_port = inet->inet_sport;
+		a->sin_local.sin_addr.s_addr = inet->inet_rcv_saddr;
+		if (!a->sin_local.sin_addr.s_addr)
+			a->sin_local.sin_addr.s_addr = inet->inet_saddr;
+
+		a->sin_remote.sin_family = AF_INET;
+		a->sin_remote.sin_port = inet->inet_dport;
+		a->sin_remote.sin_addr.s_addr = inet->inet_daddr;
+#if IS_ENABLED(CONFIG_MPTCP_IPV6)
+	} else if (ssk->sk_family == AF_INET6) {
+		const struct ipv6_pinfo *np = inet6_sk(ssk);
+
+		a->sin6_local.sin6_family = AF_INET6;
+		a->sin6_local.sin6_port = inet->inet_sport;
+		if (ipv6_addr_any(&ssk->sk_v6_rcv_saddr))
+			a->sin6_local.sin6_addr = np->saddr;
+		else
+			a->sin6_local.sin6_addr = ssk->sk_v6_rcv_saddr;
+
+		a->sin6_remote.sin6_family = AF_INET6;
+		a->sin6_remote.sin6_port = inet->inet_dport;
+		a->sin6_remote.sin6_addr = ssk->sk_v6_daddr;
+#endif
+	}
+}
+
+static int mptcp_getsockopt_info(struct mptcp_sock *msk, char __user *optval,
+				 int __user *optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_info m_info;
+	int len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	len = min_t(unsigned int, len, sizeof(struct mptcp_info));
+
+	lock_sock(sk);
+	mptcp_diag_fill_info(msk, &m_info);
+	release_sock(sk);
+
+	if (put_user(len, optlen) || copy_to_user(optval, &m_info, len))
+		return -EFAULT;
+	return 0;
+}
+
+/* one call returning the MPTCP-level state plus tcp_info and addresses
+ * of each subflow, see struct mptcp_full_info
+ */
+static int mptcp_getsockopt_full_info(struct mptcp_sock *msk,
+				      char __user *optval,
+				      int __user *optlen)
+{
+	unsigned int sfcount = 0, sfinfo_len, tcpinfo_len;
+	char __user *sfinfo_ptr, *tcpinfo_ptr;
+	struct mptcp_subflow_context *subflow;
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_full_info mfi;
+	int len, ret = 0;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+
+	/* the mptcp_info tail can be truncated, the header can not */
+	if (len < (int)offsetof(struct mptcp_full_info, mptcp_info))
+		return -EINVAL;
+
+	len = min_t(unsigned int, len, sizeof(mfi));
+	memset(&mfi, 0, sizeof(mfi));
+	if (copy_from_user(&mfi, optval, len))
+		return -EFAULT;
+
+	if (mfi.size_tcpinfo_kernel || mfi.size_sfinfo_kernel ||
+	    mfi.num_subflows)
+		return -EINVAL;
+
+	sfinfo_len = min_t(unsigned int, mfi.size_sfinfo_user,
+			   sizeof(struct mptcp_subflow_info));
+	tcpinfo_len = min_t(unsigned int, mfi.size_tcpinfo_user,
+			    sizeof(struct tcp_info));
+	sfinfo_ptr = u64_to_user_ptr(mfi.subflow_info);
+	tcpinfo_ptr = u64_to_user_ptr(mfi.tcp_info);
+
+	lock_sock(sk);
+	__mptcp_flush_join_list(msk);
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		struct mptcp_subflow_info sfinfo;
+		struct tcp_info tcp_info;
+
+		if (sfcount++ >= mfi.size_arrays_user)
+			continue;
+
+		if (tcpinfo_len) {
+			tcp_get_info(ssk, &tcp_info);
+			if (copy_to_user(tcpinfo_ptr, &tcp_info, tcpinfo_len)) {
+				ret = -EFAULT;
+				break;
+			}
+			tcpinfo_ptr += mfi.size_tcpinfo_user;
+		}
+
+		if (sfinfo_len) {
+			memset(&sfinfo, 0, sizeof(sfinfo));
+			sfinfo.flags = mptcp_diag_subflow_flags(subflow);
+			sfinfo.local_id = subflow->local_id;
+			sfinfo.remote_id = subflow->remote_id;
+			mptcp_get_sub_addrs(ssk, &sfinfo.addrs);
+			if (copy_to_user(sfinfo_ptr, &sfinfo, sfinfo_len)) {
+				ret = -EFAULT;
+				break;
+			}
+			sfinfo_ptr += mfi.size_sfinfo_user;
+		}
+	}
+	mptcp_diag_fill_info(msk, &mfi.mptcp_info);
+	release_sock(sk);
+
+	if (ret)
+		return ret;
+
+	mfi.num_subflows = sfcount;
+	mfi.size_tcpinfo_kernel = sizeof(struct tcp_info);
+	mfi.size_sfinfo_kernel = sizeof(struct mptcp_subflow_info);
+
+	if (put_user(len, optlen) || copy_to_user(optval, &mfi, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int mptcp_getsockopt_sol_mptcp(struct mptcp_sock *msk, int optname,
+				      char __user *optval, int __user *optlen)
+{
+	struct sock *sk = (struct sock *)msk;
+	char name[MPTCP_SCHED_NAME_MAX];
+	int len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+
+	switch (optname) {
+	case MPTCP_SCHEDULER:
+		if (len < 0)
+			return -EINVAL;
+
+		len = min_t(unsigned int, len, MPTCP_SCHED_NAME_MAX);
+
+		lock_sock(sk);
+		strncpy(name, msk->sched->name, sizeof(name));
+		release_sock(sk);
+
+		if (put_user(len, optlen) || copy_to_user(optval, name, len))
+			return -EFAULT;
+		return 0;
+	case MPTCP_INFO:
+		return mptcp_getsockopt_info(msk, optval, optlen);
+	case MPTCP_FULL_INFO:
+		return mptcp_getsockopt_full_info(msk, optval, optlen);
+	}
+
+	return -ENOPROTOOPT;
+}
+
 static int mptcp_getsockopt(struct sock *sk, int level, int optname,
 			    char __user *optval, int __user *option)
 {
@@ -1730,12 +3867,21 @@ static int mptcp_getsockopt(struct sock *sk, int level, int optname,
 
 	pr_debug("msk=%p", msk);
 
-	/* @@ the meaning of setsockopt() when the socket is connected and
-	 * there are multiple subflows is not yet defined. It is up to the
-	 * MPTCP-level socket to configure the subflows until the subflow
-	 * is in TCP fallback, when socket options are passed through
-	 * to the one remaining subflow.
-	 */
+	if (level == SOL_MPTCP)
+		return mptcp_getsockopt_sol_mptcp(msk, optname, optval, option);
+
+	if (level == SOL_TCP) {
+		switch (optname) {
+		case TCP_NODELAY:
+		case TCP_CONGESTION:
+		case TCP_NOTSENT_LOWAT:
+		case TCP_ZEROCOPY_RECEIVE:
+			return mptcp_getsockopt_sol_tcp(msk, optname, optval,
+							option);
+		}
+	}
+
+	/* see mptcp_setsockopt() */
 	lock_sock(sk);
 	ssk = __mptcp_tcp_fallback(msk);
 	release_sock(sk);
@@ -1768,8 +3914,14 @@ static void mptcp_release_cb(struct sock *sk)
 		struct mptcp_sock *msk = mptcp_sk(sk);
 		struct sock *ssk;
 
+		if (__mptcp_splice_handoff(msk)) {
+			set_bit(MPTCP_DATA_READY, &msk->flags);
+			sk->sk_data_ready(sk);
+		}
+
 		ssk = mptcp_subflow_recv_lookup(msk);
-		if (!ssk || !schedule_work(&msk->work))
+		if ((!ssk && !mptcp_pending_data_fin(sk, NULL)) ||
+		    !schedule_work(&msk->work))
 			__sock_put(sk);
 	}
 
@@ -1829,12 +3981,14 @@ void mptcp_finish_connect(struct sock *ssk)
 	 */
 	WRITE_ONCE(msk->remote_key, subflow->remote_key);
 	WRITE_ONCE(msk->local_key, subflow->local_key);
-	WRITE_ONCE(msk->write_seq, subflow->idsn + 1);
+	mptcp_crypto_msk_keys_init(msk);
+	WRITE_ONCE(msk->write_seq, subflow->idsn + 1 + subflow->syn_data_len);
 	WRITE_ONCE(msk->ack_seq, ack_seq);
 	WRITE_ONCE(msk->can_ack, 1);
 	atomic64_set(&msk->snd_una, msk->write_seq);
+	subflow->syn_data_len = 0;
 
-	mptcp_pm_new_connection(msk, 0);
+	mptcp_pm_new_connection(msk, ssk, 0);
 
 	mptcp_rcv_space_init(msk, ssk);
 }
@@ -1863,7 +4017,7 @@ bool mptcp_finish_join(struct sock *sk)
 		return false;
 
 	if (!msk->pm.server_side)
-		return true;
+		goto out;
 
 	if (!mptcp_pm_allow_new_subflow(msk))
 		return false;
@@ -1888,14 +4042,34 @@ bool mptcp_finish_join(struct sock *sk)
 	if (parent_sock && !sk->sk_socket)
 		mptcp_sock_graft(sk, parent_sock);
 	subflow->map_seq = msk->ack_seq;
+
+	/* let the worker replay any msk-level socket option on the new subflow */
+	if (READ_ONCE(msk->setsockopt_seq) && schedule_work(&msk->work))
+		sock_hold(parent);
+
+out:
+	mptcp_event(MPTCP_EVENT_SUB_ESTABLISHED, msk, sk, GFP_ATOMIC);
 	return true;
 }
 
+static u32 mptcp_notsent_lowat(const struct sock *sk)
+{
+	return READ_ONCE(mptcp_sk(sk)->notsent_lowat) ?:
+	       sock_net(sk)->ipv4.sysctl_tcp_notsent_lowat;
+}
+
+/* see tcp_stream_memory_free(), the limit applies to the data not yet
+ * transmitted by any subflow
+ */
 static bool mptcp_memory_free(const struct sock *sk, int wake)
 {
-	struct mptcp_sock *msk = mptcp_sk(sk);
+	const struct mptcp_sock *msk = mptcp_sk(sk);
+	u32 notsent = atomic_read(&msk->wmem_notsent);
+
+	if (wake && !test_bit(MPTCP_SEND_SPACE, &msk->flags))
+		return false;
 
-	return wake ? test_bit(MPTCP_SEND_SPACE, &msk->flags) : true;
+	return (notsent << wake) < mptcp_notsent_lowat(sk);
 }
 
 static struct proto mptcp_prot = {
@@ -1910,6 +4084,7 @@ static struct proto mptcp_prot = {
 	.shutdown	= tcp_shutdown,
 	.destroy	= mptcp_destroy,
 	.sendmsg	= mptcp_sendmsg,
+	.sendpage	= mptcp_sendpage,
 	.recvmsg	= mptcp_recvmsg,
 	.release_cb	= mptcp_release_cb,
 	.hash		= mptcp_hash,
@@ -1948,22 +4123,27 @@ static int mptcp_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	return err;
 }
 
-static void mptcp_subflow_early_fallback(struct mptcp_sock *msk,
-					 struct mptcp_subflow_context *subflow)
-{
-	subflow->request_mptcp = 0;
-	__mptcp_do_fallback(msk);
-}
 
 static int mptcp_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 				int addr_len, int flags)
 {
 	struct mptcp_sock *msk = mptcp_sk(sock->sk);
-	struct mptcp_subflow_context *subflow;
 	struct socket *ssock;
 	int err;
 
+	if (addr_len < sizeof(uaddr->sa_family))
+		return -EINVAL;
+
 	lock_sock(sock->sk);
+	/* resetting the subflows would leave the msk without a usable
+	 * initial subflow, unlike a disconnected TCP socket: refuse. An
+	 * abortive close is available via SO_LINGER with zero timeout.
+	 */
+	if (uaddr->sa_family == AF_UNSPEC) {
+		err = -EOPNOTSUPP;
+		goto unlock;
+	}
+
 	if (sock->state != SS_UNCONNECTED && msk->subflow) {
 		/* pending connection or invalid state, let existing subflow
 		 * cope with that
@@ -1978,18 +4158,7 @@ static int mptcp_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 		goto unlock;
 	}
 
-	mptcp_token_destroy(msk);
-	inet_sk_state_store(sock->sk, TCP_SYN_SENT);
-	subflow = mptcp_subflow_ctx(ssock->sk);
-#ifdef CONFIG_TCP_MD5SIG
-	/* no MPTCP if MD5SIG is enabled on this socket or we may run out of
-	 * TCP option space.
-	 */
-	if (rcu_access_pointer(tcp_sk(ssock->sk)->md5sig_info))
-		mptcp_subflow_early_fallback(msk, subflow);
-#endif
-	if (subflow->request_mptcp && mptcp_token_new_connect(ssock->sk))
-		mptcp_subflow_early_fallback(msk, subflow);
+	mptcp_connect_init(msk, ssock);
 
 do_connect:
 	err = ssock->ops->connect(ssock, uaddr, addr_len, flags);
@@ -2072,6 +4241,9 @@ static int mptcp_stream_accept(struct socket *sock, struct socket *newsock,
 
 			if (!ssk->sk_socket)
 				mptcp_sock_graft(ssk, newsock);
+
+			/* options inherited from the listener */
+			mptcp_sockopt_sync(msk, ssk);
 		}
 	}
 
@@ -2108,12 +4280,25 @@ static __poll_t mptcp_poll(struct file *file, struct socket *sock,
 
 	if (state != TCP_SYN_SENT && state != TCP_SYN_RECV) {
 		mask |= mptcp_check_readable(msk);
-		if (sk_stream_is_writeable(sk) &&
-		    test_bit(MPTCP_SEND_SPACE, &msk->flags))
+		if (sk_stream_is_writeable(sk)) {
 			mask |= EPOLLOUT | EPOLLWRNORM;
+		} else {
+			mptcp_set_nospace(sk);
+
+			/* Race breaker, see tcp_poll() */
+			smp_mb__after_atomic();
+			if (sk_stream_is_writeable(sk))
+				mask |= EPOLLOUT | EPOLLWRNORM;
+		}
 	}
 	if (sk->sk_shutdown & RCV_SHUTDOWN)
 		mask |= EPOLLIN | EPOLLRDNORM | EPOLLRDHUP;
+	if (sk->sk_shutdown == SHUTDOWN_MASK || state == TCP_CLOSE)
+		mask |= EPOLLHUP;
+
+	/* MSG_ZEROCOPY completions are reported on the error queue */
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
+		mask |= EPOLLERR;
 
 	return mask;
 }
@@ -2122,21 +4307,14 @@ static int mptcp_shutdown(struct socket *sock, int how)
 {
 	struct mptcp_sock *msk = mptcp_sk(sock->sk);
 	struct mptcp_subflow_context *subflow;
-	int ret = 0;
 
 	pr_debug("sk=%p, how=%d", msk, how);
 
-	lock_sock(sock->sk);
-	if (how == SHUT_WR || how == SHUT_RDWR)
-		inet_sk_state_store(sock->sk, TCP_FIN_WAIT1);
-
 	how++;
+	if ((how & ~SHUTDOWN_MASK) || !how)
+		return -EINVAL;
 
-	if ((how & ~SHUTDOWN_MASK) || !how) {
-		ret = -EINVAL;
-		goto out_unlock;
-	}
-
+	lock_sock(sock->sk);
 	if (sock->state == SS_CONNECTING) {
 		if ((1 << sock->sk->sk_state) &
 		    (TCPF_SYN_SENT | TCPF_SYN_RECV | TCPF_CLOSE))
@@ -2145,20 +4323,26 @@ static int mptcp_shutdown(struct socket *sock, int how)
 			sock->state = SS_CONNECTED;
 	}
 
+	sock->sk->sk_shutdown |= how;
+	if ((how & SEND_SHUTDOWN) &&
+	    ((1 << sock->sk->sk_state) &
+	     (TCPF_ESTABLISHED | TCPF_SYN_SENT | TCPF_SYN_RECV |
+	      TCPF_CLOSE_WAIT)) &&
+	    mptcp_close_state(sock->sk) && !__mptcp_check_fallback(msk))
+		__mptcp_wr_shutdown(sock->sk);
+
 	__mptcp_flush_join_list(msk);
 	mptcp_for_each_subflow(msk, subflow) {
 		struct sock *tcp_sk = mptcp_subflow_tcp_sock(subflow);
 
-		mptcp_subflow_shutdown(tcp_sk, how, 1, msk->write_seq);
+		mptcp_subflow_shutdown(sock->sk, tcp_sk, how);
 	}
 
 	/* Wake up anyone sleeping in poll. */
 	sock->sk->sk_state_change(sock->sk);
-
-out_unlock:
 	release_sock(sock->sk);
 
-	return ret;
+	return 0;
 }
 
 static const struct proto_ops mptcp_stream_ops = {
@@ -2179,8 +4363,10 @@ static const struct proto_ops mptcp_stream_ops = {
 	.getsockopt	   = sock_common_getsockopt,
 	.sendmsg	   = inet_sendmsg,
 	.recvmsg	   = inet_recvmsg,
-	.mmap		   = sock_no_mmap,
+	.mmap		   = tcp_mmap,
 	.sendpage	   = inet_sendpage,
+	.splice_read	   = mptcp_splice_read,
+	.read_sock	   = mptcp_read_sock,
 #ifdef CONFIG_COMPAT
 	.compat_setsockopt = compat_sock_common_setsockopt,
 	.compat_getsockopt = compat_sock_common_getsockopt,
@@ -2210,7 +4396,9 @@ void __init mptcp_proto_init(void)
 
 	mptcp_subflow_init();
 	mptcp_pm_init();
+	mptcp_sched_init();
 	mptcp_token_init();
+	mptcp_join_cookie_init();
 
 	if (proto_register(&mptcp_prot, MPTCP_USE_SLAB) != 0)
 		panic("Failed to register MPTCP proto.\n");
@@ -2239,8 +4427,10 @@ static const struct proto_ops mptcp_v6_stream_ops = {
 	.getsockopt	   = sock_common_getsockopt,
 	.sendmsg	   = inet6_sendmsg,
 	.recvmsg	   = inet6_recvmsg,
-	.mmap		   = sock_no_mmap,
+	.mmap		   = tcp_mmap,
 	.sendpage	   = inet_sendpage,
+	.splice_read	   = mptcp_splice_read,
+	.read_sock	   = mptcp_read_sock,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl	   = inet6_compat_ioctl,
 	.compat_setsockopt = compat_sock_common_setsockopt,
@@ -8,8 +8,10 @@
 #define __MPTCP_PROTOCOL_H
 
 #include <linux/random.h>
+#include <crypto/sha.h>
 #include <net/tcp.h>
 #include <net/inet_connection_sock.h>
+#include <uapi/linux/mptcp.h>
 
 #define MPTCP_SUPPORTED_VERSION	1
 
@@ -23,6 +25,9 @@
 #define OPTION_MPTCP_ADD_ADDR	BIT(6)
 #define OPTION_MPTCP_ADD_ADDR6	BIT(7)
 #define OPTION_MPTCP_RM_ADDR	BIT(8)
+#define OPTION_MPTCP_PRIO	BIT(9)
+#define OPTION_MPTCP_FASTCLOSE	BIT(10)
+#define OPTION_MPTCP_RST	BIT(11)
 
 /* MPTCP option subtypes */
 #define MPTCPOPT_MP_CAPABLE	0
@@ -33,6 +38,7 @@
 #define MPTCPOPT_MP_PRIO	5
 #define MPTCPOPT_MP_FAIL	6
 #define MPTCPOPT_MP_FASTCLOSE	7
+#define MPTCPOPT_RST		8
 
 /* MPTCP suboption lengths */
 #define TCPOLEN_MPTCP_MPC_SYN		4
@@ -57,13 +63,31 @@
 #define TCPOLEN_MPTCP_ADD_ADDR6_BASE	20
 #define TCPOLEN_MPTCP_ADD_ADDR6_BASE_PORT	22
 #define TCPOLEN_MPTCP_PORT_LEN		2
+#define TCPOLEN_MPTCP_PORT_ALIGN	2
 #define TCPOLEN_MPTCP_RM_ADDR_BASE	4
+#define TCPOLEN_MPTCP_PRIO		3
+#define TCPOLEN_MPTCP_PRIO_ALIGN	4
+#define TCPOLEN_MPTCP_FASTCLOSE		12
+#define TCPOLEN_MPTCP_RST		4
 
 /* MPTCP MP_JOIN flags */
 #define MPTCPOPT_BACKUP		BIT(0)
 #define MPTCPOPT_HMAC_LEN	20
 #define MPTCPOPT_THMAC_LEN	8
 
+/* MPTCP MP_PRIO flags */
+#define MPTCP_PRIO_BKUP		BIT(0)
+
+/* MPTCP MP_RST flags and reason codes */
+#define MPTCP_RST_TRANSIENT	BIT(0)
+#define MPTCP_RST_EUNSPEC	0
+#define MPTCP_RST_EMPTCP	1
+#define MPTCP_RST_ERESOURCE	2
+#define MPTCP_RST_EPROHIBIT	3
+#define MPTCP_RST_EWQ2BIG	4
+#define MPTCP_RST_EBADPERF	5
+#define MPTCP_RST_EMIDDLEBOX	6
+
 /* MPTCP MP_CAPABLE flags */
 #define MPTCP_VERSION_MASK	(0x0F)
 #define MPTCP_CAP_CHECKSUM_REQD	BIT(7)
@@ -90,6 +114,7 @@
 #define MPTCP_WORK_RTX		2
 #define MPTCP_WORK_EOF		3
 #define MPTCP_FALLBACK_DONE	4
+#define MPTCP_WORK_FASTCLOSE	5
 
 struct mptcp_options_received {
 	u64	sndr_key;
@@ -103,9 +128,14 @@ struct mptcp_options_received {
 		dss : 1,
 		add_addr : 1,
 		rm_addr : 1,
+		mp_prio : 1,
 		family : 4,
 		echo : 1,
-		backup : 1;
+		backup : 1,
+		fastclose : 1,
+		reset : 1;
+	u8	reset_reason : 4,
+		reset_transient : 1;
 	u32	token;
 	u32	nonce;
 	u64	thmac;
@@ -150,21 +180,40 @@ struct mptcp_addr_info {
 
 enum mptcp_pm_status {
 	MPTCP_PM_ADD_ADDR_RECEIVED,
+	MPTCP_PM_ADD_ADDR_SEND_ACK,
+	MPTCP_PM_RM_ADDR_RECEIVED,
 	MPTCP_PM_ESTABLISHED,
 	MPTCP_PM_SUBFLOW_ESTABLISHED,
 };
 
+#define MPTCP_PM_MAX_ADDR_ID	U8_MAX
+
+/* pending suboptions, see mptcp_pm_data.addr_signal */
+#define MPTCP_ADD_ADDR_SIGNAL	BIT(0)
+#define MPTCP_ADD_ADDR_ECHO	BIT(1)
+#define MPTCP_RM_ADDR_SIGNAL	BIT(2)
+
+enum mptcp_pm_type {
+	MPTCP_PM_TYPE_KERNEL = 0,
+	MPTCP_PM_TYPE_USERSPACE,
+
+	__MPTCP_PM_TYPE_NR,
+	__MPTCP_PM_TYPE_MAX = __MPTCP_PM_TYPE_NR - 1,
+};
+
 struct mptcp_pm_data {
 	struct mptcp_addr_info local;
 	struct mptcp_addr_info remote;
 
 	spinlock_t	lock;		/*protects the whole PM data */
+	struct list_head anno_list;	/* announced addresses, awaiting echo */
 
-	bool		addr_signal;
+	u8		addr_signal;
 	bool		server_side;
 	bool		work_pending;
 	bool		accept_addr;
 	bool		accept_subflow;
+	bool		ndiffports;	/* ndiffports endpoints can be reused */
 	u8		add_addr_signaled;
 	u8		add_addr_accepted;
 	u8		local_addr_used;
@@ -174,6 +223,8 @@ struct mptcp_pm_data {
 	u8		local_addr_max;
 	u8		subflows_max;
 	u8		status;
+	u8		rm_id;		/* RM_ADDR to be signaled */
+	DECLARE_BITMAP(rm_ids_rcv, MPTCP_PM_MAX_ADDR_ID + 1);
 };
 
 struct mptcp_data_frag {
@@ -182,7 +233,40 @@ struct mptcp_data_frag {
 	int data_len;
 	int offset;
 	int overhead;
+	bool zc;		/* page is referenced, not carved from page_frag */
 	struct page *page;
+	struct ubuf_info *uarg;	/* MSG_ZEROCOPY completion, if any */
+	struct sock *ssk;	/* last subflow carrying the data, referenced */
+};
+
+#define MPTCP_SCHED_NAME_MAX	16
+#define MPTCP_SCHED_PRIV_SIZE	2
+
+/* the core transmits new data on all the non-backup subflows */
+#define MPTCP_SCHED_FLAG_REDUNDANT	BIT(0)
+
+struct mptcp_sock;
+
+struct mptcp_sched_ops {
+	/* return the subflow for the next chunk of data, or NULL if none
+	 * can accept it right now. Called with the msk socket lock held.
+	 */
+	struct sock *(*get_subflow)(struct mptcp_sock *msk);
+	void (*init)(struct mptcp_sock *msk);
+	void (*release)(struct mptcp_sock *msk);
+
+	u32		flags;
+	char		name[MPTCP_SCHED_NAME_MAX];
+	struct module	*owner;
+	struct list_head list;
+};
+
+#define SHA256_DIGEST_WORDS (SHA256_DIGEST_SIZE / 4)
+
+/* SHA-256 state after the HMAC inner and outer key pads */
+struct mptcp_hmac_key {
+	u32	istate[SHA256_DIGEST_WORDS];
+	u32	ostate[SHA256_DIGEST_WORDS];
 };
 
 /* MPTCP connection sock */
@@ -191,22 +275,43 @@ struct mptcp_sock {
 	struct inet_connection_sock sk;
 	u64		local_key;
 	u64		remote_key;
+	struct mptcp_hmac_key local_hmac;	/* keyed by local || remote */
+	struct mptcp_hmac_key remote_hmac;	/* keyed by remote || local */
 	u64		write_seq;
 	u64		ack_seq;
+	u64		rcv_data_fin_seq;
 	atomic64_t	snd_una;
 	unsigned long	timer_ival;
 	u32		token;
 	unsigned long	flags;
 	bool		can_ack;
+	bool		snd_data_fin_enable;
+	bool		rcv_data_fin;
 	spinlock_t	join_list_lock;
 	struct work_struct work;
 	struct list_head conn_list;
 	struct list_head rtx_queue;
 	struct list_head join_list;
+	struct rb_root	out_of_order_queue;
+	struct sk_buff	*ooo_last_skb;
+	struct sk_buff	*rx_handoff;	/* skbs detached by the subflows,
+					 * linked via skb->next, newest first
+					 */
 	struct skb_ext	*cached_ext;	/* for the next sendmsg */
 	struct socket	*subflow; /* outgoing connect/listener/!mp_capable */
 	struct sock	*first;
+	const struct sock *listener;	/* accepted the connection, deref'd
+					 * only as a live reuseport member
+					 */
 	struct mptcp_pm_data	pm;
+	const struct mptcp_sched_ops *sched;
+	u64		sched_priv[MPTCP_SCHED_PRIV_SIZE];
+	u32		setsockopt_seq;	/* bumped on each propagated option */
+	u32		notsent_lowat;
+	atomic_t	wmem_sndbuf;	/* sum of the subflows sk_sndbuf */
+	atomic_t	wmem_notsent;	/* queued on the subflows, not sent yet */
+	bool		nodelay;
+	char		ca_name[TCP_CA_NAME_MAX];
 	struct {
 		u32	space;	/* bytes copied in last measurement window */
 		u32	copied; /* bytes copied in this measurement window */
@@ -223,6 +328,11 @@ static inline struct mptcp_sock *mptcp_sk(const struct sock *sk)
 	return (struct mptcp_sock *)sk;
 }
 
+static inline void *mptcp_sched_priv(const struct mptcp_sock *msk)
+{
+	return (void *)msk->sched_priv;
+}
+
 static inline struct mptcp_data_frag *mptcp_rtx_tail(const struct sock *sk)
 {
 	struct mptcp_sock *msk = mptcp_sk(sk);
@@ -277,6 +387,11 @@ struct mptcp_subflow_context {
 	u32	map_subflow_seq;
 	u32	ssn_offset;
 	u32	map_data_len;
+	u32	penalty_stamp;	/* tcp_jiffies32 at the last cwnd penalty */
+	u32	setsockopt_seq;	/* msk options replayed up to this seq */
+	u32	syn_data_len;	/* Fast Open SYN data, not mapped yet */
+	int	cached_sndbuf;	/* accounted in msk->wmem_sndbuf */
+	u32	cached_notsent;	/* accounted in msk->wmem_notsent */
 	u32	request_mptcp : 1,  /* send MP_CAPABLE */
 		request_join : 1,   /* send MP_JOIN */
 		request_bkup : 1,
@@ -290,10 +405,11 @@ struct mptcp_subflow_context {
 		backup : 1,
 		data_avail : 1,
 		rx_eof : 1,
-		data_fin_tx_enable : 1,
 		use_64bit_ack : 1, /* Set when we received a 64-bit DSN */
-		can_ack : 1;	    /* only after processing the remote a key */
-	u64	data_fin_tx_seq;
+		can_ack : 1,	    /* only after processing the remote a key */
+		send_mp_prio : 1,   /* MP_PRIO pending on the next ack */
+		send_fastclose : 1, /* add MP_FASTCLOSE to the outgoing RST */
+		join_only : 1;	    /* listener accepting MP_JOIN SYNs only */
 	u32	remote_nonce;
 	u64	thmac;
 	u32	local_nonce;
@@ -327,6 +443,13 @@ mptcp_subflow_tcp_sock(const struct mptcp_subflow_context *subflow)
 	return subflow->tcp_sock;
 }
 
+/* either end may ask for the subflow to be used as backup only */
+static inline bool
+mptcp_subflow_is_backup(const struct mptcp_subflow_context *subflow)
+{
+	return subflow->backup || subflow->request_bkup;
+}
+
 static inline u64
 mptcp_subflow_get_map_offset(const struct mptcp_subflow_context *subflow)
 {
@@ -342,16 +465,42 @@ mptcp_subflow_get_mapped_dsn(const struct mptcp_subflow_context *subflow)
 }
 
 int mptcp_is_enabled(struct net *net);
+const struct mptcp_sched_ops *mptcp_get_sched(struct net *net);
+int mptcp_get_pm_type(struct net *net);
+unsigned int mptcp_get_add_addr_timeout(struct net *net);
 void mptcp_subflow_fully_established(struct mptcp_subflow_context *subflow,
 				     struct mptcp_options_received *mp_opt);
 bool mptcp_subflow_data_available(struct sock *sk);
 void __init mptcp_subflow_init(void);
 
+#ifdef CONFIG_SYN_COOKIES
+void mptcp_join_cookie_save(const struct mptcp_subflow_request_sock *subflow_req,
+			    struct sk_buff *skb);
+bool mptcp_join_cookie_init_state(struct mptcp_subflow_request_sock *subflow_req,
+				  struct sk_buff *skb);
+void __init mptcp_join_cookie_init(void);
+#else
+static inline void
+mptcp_join_cookie_save(const struct mptcp_subflow_request_sock *subflow_req,
+		       struct sk_buff *skb) {}
+static inline bool
+mptcp_join_cookie_init_state(struct mptcp_subflow_request_sock *subflow_req,
+			     struct sk_buff *skb)
+{
+	return false;
+}
+
+static inline void mptcp_join_cookie_init(void) {}
+#endif
+
 /* called with sk socket lock held */
+void mptcp_info2sockaddr(const struct mptcp_addr_info *info,
+			 struct sockaddr_storage *addr);
 int __mptcp_subflow_connect(struct sock *sk, int ifindex,
 			    const struct mptcp_addr_info *loc,
-			    const struct mptcp_addr_info *remote);
+			    const struct mptcp_addr_info *remote, u8 flags);
 int mptcp_subflow_create_socket(struct sock *sk, struct socket **new_sock);
+void mptcp_subflow_update_wmem(struct sock *sk, struct sock *ssk);
 
 static inline void mptcp_subflow_tcp_fallback(struct sock *sk,
 					      struct mptcp_subflow_context *ctx)
@@ -380,6 +529,14 @@ void mptcp_data_ready(struct sock *sk, struct sock *ssk);
 bool mptcp_finish_join(struct sock *sk);
 void mptcp_data_acked(struct sock *sk);
 void mptcp_subflow_eof(struct sock *sk);
+void mptcp_sockopt_sync(struct mptcp_sock *msk, struct sock *ssk);
+void __mptcp_flush_join_list(struct mptcp_sock *msk);
+void __mptcp_close_ssk(struct sock *sk, struct sock *ssk,
+		       struct mptcp_subflow_context *subflow, long timeout);
+void mptcp_fastclose_received(struct mptcp_sock *msk);
+void mptcp_schedule_work(struct sock *sk);
+bool mptcp_update_rcv_data_fin(struct mptcp_sock *msk, u64 data_fin_seq,
+			       bool use_64bit);
 
 void __init mptcp_token_init(void);
 static inline void mptcp_token_init_request(struct request_sock *req)
@@ -388,14 +545,17 @@ static inline void mptcp_token_init_request(struct request_sock *req)
 }
 
 int mptcp_token_new_request(struct request_sock *req);
+int mptcp_token_new_cookie_request(struct request_sock *req);
+bool mptcp_token_exists(const struct net *net, u32 token);
 void mptcp_token_destroy_request(struct request_sock *req);
 int mptcp_token_new_connect(struct sock *sk);
 void mptcp_token_accept(struct mptcp_subflow_request_sock *r,
 			struct mptcp_sock *msk);
-struct mptcp_sock *mptcp_token_get_sock(u32 token);
+struct mptcp_sock *mptcp_token_get_sock(struct net *net, u32 token);
 struct mptcp_sock *mptcp_token_iter_next(const struct net *net, long *s_slot,
 					 long *s_num);
 void mptcp_token_destroy(struct mptcp_sock *msk);
+unsigned int mptcp_token_hash_size(void);
 
 void mptcp_crypto_key_sha(u64 key, u32 *token, u64 *idsn);
 static inline void mptcp_crypto_key_gen_sha(u64 *key, u32 *token, u64 *idsn)
@@ -411,11 +571,39 @@ static inline void mptcp_crypto_key_gen_sha(u64 *key, u32 *token, u64 *idsn)
 }
 
 void mptcp_crypto_hmac_sha(u64 key1, u64 key2, u8 *msg, int len, void *hmac);
+void mptcp_crypto_hmac_prepare(u64 key1, u64 key2, struct mptcp_hmac_key *hkey);
+void mptcp_crypto_hmac_sha_prepared(const struct mptcp_hmac_key *hkey,
+				    const u8 *msg, int len, void *hmac);
+
+/* must be called before the keys are used by concurrent joins, i.e. before
+ * setting can_ack or publishing the msk
+ */
+static inline void mptcp_crypto_msk_keys_init(struct mptcp_sock *msk)
+{
+	mptcp_crypto_hmac_prepare(msk->local_key, msk->remote_key,
+				  &msk->local_hmac);
+	mptcp_crypto_hmac_prepare(msk->remote_key, msk->local_key,
+				  &msk->remote_hmac);
+}
+
+void __init mptcp_sched_init(void);
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+const struct mptcp_sched_ops *mptcp_sched_find(const char *name);
+void mptcp_sched_put(const struct mptcp_sched_ops *sched);
+const struct mptcp_sched_ops *mptcp_sched_default_ops(void);
+void mptcp_sched_get_available(char *buf, size_t maxlen);
+void mptcp_sched_data_init(struct mptcp_sock *msk);
+void mptcp_sched_set(struct mptcp_sock *msk,
+		     const struct mptcp_sched_ops *sched);
+void mptcp_sched_release(struct mptcp_sock *msk);
 
 void __init mptcp_pm_init(void);
 void mptcp_pm_data_init(struct mptcp_sock *msk);
-void mptcp_pm_new_connection(struct mptcp_sock *msk, int server_side);
-void mptcp_pm_fully_established(struct mptcp_sock *msk);
+void mptcp_pm_new_connection(struct mptcp_sock *msk, const struct sock *ssk,
+			     int server_side);
+void mptcp_pm_fully_established(struct mptcp_sock *msk,
+				const struct sock *ssk);
 bool mptcp_pm_allow_new_subflow(struct mptcp_sock *msk);
 void mptcp_pm_connection_closed(struct mptcp_sock *msk);
 void mptcp_pm_subflow_established(struct mptcp_sock *msk,
@@ -423,26 +611,53 @@ void mptcp_pm_subflow_established(struct mptcp_sock *msk,
 void mptcp_pm_subflow_closed(struct mptcp_sock *msk, u8 id);
 void mptcp_pm_add_addr_received(struct mptcp_sock *msk,
 				const struct mptcp_addr_info *addr);
+void mptcp_pm_rm_addr_received(struct mptcp_sock *msk, u8 rm_id);
+void mptcp_pm_mp_prio_received(struct sock *ssk, u8 bkup);
+
+void mptcp_pm_add_addr_echoed(struct mptcp_sock *msk,
+			      const struct mptcp_addr_info *addr);
+void mptcp_pm_add_addr_send_ack(struct mptcp_sock *msk);
 
 int mptcp_pm_announce_addr(struct mptcp_sock *msk,
-			   const struct mptcp_addr_info *addr);
+			   const struct mptcp_addr_info *addr,
+			   bool echo);
 int mptcp_pm_remove_addr(struct mptcp_sock *msk, u8 local_id);
 int mptcp_pm_remove_subflow(struct mptcp_sock *msk, u8 remote_id);
 
 static inline bool mptcp_pm_should_signal(struct mptcp_sock *msk)
 {
-	return READ_ONCE(msk->pm.addr_signal);
+	return READ_ONCE(msk->pm.addr_signal) &
+	       (MPTCP_ADD_ADDR_SIGNAL | MPTCP_ADD_ADDR_ECHO);
 }
 
-static inline unsigned int mptcp_add_addr_len(int family)
+static inline bool mptcp_pm_should_rm_signal(struct mptcp_sock *msk)
 {
+	return READ_ONCE(msk->pm.addr_signal) & MPTCP_RM_ADDR_SIGNAL;
+}
+
+static inline unsigned int mptcp_add_addr_len(int family, bool echo,
+					      bool port)
+{
+	unsigned int len;
+
 	if (family == AF_INET)
-		return TCPOLEN_MPTCP_ADD_ADDR;
-	return TCPOLEN_MPTCP_ADD_ADDR6;
+		len = echo ? TCPOLEN_MPTCP_ADD_ADDR_BASE :
+			     TCPOLEN_MPTCP_ADD_ADDR;
+	else
+		len = echo ? TCPOLEN_MPTCP_ADD_ADDR6_BASE :
+			     TCPOLEN_MPTCP_ADD_ADDR6;
+
+	/* the port is followed by two bytes of NOP padding */
+	if (port)
+		len += TCPOLEN_MPTCP_PORT_LEN + TCPOLEN_MPTCP_PORT_ALIGN;
+	return len;
 }
 
 bool mptcp_pm_addr_signal(struct mptcp_sock *msk, unsigned int remaining,
-			  struct mptcp_addr_info *saddr);
+			  struct mptcp_addr_info *saddr, bool *echo,
+			  bool consume);
+bool mptcp_pm_rm_addr_signal(struct mptcp_sock *msk, unsigned int remaining,
+			     u8 *rm_id, bool consume);
 int mptcp_pm_get_local_id(struct mptcp_sock *msk, struct sock_common *skc);
 
 void __init mptcp_pm_nl_init(void);
@@ -450,8 +665,19 @@ void mptcp_pm_nl_data_init(struct mptcp_sock *msk);
 void mptcp_pm_nl_fully_established(struct mptcp_sock *msk);
 void mptcp_pm_nl_subflow_established(struct mptcp_sock *msk);
 void mptcp_pm_nl_add_addr_received(struct mptcp_sock *msk);
+void mptcp_pm_nl_addr_send_ack(struct mptcp_sock *msk);
+void mptcp_pm_nl_rm_addr_received(struct mptcp_sock *msk);
+void mptcp_pm_del_add_timer(struct mptcp_sock *msk,
+			    const struct mptcp_addr_info *addr);
+void mptcp_pm_free_anno_list(struct mptcp_sock *msk, bool stop_timers);
 int mptcp_pm_nl_get_local_id(struct mptcp_sock *msk, struct sock_common *skc);
 
+void mptcp_event(enum mptcp_event_type type, const struct mptcp_sock *msk,
+		 const struct sock *ssk, gfp_t gfp);
+void mptcp_event_addr_announced(const struct mptcp_sock *msk,
+				const struct mptcp_addr_info *info);
+void mptcp_event_addr_removed(const struct mptcp_sock *msk, u8 id);
+
 static inline struct mptcp_ext *mptcp_get_ext(struct sk_buff *skb)
 {
 	return (struct mptcp_ext *)skb_ext_find(skb, SKB_EXT_MPTCP);
@@ -465,6 +691,8 @@ static inline bool before64(__u64 seq1, __u64 seq2)
 #define after64(seq2, seq1)	before64(seq1, seq2)
 
 void mptcp_diag_subflow_init(struct tcp_ulp_ops *ops);
+u32 mptcp_diag_subflow_flags(const struct mptcp_subflow_context *sf);
+void mptcp_diag_fill_info(struct mptcp_sock *msk, struct mptcp_info *info);
 
 static inline bool __mptcp_check_fallback(struct mptcp_sock *msk)
 {
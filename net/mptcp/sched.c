@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Packet scheduler framework and in-kernel schedulers.
+ */
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+static struct mptcp_sched_ops *__mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+/* the returned scheduler holds a reference on its module, to be released
+ * with mptcp_sched_put()
+ */
+const struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = __mptcp_sched_find(name);
+	if (sched && !try_module_get(sched->owner))
+		sched = NULL;
+	rcu_read_unlock();
+
+	return sched;
+}
+
+void mptcp_sched_put(const struct mptcp_sched_ops *sched)
+{
+	module_put(sched->owner);
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_subflow)
+		return -EINVAL;
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (__mptcp_sched_find(sched->name)) {
+		pr_notice("%s already registered\n", sched->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_debug("%s registered", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+/* the module owning the scheduler can't be unloaded while any msk or netns
+ * default refers to it: once removed from the list it can't be picked
+ * again, wait for lookups still in flight to complete
+ */
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+void mptcp_sched_get_available(char *buf, size_t maxlen)
+{
+	struct mptcp_sched_ops *sched;
+	size_t offs = 0;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		offs += snprintf(buf + offs, maxlen - offs, "%s%s",
+				 offs == 0 ? "" : " ", sched->name);
+		if (WARN_ON_ONCE(offs >= maxlen))
+			break;
+	}
+	rcu_read_unlock();
+}
+
+/* called with the msk socket lock held, or before the msk is visible; the
+ * msk takes over the caller's reference on the scheduler
+ */
+void mptcp_sched_set(struct mptcp_sock *msk,
+		     const struct mptcp_sched_ops *sched)
+{
+	mptcp_sched_release(msk);
+
+	memset(msk->sched_priv, 0, sizeof(msk->sched_priv));
+	msk->sched = sched;
+	if (sched->init)
+		sched->init(msk);
+}
+
+void mptcp_sched_data_init(struct mptcp_sock *msk)
+{
+	const struct mptcp_sched_ops *sched = msk->sched;
+
+	/* accepted sockets inherit the listener's scheduler, the listener
+	 * still holds a reference on it
+	 */
+	if (sched)
+		__module_get(sched->owner);
+	else
+		sched = mptcp_get_sched(sock_net((struct sock *)msk));
+
+	msk->sched = NULL;
+	mptcp_sched_set(msk, sched);
+}
+
+void mptcp_sched_release(struct mptcp_sock *msk)
+{
+	const struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	if (sched->release)
+		sched->release(msk);
+	mptcp_sched_put(sched);
+	msk->sched = NULL;
+}
+
+static bool mptcp_subflow_cwnd_avail(const struct sock *ssk)
+{
+	const struct tcp_sock *tp = tcp_sk(ssk);
+
+	return tcp_packets_in_flight(tp) < tp->snd_cwnd;
+}
+
+/* Pick the non-backup subflow with the lowest srtt that still has room in
+ * its congestion window. If all of them are cwnd limited, still prefer the
+ * lowest srtt one with send buffer space, so that data is queued at TCP
+ * level instead of blocking the writer. Backup subflows are used only when
+ * no other subflow exists.
+ */
+static struct sock *mptcp_sched_default_get_subflow(struct mptcp_sock *msk)
+{
+	u32 best_rtt = U32_MAX, limited_rtt = U32_MAX;
+	struct sock *best = NULL, *limited = NULL;
+	struct mptcp_subflow_context *subflow;
+	struct sock *backup = NULL;
+	bool active = false;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		u32 srtt;
+
+		if (mptcp_subflow_is_backup(subflow)) {
+			if (!backup && sk_stream_memory_free(ssk))
+				backup = ssk;
+			continue;
+		}
+
+		active = true;
+		if (!sk_stream_memory_free(ssk))
+			continue;
+
+		srtt = tcp_sk(ssk)->srtt_us;
+		if (!mptcp_subflow_cwnd_avail(ssk)) {
+			if (srtt < limited_rtt) {
+				limited_rtt = srtt;
+				limited = ssk;
+			}
+			continue;
+		}
+
+		if (srtt < best_rtt) {
+			best_rtt = srtt;
+			best = ssk;
+		}
+	}
+
+	if (best)
+		return best;
+	if (limited)
+		return limited;
+
+	return active ? NULL : backup;
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.name		= "default",
+};
+
+struct mptcp_sched_rr {
+	struct sock *last;	/* only compared against, never dereferenced */
+};
+
+/* Cycle over the non-backup subflows with cwnd space, starting after the
+ * one picked by the previous invocation.
+ */
+static struct sock *mptcp_sched_rr_get_subflow(struct mptcp_sock *msk)
+{
+	struct sock *first = NULL, *next = NULL, *limited = NULL;
+	struct mptcp_sched_rr *rr = mptcp_sched_priv(msk);
+	struct mptcp_subflow_context *subflow;
+	bool active = false, seen_last = false;
+	struct sock *backup = NULL;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		if (mptcp_subflow_is_backup(subflow)) {
+			if (!backup && sk_stream_memory_free(ssk))
+				backup = ssk;
+			continue;
+		}
+
+		active = true;
+		if (sk_stream_memory_free(ssk)) {
+			if (!mptcp_subflow_cwnd_avail(ssk)) {
+				if (!limited)
+					limited = ssk;
+			} else {
+				if (!first)
+					first = ssk;
+				if (seen_last && !next)
+					next = ssk;
+			}
+		}
+
+		if (ssk == rr->last)
+			seen_last = true;
+	}
+
+	if (!next)
+		next = first ? : limited;
+	if (next) {
+		rr->last = next;
+		return next;
+	}
+
+	return active ? NULL : backup;
+}
+
+static struct mptcp_sched_ops mptcp_sched_rr = {
+	.get_subflow	= mptcp_sched_rr_get_subflow,
+	.name		= "roundrobin",
+};
+
+/* New data goes to the same subflow the default scheduler would pick, and
+ * the core transmits a copy on every other non-backup subflow.
+ */
+static struct mptcp_sched_ops mptcp_sched_redundant = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.flags		= MPTCP_SCHED_FLAG_REDUNDANT,
+	.name		= "redundant",
+};
+
+const struct mptcp_sched_ops *mptcp_sched_default_ops(void)
+{
+	return &mptcp_sched_default;
+}
+
+void __init mptcp_sched_init(void)
+{
+	BUILD_BUG_ON(sizeof(struct mptcp_sched_rr) >
+		     sizeof_field(struct mptcp_sock, sched_priv));
+
+	if (mptcp_register_scheduler(&mptcp_sched_default) ||
+	    mptcp_register_scheduler(&mptcp_sched_rr) ||
+	    mptcp_register_scheduler(&mptcp_sched_redundant))
+		panic("Failed to register MPTCP schedulers.\n");
+}
@@ -16,6 +16,7 @@
 #include <net/inet_hashtables.h>
 #include <net/protocol.h>
 #include <net/tcp.h>
+#include <net/sock_reuseport.h>
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
 #include <net/ip6_route.h>
 #endif
@@ -42,15 +43,15 @@ static void subflow_req_destructor(struct request_sock *req)
 	tcp_request_sock_ops.destructor(req);
 }
 
-static void subflow_generate_hmac(u64 key1, u64 key2, u32 nonce1, u32 nonce2,
-				  void *hmac)
+static void subflow_generate_hmac(const struct mptcp_hmac_key *hkey,
+				  u32 nonce1, u32 nonce2, void *hmac)
 {
 	u8 msg[8];
 
 	put_unaligned_be32(nonce1, &msg[0]);
 	put_unaligned_be32(nonce2, &msg[4]);
 
-	mptcp_crypto_hmac_sha(key1, key2, msg, 8, hmac);
+	mptcp_crypto_hmac_sha_prepared(hkey, msg, 8, hmac);
 }
 
 static bool mptcp_can_accept_new_subflow(const struct mptcp_sock *msk)
@@ -68,7 +69,8 @@ static struct mptcp_sock *subflow_token_join_request(struct request_sock *req,
 	struct mptcp_sock *msk;
 	int local_id;
 
-	msk = mptcp_token_get_sock(subflow_req->token);
+	msk = mptcp_token_get_sock(sock_net(req_to_sk(req)),
+				   subflow_req->token);
 	if (!msk) {
 		SUBFLOW_REQ_INC_STATS(req, MPTCP_MIB_JOINNOTOKEN);
 		return NULL;
@@ -83,30 +85,132 @@ static struct mptcp_sock *subflow_token_join_request(struct request_sock *req,
 
 	get_random_bytes(&subflow_req->local_nonce, sizeof(u32));
 
-	subflow_generate_hmac(msk->local_key, msk->remote_key,
-			      subflow_req->local_nonce,
+	subflow_generate_hmac(&msk->local_hmac, subflow_req->local_nonce,
 			      subflow_req->remote_nonce, hmac);
 
 	subflow_req->thmac = get_unaligned_be64(hmac);
 	return msk;
 }
 
-static void subflow_init_req(struct request_sock *req,
-			     const struct sock *sk_listener,
-			     struct sk_buff *skb)
+/**
+ * mptcp_reuseport_select_sock - steer MP_JOIN SYNs within a reuseport group
+ * @sk: a member of the SO_REUSEPORT group matching the SYN
+ * @skb: the incoming packet
+ * @doff: offset of the TCP payload from skb->data
+ *
+ * Select the group member that accepted the MP_CAPABLE subflow of the
+ * connection being joined, so that all the subflows of a connection are
+ * processed by the same listener, and, through RFS, on the CPU running
+ * its reader. A BPF selector attached to the group keeps precedence.
+ *
+ * Only the TCP receive path is steered: there skb->data points to the
+ * TCP header and the whole header, options included, is linear. Other
+ * lookups, e.g. from nf_tproxy or xt_socket, get the default selection.
+ *
+ * Called under RCU by the listener lookup, returns NULL to let the
+ * default selection run.
+ */
+struct sock *mptcp_reuseport_select_sock(struct sock *sk, struct sk_buff *skb,
+					 int doff)
 {
-	struct mptcp_subflow_context *listener = mptcp_subflow_ctx(sk_listener);
-	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
 	struct mptcp_options_received mp_opt;
+	struct sock_reuseport *reuse;
+	const struct tcphdr *th;
+	const struct sock *listener;
+	struct sock *ret = NULL;
+	struct mptcp_sock *msk;
+	u16 socks, i;
 
-	pr_debug("subflow_req=%p, listener=%p", subflow_req, listener);
+	if (!skb || sk->sk_protocol != IPPROTO_TCP || !sk_is_mptcp(sk))
+		return NULL;
+
+	if (skb_transport_offset(skb) || doff < sizeof(struct tcphdr) ||
+	    skb_headlen(skb) < doff)
+		return NULL;
+
+	th = tcp_hdr(skb);
+	if (__tcp_hdrlen(th) != doff || !th->syn || th->ack)
+		return NULL;
+
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (!reuse || rcu_access_pointer(reuse->prog))
+		return NULL;
 
+	/* the lookup runs before tcp_v4_fill_cb()/tcp_v6_fill_cb(): the
+	 * MP_CAPABLE parsing, which depends on TCP_SKB_CB() flags, is not
+	 * reliable yet. Only the MP_JOIN token is consumed here.
+	 */
 	mptcp_get_options(skb, &mp_opt);
+	if (!mp_opt.mp_join)
+		return NULL;
+
+	msk = mptcp_token_get_sock(sock_net(sk), mp_opt.token);
+	if (!msk)
+		return NULL;
+
+	/* the listener is dereferenced only once it matches a live member
+	 * of the group, which RCU keeps around for the whole lookup
+	 */
+	listener = READ_ONCE(msk->listener);
+	socks = READ_ONCE(reuse->num_socks);
+	/* paired with smp_wmb() in reuseport_add_sock() */
+	smp_rmb();
+	for (i = 0; i < socks; i++) {
+		if (reuse->socks[i] == listener &&
+		    listener->sk_state == TCP_LISTEN) {
+			ret = reuse->socks[i];
+			break;
+		}
+	}
+
+	sock_put((struct sock *)msk);
+	return ret;
+}
+
+static void subflow_init_req(struct request_sock *req,
+			     const struct sock *sk_listener)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
 
 	subflow_req->mp_capable = 0;
 	subflow_req->mp_join = 0;
 	subflow_req->msk = NULL;
 	mptcp_token_init_request(req);
+}
+
+/* with syncookies no request socket survives the SYN: pick a key whose
+ * token is not in use, it will be hashed once the third ACK echoes it
+ */
+static void subflow_init_req_cookie_key(struct request_sock *req)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	int retries = 4;
+
+	do {
+		mptcp_crypto_key_gen_sha(&subflow_req->local_key,
+					 &subflow_req->token,
+					 &subflow_req->idsn);
+		if (!mptcp_token_exists(sock_net(req_to_sk(req)),
+					subflow_req->token)) {
+			subflow_req->mp_capable = 1;
+			return;
+		}
+	} while (--retries);
+
+	SUBFLOW_REQ_INC_STATS(req, MPTCP_MIB_TOKENFALLBACKINIT);
+}
+
+static void subflow_check_req(struct request_sock *req,
+			      const struct sock *sk_listener,
+			      struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *listener = mptcp_subflow_ctx(sk_listener);
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	struct mptcp_options_received mp_opt;
+
+	pr_debug("subflow_req=%p, listener=%p", subflow_req, listener);
+
+	mptcp_get_options(skb, &mp_opt);
 
 #ifdef CONFIG_TCP_MD5SIG
 	/* no MPTCP if MD5SIG is enabled on this socket or we may run out of
@@ -128,11 +232,15 @@ static void subflow_init_req(struct request_sock *req,
 	if (mp_opt.mp_capable && listener->request_mptcp) {
 		int err;
 
+		subflow_req->ssn_offset = TCP_SKB_CB(skb)->seq;
+		if (unlikely(tcp_rsk(req)->syncookie)) {
+			subflow_init_req_cookie_key(req);
+			return;
+		}
+
 		err = mptcp_token_new_request(req);
 		if (err == 0)
 			subflow_req->mp_capable = 1;
-
-		subflow_req->ssn_offset = TCP_SKB_CB(skb)->seq;
 	} else if (mp_opt.mp_join && listener->request_mptcp) {
 		subflow_req->ssn_offset = TCP_SKB_CB(skb)->seq;
 		subflow_req->mp_join = 1;
@@ -141,11 +249,69 @@ static void subflow_init_req(struct request_sock *req,
 		subflow_req->token = mp_opt.token;
 		subflow_req->remote_nonce = mp_opt.nonce;
 		subflow_req->msk = subflow_token_join_request(req, skb);
+
+		if (unlikely(tcp_rsk(req)->syncookie) && subflow_req->msk &&
+		    mptcp_can_accept_new_subflow(subflow_req->msk))
+			mptcp_join_cookie_save(subflow_req, skb);
+
 		pr_debug("token=%u, remote_nonce=%u msk=%p", subflow_req->token,
 			 subflow_req->remote_nonce, subflow_req->msk);
 	}
 }
 
+/**
+ * mptcp_subflow_init_cookie_req - rebuild a subflow request from a cookie
+ * @req: the request socket allocated for the third ACK
+ * @sk_listener: the MPTCP-enabled listener subflow
+ * @skb: the third ACK
+ *
+ * Restore the MPTCP state that a SYN answered with a syncookie did not
+ * store: the MP_CAPABLE key echoed by the peer, or the MP_JOIN state
+ * saved in the join cookie table.
+ *
+ * Returns 0 on success, a negative error if the request must be dropped.
+ */
+int mptcp_subflow_init_cookie_req(struct request_sock *req,
+				  const struct sock *sk_listener,
+				  struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *listener = mptcp_subflow_ctx(sk_listener);
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	struct mptcp_options_received mp_opt;
+	int err;
+
+	subflow_init_req(req, sk_listener);
+	mptcp_get_options(skb, &mp_opt);
+
+	if (mp_opt.mp_capable && mp_opt.mp_join)
+		return -EINVAL;
+
+	if (mp_opt.mp_capable && listener->request_mptcp) {
+		if (mp_opt.sndr_key == 0)
+			return -EINVAL;
+
+		subflow_req->local_key = mp_opt.rcvr_key;
+		err = mptcp_token_new_cookie_request(req);
+		if (err)
+			return err;
+
+		subflow_req->mp_capable = 1;
+		subflow_req->ssn_offset = TCP_SKB_CB(skb)->seq - 1;
+	} else if (mp_opt.mp_join && listener->request_mptcp) {
+		if (!mptcp_join_cookie_init_state(subflow_req, skb))
+			return -EINVAL;
+
+		/* the HMAC and the msk status are validated by
+		 * subflow_syn_recv_sock(), as for plain joins
+		 */
+		subflow_req->mp_join = 1;
+		subflow_req->ssn_offset = TCP_SKB_CB(skb)->seq - 1;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mptcp_subflow_init_cookie_req);
+
 static void subflow_v4_init_req(struct request_sock *req,
 				const struct sock *sk_listener,
 				struct sk_buff *skb)
@@ -154,7 +320,8 @@ static void subflow_v4_init_req(struct request_sock *req,
 
 	tcp_request_sock_ipv4_ops.init_req(req, sk_listener, skb);
 
-	subflow_init_req(req, sk_listener, skb);
+	subflow_init_req(req, sk_listener);
+	subflow_check_req(req, sk_listener, skb);
 }
 
 #if IS_ENABLED(CONFIG_MPTCP_IPV6)
@@ -166,7 +333,8 @@ static void subflow_v6_init_req(struct request_sock *req,
 
 	tcp_request_sock_ipv6_ops.init_req(req, sk_listener, skb);
 
-	subflow_init_req(req, sk_listener, skb);
+	subflow_init_req(req, sk_listener);
+	subflow_check_req(req, sk_listener, skb);
 }
 #endif
 
@@ -176,7 +344,7 @@ static bool subflow_thmac_valid(struct mptcp_subflow_context *subflow)
 	u8 hmac[SHA256_DIGEST_SIZE];
 	u64 thmac;
 
-	subflow_generate_hmac(subflow->remote_key, subflow->local_key,
+	subflow_generate_hmac(&mptcp_sk(subflow->conn)->remote_hmac,
 			      subflow->remote_nonce, subflow->local_nonce,
 			      hmac);
 
@@ -206,7 +374,7 @@ static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
 	if (subflow->conn_finished)
 		return;
 
-	subflow->rel_write_seq = 1;
+	subflow->rel_write_seq = 1 + subflow->syn_data_len;
 	subflow->conn_finished = 1;
 	subflow->ssn_offset = TCP_SKB_CB(skb)->seq;
 	pr_debug("subflow=%p synack seq=%x", subflow, subflow->ssn_offset);
@@ -226,6 +394,12 @@ static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
 		subflow->remote_key = mp_opt.sndr_key;
 		pr_debug("subflow=%p, remote_key=%llu", subflow,
 			 subflow->remote_key);
+
+		/* MP_CAPABLE goes on the first packet after the SYN-ACK, or
+		 * on the Fast Open data, if the peer did not accept it with
+		 * the SYN: TCP will send it again.
+		 */
+		subflow->snd_isn = tcp_sk(sk)->snd_una;
 		mptcp_finish_connect(sk);
 	} else if (subflow->request_join) {
 		u8 hmac[SHA256_DIGEST_SIZE];
@@ -235,6 +409,7 @@ static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
 
 		subflow->thmac = mp_opt.thmac;
 		subflow->remote_nonce = mp_opt.nonce;
+		subflow->remote_id = mp_opt.join_id;
 		pr_debug("subflow=%p, thmac=%llu, remote_nonce=%u", subflow,
 			 subflow->thmac, subflow->remote_nonce);
 
@@ -243,7 +418,7 @@ static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
 			goto do_reset;
 		}
 
-		subflow_generate_hmac(subflow->local_key, subflow->remote_key,
+		subflow_generate_hmac(&mptcp_sk(parent)->local_hmac,
 				      subflow->local_nonce,
 				      subflow->remote_nonce,
 				      hmac);
@@ -265,9 +440,25 @@ static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
 	tcp_done(sk);
 }
 
-static struct request_sock_ops subflow_request_sock_ops;
+struct request_sock_ops mptcp_subflow_request_sock_ops;
+EXPORT_SYMBOL_GPL(mptcp_subflow_request_sock_ops);
 static struct tcp_request_sock_ops subflow_request_sock_ipv4_ops;
 
+/* the listeners created by the PM for signaled ports are never accepted
+ * from: refuse any SYN that would land in their accept queue
+ */
+static bool subflow_join_only_refuse(const struct sock *sk,
+				     const struct sk_buff *skb)
+{
+	struct mptcp_options_received mp_opt;
+
+	if (!mptcp_subflow_ctx(sk)->join_only)
+		return false;
+
+	mptcp_get_options(skb, &mp_opt);
+	return !mp_opt.mp_join;
+}
+
 static int subflow_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
@@ -278,7 +469,10 @@ static int subflow_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	if (skb_rtable(skb)->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST))
 		goto drop;
 
-	return tcp_conn_request(&subflow_request_sock_ops,
+	if (subflow_join_only_refuse(sk, skb))
+		return -1; /* send reset */
+
+	return tcp_conn_request(&mptcp_subflow_request_sock_ops,
 				&subflow_request_sock_ipv4_ops,
 				sk, skb);
 drop:
@@ -303,7 +497,10 @@ static int subflow_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 	if (!ipv6_unicast_destination(skb))
 		goto drop;
 
-	return tcp_conn_request(&subflow_request_sock_ops,
+	if (subflow_join_only_refuse(sk, skb))
+		return -1; /* send reset */
+
+	return tcp_conn_request(&mptcp_subflow_request_sock_ops,
 				&subflow_request_sock_ipv6_ops, sk, skb);
 
 drop:
@@ -325,8 +522,7 @@ static bool subflow_hmac_valid(const struct request_sock *req,
 	if (!msk)
 		return false;
 
-	subflow_generate_hmac(msk->remote_key, msk->local_key,
-			      subflow_req->remote_nonce,
+	subflow_generate_hmac(&msk->remote_hmac, subflow_req->remote_nonce,
 			      subflow_req->local_nonce, hmac);
 
 	return !crypto_memneq(hmac, mp_opt->hmac, MPTCPOPT_HMAC_LEN);
@@ -353,6 +549,7 @@ static void mptcp_sock_destruct(struct sock *sk)
 	}
 
 	mptcp_token_destroy(mptcp_sk(sk));
+	mptcp_pm_free_anno_list(mptcp_sk(sk), false);
 	inet_sock_destruct(sk);
 }
 
@@ -397,7 +594,7 @@ void mptcp_subflow_fully_established(struct mptcp_subflow_context *subflow,
 	subflow->can_ack = 1;
 
 	inet_sk_state_store(subflow->conn, TCP_ESTABLISHED);
-	mptcp_pm_new_connection(msk, 1);
+	mptcp_pm_new_connection(msk, mptcp_subflow_tcp_sock(subflow), 1);
 }
 
 static struct sock *subflow_syn_recv_sock(const struct sock *sk,
@@ -448,6 +645,8 @@ static struct sock *subflow_syn_recv_sock(const struct sock *sk,
 		new_msk = mptcp_sk_clone(listener->conn, &mp_opt, req);
 		if (!new_msk)
 			fallback = true;
+		else
+			mptcp_sk(new_msk)->listener = sk;
 	} else if (subflow_req->mp_join) {
 		mptcp_get_options(skb, &mp_opt);
 		if (!mp_opt.mp_join ||
@@ -493,6 +692,12 @@ static struct sock *subflow_syn_recv_sock(const struct sock *sk,
 			 */
 			if (mp_opt.mp_capable)
 				mptcp_subflow_fully_established(ctx, &mp_opt);
+
+			/* Fast Open creates the child on SYN reception, and
+			 * queues the SYN data before the peer key is known
+			 */
+			if (TCP_SKB_CB(skb)->tcp_flags & TCPHDR_SYN)
+				ctx->syn_data_len = skb->len - tcp_hdrlen(skb);
 		} else if (ctx->mp_join) {
 			struct mptcp_sock *owner;
 
@@ -594,6 +799,34 @@ static bool validate_mapping(struct sock *ssk, struct sk_buff *skb)
 	return true;
 }
 
+/* The Fast Open SYN data carries no mapping: it is the first chunk of
+ * the MPTCP stream, as for MP_CAPABLE + data, and can be mapped only
+ * after the MP_CAPABLE third ack provides the peer key.
+ */
+static enum mapping_status subflow_fastopen_map(struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	u64 map_seq;
+
+	if (!subflow->fully_established)
+		return MAPPING_EMPTY;
+
+	mptcp_crypto_key_sha(subflow->remote_key, NULL, &map_seq);
+	subflow->map_seq = map_seq + 1;
+	subflow->map_subflow_seq = 1;
+	subflow->map_data_len = subflow->syn_data_len;
+	subflow->map_valid = 1;
+	subflow->mpc_map = 1;
+	subflow->syn_data_len = 0;
+	pr_debug("fastopen map seq=%llu data_len=%u", subflow->map_seq,
+		 subflow->map_data_len);
+
+	if (!validate_mapping(ssk, skb_peek(&ssk->sk_receive_queue)))
+		return MAPPING_INVALID;
+
+	return MAPPING_OK;
+}
+
 static enum mapping_status get_mapping_status(struct sock *ssk)
 {
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
@@ -611,6 +844,9 @@ static enum mapping_status get_mapping_status(struct sock *ssk)
 
 	mpext = mptcp_get_ext(skb);
 	if (!mpext || !mpext->use_map) {
+		if (!subflow->map_valid && subflow->syn_data_len)
+			return subflow_fastopen_map(ssk);
+
 		if (!subflow->map_valid && !skb->len) {
 			/* the TCP stack deliver 0 len FIN pkt to the receive
 			 * queue, that is the only 0len pkts ever expected here,
@@ -643,8 +879,15 @@ static enum mapping_status get_mapping_status(struct sock *ssk)
 	}
 
 	if (mpext->data_fin == 1) {
+		struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+
 		if (data_len == 1) {
-			pr_debug("DATA_FIN with no payload");
+			pr_debug("DATA_FIN with no payload seq=%llu",
+				 mpext->data_seq);
+			if (mptcp_update_rcv_data_fin(msk, mpext->data_seq,
+						      mpext->dsn64))
+				mptcp_schedule_work(subflow->conn);
+
 			if (subflow->map_valid) {
 				/* A DATA_FIN might arrive in a DSS
 				 * option before the previous mapping
@@ -653,9 +896,24 @@ static enum mapping_status get_mapping_status(struct sock *ssk)
 				 */
 				skb_ext_del(skb, SKB_EXT_MPTCP);
 				return MAPPING_OK;
-			} else {
-				return MAPPING_DATA_FIN;
 			}
+
+			/* nothing to move to the msk, the DATA_FIN will be
+			 * processed by the msk worker
+			 */
+			if (!skb->len)
+				sk_eat_skb(ssk, skb);
+			return MAPPING_DATA_FIN;
+		} else {
+			u64 data_fin_seq = mpext->data_seq + data_len - 1;
+
+			/* a 32 bits data_seq implies a 32 bits DATA_FIN seq */
+			if (!mpext->dsn64)
+				data_fin_seq &= GENMASK_ULL(31, 0);
+			mptcp_update_rcv_data_fin(msk, data_fin_seq,
+						  mpext->dsn64);
+			pr_debug("DATA_FIN with mapping seq=%llu dsn64=%d",
+				 data_fin_seq, mpext->dsn64);
 		}
 
 		/* Adjust for DATA_FIN using 1 byte of sequence space */
@@ -777,6 +1035,7 @@ static bool subflow_check_data_avail(struct sock *ssk)
 				goto fatal;
 			}
 			WRITE_ONCE(msk->remote_key, subflow->remote_key);
+			mptcp_crypto_msk_keys_init(msk);
 			WRITE_ONCE(msk->ack_seq, subflow->map_seq);
 			WRITE_ONCE(msk->can_ack, true);
 		}
@@ -785,22 +1044,16 @@ static bool subflow_check_data_avail(struct sock *ssk)
 		ack_seq = mptcp_subflow_get_mapped_dsn(subflow);
 		pr_debug("msk ack_seq=%llx subflow ack_seq=%llx", old_ack,
 			 ack_seq);
-		if (ack_seq == old_ack)
+		/* in-sequence and future mappings are moved to the msk,
+		 * which keeps the latter in its out of order queue. Old
+		 * values are spurious retransmission, discard them.
+		 */
+		if (!before64(ack_seq, old_ack))
 			break;
 
-		/* only accept in-sequence mapping. Old values are spurious
-		 * retransmission; we can hit "future" values on active backup
-		 * subflow switch, we relay on retransmissions to get
-		 * in-sequence data.
-		 * Cuncurrent subflows support will require subflow data
-		 * reordering
-		 */
 		map_remaining = subflow->map_data_len -
 				mptcp_subflow_get_map_offset(subflow);
-		if (before64(ack_seq, old_ack))
-			delta = min_t(size_t, old_ack - ack_seq, map_remaining);
-		else
-			delta = min_t(size_t, ack_seq - old_ack, map_remaining);
+		delta = min_t(size_t, old_ack - ack_seq, map_remaining);
 
 		/* discard mapped data */
 		pr_debug("discarding %zu bytes, current map len=%d", delta,
@@ -905,6 +1158,7 @@ static void subflow_write_space(struct sock *sk)
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
 	struct sock *parent = subflow->conn;
 
+	mptcp_subflow_update_wmem(parent, sk);
 	sk_stream_write_space(sk);
 	if (sk_stream_is_writeable(sk)) {
 		set_bit(MPTCP_SEND_SPACE, &mptcp_sk(parent)->flags);
@@ -944,8 +1198,8 @@ void mptcpv6_handle_mapped(struct sock *sk, bool mapped)
 }
 #endif
 
-static void mptcp_info2sockaddr(const struct mptcp_addr_info *info,
-				struct sockaddr_storage *addr)
+void mptcp_info2sockaddr(const struct mptcp_addr_info *info,
+			 struct sockaddr_storage *addr)
 {
 	memset(addr, 0, sizeof(*addr));
 	addr->ss_family = info->family;
@@ -967,7 +1221,7 @@ static void mptcp_info2sockaddr(const struct mptcp_addr_info *info,
 
 int __mptcp_subflow_connect(struct sock *sk, int ifindex,
 			    const struct mptcp_addr_info *loc,
-			    const struct mptcp_addr_info *remote)
+			    const struct mptcp_addr_info *remote, u8 flags)
 {
 	struct mptcp_sock *msk = mptcp_sk(sk);
 	struct mptcp_subflow_context *subflow;
@@ -1010,6 +1264,8 @@ int __mptcp_subflow_connect(struct sock *sk, int ifindex,
 	if (loc->family == AF_INET6)
 		addrlen = sizeof(struct sockaddr_in6);
 #endif
+	mptcp_sockopt_sync(msk, ssk);
+
 	ssk->sk_bound_dev_if = ifindex;
 	err = kernel_bind(sf, (struct sockaddr *)&addr, addrlen);
 	if (err)
@@ -1021,7 +1277,7 @@ int __mptcp_subflow_connect(struct sock *sk, int ifindex,
 	subflow->remote_token = remote_token;
 	subflow->local_id = local_id;
 	subflow->request_join = 1;
-	subflow->request_bkup = 1;
+	subflow->request_bkup = !!(flags & MPTCP_PM_ADDR_FLAG_BACKUP);
 	mptcp_info2sockaddr(remote, &addr);
 
 	err = kernel_connect(sf, (struct sockaddr *)&addr, addrlen, O_NONBLOCK);
@@ -1249,6 +1505,7 @@ static void subflow_ulp_clone(const struct request_sock *req,
 		new_ctx->fully_established = 1;
 		new_ctx->backup = subflow_req->backup;
 		new_ctx->local_id = subflow_req->local_id;
+		new_ctx->remote_id = subflow_req->remote_id;
 		new_ctx->token = subflow_req->token;
 		new_ctx->thmac = subflow_req->thmac;
 	}
@@ -1282,8 +1539,8 @@ static int subflow_ops_init(struct request_sock_ops *subflow_ops)
 
 void __init mptcp_subflow_init(void)
 {
-	subflow_request_sock_ops = tcp_request_sock_ops;
-	if (subflow_ops_init(&subflow_request_sock_ops) != 0)
+	mptcp_subflow_request_sock_ops = tcp_request_sock_ops;
+	if (subflow_ops_init(&mptcp_subflow_request_sock_ops) != 0)
 		panic("MPTCP: failed to init subflow request sock ops\n");
 
 	subflow_request_sock_ipv4_ops = tcp_request_sock_ipv4_ops;
@@ -32,9 +32,11 @@
 #include <net/protocol.h>
 #include <net/mptcp.h>
 #include "protocol.h"
+#include "mib.h"
 
 #define TOKEN_MAX_RETRIES	4
 #define TOKEN_MAX_CHAIN_LEN	4
+#define TOKEN_MAX_ENTRIES	(1 << 20)
 
 struct token_bucket {
 	spinlock_t		lock;
@@ -46,6 +48,22 @@ struct token_bucket {
 static struct token_bucket *token_hash __read_mostly;
 static unsigned int token_mask __read_mostly;
 
+static __initdata unsigned long token_entries;
+static int __init set_token_entries(char *str)
+{
+	ssize_t ret;
+
+	if (!str)
+		return 0;
+
+	ret = kstrtoul(str, 0, &token_entries);
+	if (ret)
+		return 0;
+
+	return 1;
+}
+__setup("mptcp_token_entries=", set_token_entries);
+
 static struct token_bucket *token_bucket(u32 token)
 {
 	return &token_hash[token & token_mask];
@@ -83,6 +101,25 @@ static bool __token_bucket_busy(struct token_bucket *t, u32 token)
 	       __token_lookup_req(t, token) || __token_lookup_msk(t, token);
 }
 
+static int __token_insert_request(struct mptcp_subflow_request_sock *req)
+{
+	struct token_bucket *bucket;
+	u32 token;
+
+	token = req->token;
+	bucket = token_bucket(token);
+	spin_lock_bh(&bucket->lock);
+	if (__token_bucket_busy(bucket, token)) {
+		spin_unlock_bh(&bucket->lock);
+		return -EBUSY;
+	}
+
+	hlist_nulls_add_head_rcu(&req->token_node, &bucket->req_chain);
+	bucket->chain_len++;
+	spin_unlock_bh(&bucket->lock);
+	return 0;
+}
+
 /**
  * mptcp_token_new_request - create new key/idsn/token for subflow_request
  * @req: the request socket
@@ -97,9 +134,8 @@ static bool __token_bucket_busy(struct token_bucket *t, u32 token)
 int mptcp_token_new_request(struct request_sock *req)
 {
 	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	struct net *net = sock_net(req_to_sk(req));
 	int retries = TOKEN_MAX_RETRIES;
-	struct token_bucket *bucket;
-	u32 token;
 
 again:
 	mptcp_crypto_key_gen_sha(&subflow_req->local_key,
@@ -109,22 +145,84 @@ int mptcp_token_new_request(struct request_sock *req)
 		 req, subflow_req->local_key, subflow_req->token,
 		 subflow_req->idsn);
 
-	token = subflow_req->token;
-	bucket = token_bucket(token);
-	spin_lock_bh(&bucket->lock);
-	if (__token_bucket_busy(bucket, token)) {
-		spin_unlock_bh(&bucket->lock);
-		if (!--retries)
+	if (__token_insert_request(subflow_req)) {
+		if (!--retries) {
+			MPTCP_INC_STATS(net, MPTCP_MIB_TOKENFALLBACKINIT);
 			return -EBUSY;
+		}
 		goto again;
 	}
 
-	hlist_nulls_add_head_rcu(&subflow_req->token_node, &bucket->req_chain);
-	bucket->chain_len++;
-	spin_unlock_bh(&bucket->lock);
+	MPTCP_INC_STATS(net, MPTCP_MIB_TOKENINUSE);
 	return 0;
 }
 
+/**
+ * mptcp_token_new_cookie_request - hash the token of a syncookie request
+ * @req: the request socket built from the third ACK
+ *
+ * The local key has been sent in clear in the SYN-ACK and is echoed back
+ * by the peer in the third ACK: re-derive the token and idsn from it and
+ * add the request to the token hash, as mptcp_token_new_request() would
+ * have done at SYN time.
+ *
+ * Returns 0 on success, -EBUSY if the token is already in use.
+ */
+int mptcp_token_new_cookie_request(struct request_sock *req)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	int err;
+
+	mptcp_crypto_key_sha(subflow_req->local_key, &subflow_req->token,
+			     &subflow_req->idsn);
+	pr_debug("req=%p local_key=%llu, token=%u, idsn=%llu\n",
+		 req, subflow_req->local_key, subflow_req->token,
+		 subflow_req->idsn);
+
+	err = __token_insert_request(subflow_req);
+	if (!err)
+		MPTCP_INC_STATS(sock_net(req_to_sk(req)),
+				MPTCP_MIB_TOKENINUSE);
+	return err;
+}
+
+/**
+ * mptcp_token_exists - check if a connection with the given token exists
+ * @net: restrict to this namespace
+ * @token: token of the mptcp connection to look for
+ *
+ * Lockless check used when no request socket is allocated, i.e. when the
+ * listener is answering with syncookies. Connections in other namespaces
+ * are not looked at, as in mptcp_token_get_sock(): a token clashing with
+ * one of them, like any other false negative, is caught when it is
+ * eventually hashed by mptcp_token_new_cookie_request().
+ */
+bool mptcp_token_exists(const struct net *net, u32 token)
+{
+	struct hlist_nulls_node *pos;
+	struct token_bucket *bucket;
+	struct sock *sk;
+	bool ret = false;
+
+	rcu_read_lock();
+	bucket = token_bucket(token);
+
+again:
+	sk_nulls_for_each_rcu(sk, pos, &bucket->msk_chain) {
+		if (READ_ONCE(mptcp_sk(sk)->token) == token &&
+		    net_eq(sock_net(sk), net)) {
+			ret = true;
+			goto out;
+		}
+	}
+	if (get_nulls_value(pos) != (token & token_mask))
+		goto again;
+
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
 /**
  * mptcp_token_new_connect - create new key/idsn/token for subflow
  * @sk: the socket that will initiate a connection
@@ -145,6 +243,7 @@ int mptcp_token_new_connect(struct sock *sk)
 {
 	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
 	struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+	struct net *net = sock_net(subflow->conn);
 	int retries = TOKEN_MAX_RETRIES;
 	struct token_bucket *bucket;
 
@@ -159,8 +258,10 @@ int mptcp_token_new_connect(struct sock *sk)
 	spin_lock_bh(&bucket->lock);
 	if (__token_bucket_busy(bucket, subflow->token)) {
 		spin_unlock_bh(&bucket->lock);
-		if (!--retries)
+		if (!--retries) {
+			MPTCP_INC_STATS(net, MPTCP_MIB_TOKENFALLBACKINIT);
 			return -EBUSY;
+		}
 		goto again;
 	}
 
@@ -168,6 +269,7 @@ int mptcp_token_new_connect(struct sock *sk)
 	__sk_nulls_add_node_rcu((struct sock *)msk, &bucket->msk_chain);
 	bucket->chain_len++;
 	spin_unlock_bh(&bucket->lock);
+	MPTCP_INC_STATS(net, MPTCP_MIB_TOKENINUSE);
 	return 0;
 }
 
@@ -198,14 +300,18 @@ void mptcp_token_accept(struct mptcp_subflow_request_sock *req,
 
 /**
  * mptcp_token_get_sock - retrieve mptcp connection sock using its token
+ * @net: restrict to this namespace
  * @token: token of the mptcp connection to retrieve
  *
  * This function returns the mptcp connection structure with the given token.
  * A reference count on the mptcp socket returned is taken.
  *
+ * The lookup is lockless: it only relies on RCU and on the nulls marker
+ * at the end of each chain to detect entries moved to another bucket.
+ *
  * returns NULL if no connection with the given token value exists.
  */
-struct mptcp_sock *mptcp_token_get_sock(u32 token)
+struct mptcp_sock *mptcp_token_get_sock(struct net *net, u32 token)
 {
 	struct hlist_nulls_node *pos;
 	struct token_bucket *bucket;
@@ -218,11 +324,13 @@ struct mptcp_sock *mptcp_token_get_sock(u32 token)
 again:
 	sk_nulls_for_each_rcu(sk, pos, &bucket->msk_chain) {
 		msk = mptcp_sk(sk);
-		if (READ_ONCE(msk->token) != token)
+		if (READ_ONCE(msk->token) != token ||
+		    !net_eq(sock_net(sk), net))
 			continue;
 		if (!refcount_inc_not_zero(&sk->sk_refcnt))
 			goto not_found;
-		if (READ_ONCE(msk->token) != token) {
+		if (READ_ONCE(msk->token) != token ||
+		    !net_eq(sock_net(sk), net)) {
 			sock_put(sk);
 			goto again;
 		}
@@ -320,6 +428,7 @@ void mptcp_token_destroy_request(struct request_sock *req)
 	if (!WARN_ON_ONCE(pos != subflow_req)) {
 		hlist_nulls_del_init_rcu(&pos->token_node);
 		bucket->chain_len--;
+		MPTCP_DEC_STATS(sock_net(req_to_sk(req)), MPTCP_MIB_TOKENINUSE);
 	}
 	spin_unlock_bh(&bucket->lock);
 }
@@ -344,23 +453,34 @@ void mptcp_token_destroy(struct mptcp_sock *msk)
 	if (!WARN_ON_ONCE(pos != msk)) {
 		__sk_nulls_del_node_init_rcu((struct sock *)pos);
 		bucket->chain_len--;
+		MPTCP_DEC_STATS(sock_net((struct sock *)msk),
+				MPTCP_MIB_TOKENINUSE);
 	}
 	spin_unlock_bh(&bucket->lock);
 }
 
+unsigned int mptcp_token_hash_size(void)
+{
+	return token_mask + 1;
+}
+
 void __init mptcp_token_init(void)
 {
 	int i;
 
+	/* the chain length is bounded, so the table must be at least as
+	 * large as the expected number of connections: unless explicitly
+	 * sized at boot time, cap the memory-based estimate to 1M slots.
+	 */
 	token_hash = alloc_large_system_hash("MPTCP token",
 					     sizeof(struct token_bucket),
-					     0,
-					     20,/* one slot per 1MB of memory */
+					     token_entries,
+					     17,/* one slot per 128KB of memory */
 					     HASH_ZERO,
 					     NULL,
 					     &token_mask,
 					     0,
-					     64 * 1024);
+					     token_entries ? 0 : TOKEN_MAX_ENTRIES);
 	for (i = 0; i < token_mask + 1; ++i) {
 		INIT_HLIST_NULLS_HEAD(&token_hash[i].req_chain, i);
 		INIT_HLIST_NULLS_HEAD(&token_hash[i].msk_chain, i);
@@ -374,4 +494,5 @@ EXPORT_SYMBOL_GPL(mptcp_token_new_connect);
 EXPORT_SYMBOL_GPL(mptcp_token_accept);
 EXPORT_SYMBOL_GPL(mptcp_token_destroy_request);
 EXPORT_SYMBOL_GPL(mptcp_token_destroy);
+EXPORT_SYMBOL_GPL(mptcp_token_hash_size);
 #endif
@@ -1,8 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 #include <kunit/test.h>
 
 #include "protocol.h"
 
+static unsigned int bench_entries = 1024;
+module_param(bench_entries, uint, 0444);
+MODULE_PARM_DESC(bench_entries, "number of connections used by the token hash benchmark, 0 to skip it");
+
 static struct mptcp_subflow_request_sock *build_req_sock(struct kunit *test)
 {
 	struct mptcp_subflow_request_sock *req;
@@ -10,6 +16,7 @@ static struct mptcp_subflow_request_sock *build_req_sock(struct kunit *test)
 	req = kunit_kzalloc(test, sizeof(struct mptcp_subflow_request_sock),
 			    GFP_USER);
 	KUNIT_EXPECT_NOT_ERR_OR_NULL(test, req);
+	sock_net_set(req_to_sk((struct request_sock *)req), &init_net);
 	mptcp_token_init_request((struct request_sock *)req);
 	return req;
 }
@@ -22,7 +29,7 @@ static void mptcp_token_test_req_basic(struct kunit *test)
 	KUNIT_ASSERT_EQ(test, 0,
 			mptcp_token_new_request((struct request_sock *)req));
 	KUNIT_EXPECT_NE(test, 0, (int)req->token);
-	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(req->token));
+	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(&init_net, req->token));
 
 	/* cleanup */
 	mptcp_token_destroy_request((struct request_sock *)req);
@@ -55,6 +62,7 @@ static struct mptcp_sock *build_msk(struct kunit *test)
 	msk = kunit_kzalloc(test, sizeof(struct mptcp_sock), GFP_USER);
 	KUNIT_EXPECT_NOT_ERR_OR_NULL(test, msk);
 	refcount_set(&((struct sock *)msk)->sk_refcnt, 1);
+	sock_net_set((struct sock *)msk, &init_net);
 	return msk;
 }
 
@@ -74,11 +82,11 @@ static void mptcp_token_test_msk_basic(struct kunit *test)
 			mptcp_token_new_connect((struct sock *)icsk));
 	KUNIT_EXPECT_NE(test, 0, (int)ctx->token);
 	KUNIT_EXPECT_EQ(test, ctx->token, msk->token);
-	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(ctx->token));
+	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(&init_net, ctx->token));
 	KUNIT_EXPECT_EQ(test, 2, (int)refcount_read(&sk->sk_refcnt));
 
 	mptcp_token_destroy(msk);
-	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(ctx->token));
+	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(&init_net, ctx->token));
 }
 
 static void mptcp_token_test_accept(struct kunit *test)
@@ -90,11 +98,11 @@ static void mptcp_token_test_accept(struct kunit *test)
 			mptcp_token_new_request((struct request_sock *)req));
 	msk->token = req->token;
 	mptcp_token_accept(req, msk);
-	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(msk->token));
+	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(&init_net, msk->token));
 
 	/* this is now a no-op */
 	mptcp_token_destroy_request((struct request_sock *)req);
-	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(msk->token));
+	KUNIT_EXPECT_PTR_EQ(test, msk, mptcp_token_get_sock(&init_net, msk->token));
 
 	/* cleanup */
 	mptcp_token_destroy(msk);
@@ -116,17 +124,101 @@ static void mptcp_token_test_destroyed(struct kunit *test)
 
 	/* simulate race on removal */
 	refcount_set(&sk->sk_refcnt, 0);
-	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(msk->token));
+	KUNIT_EXPECT_PTR_EQ(test, null_msk, mptcp_token_get_sock(&init_net, msk->token));
 
 	/* cleanup */
 	mptcp_token_destroy(msk);
 }
 
+/* insert, look up and remove bench_entries connections, reporting the
+ * per-operation cost; tokens that could not be allocated because their
+ * bucket was full are reported, not treated as failures. The default size
+ * keeps the suite quick, load the module with a larger bench_entries to
+ * measure the hash under pressure.
+ */
+static void mptcp_token_test_bench(struct kunit *test)
+{
+	struct inet_connection_sock *icsk = build_icsk(test);
+	struct mptcp_subflow_context *ctx = build_ctx(test);
+	unsigned int i, n, inserted = 0, found = 0, busy = 0;
+	struct mptcp_sock **msks;
+	u64 start, insert_ns, lookup_ns;
+
+	if (!bench_entries) {
+		kunit_info(test, "bench_entries is 0, skipping\n");
+		return;
+	}
+
+	msks = kvcalloc(bench_entries, sizeof(*msks), GFP_KERNEL);
+	if (!msks) {
+		kunit_info(test, "can't allocate %u entries, skipping\n",
+			   bench_entries);
+		return;
+	}
+
+	for (i = 0; i < bench_entries; i++) {
+		struct mptcp_sock *msk;
+
+		msk = kzalloc(sizeof(*msk),
+			      GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+
+		if (!msk)
+			break;
+
+		refcount_set(&((struct sock *)msk)->sk_refcnt, 1);
+		sock_net_set((struct sock *)msk, &init_net);
+		msks[i] = msk;
+		cond_resched();
+	}
+	n = i;
+
+	rcu_assign_pointer(icsk->icsk_ulp_data, ctx);
+	start = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		ctx->conn = (struct sock *)msks[i];
+		if (mptcp_token_new_connect((struct sock *)icsk))
+			busy++;
+		else
+			inserted++;
+	}
+	insert_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		struct mptcp_sock *msk;
+
+		if (!msks[i]->token)
+			continue;
+
+		msk = mptcp_token_get_sock(&init_net, msks[i]->token);
+		if (msk == msks[i])
+			found++;
+		if (msk)
+			sock_put((struct sock *)msk);
+	}
+	lookup_ns = ktime_get_ns() - start;
+
+	KUNIT_EXPECT_EQ(test, inserted, found);
+	kunit_info(test, "%u buckets, %u entries, %u busy\n",
+		   mptcp_token_hash_size(), inserted, busy);
+	kunit_info(test, "insert %llu ns/op, lookup %llu ns/op\n",
+		   div_u64(insert_ns, max(n, 1U)),
+		   div_u64(lookup_ns, max(found, 1U)));
+
+	for (i = 0; i < n; i++) {
+		mptcp_token_destroy(msks[i]);
+		kfree(msks[i]);
+		cond_resched();
+	}
+	kvfree(msks);
+}
+
 static struct kunit_case mptcp_token_test_cases[] = {
 	KUNIT_CASE(mptcp_token_test_req_basic),
 	KUNIT_CASE(mptcp_token_test_msk_basic),
 	KUNIT_CASE(mptcp_token_test_accept),
 	KUNIT_CASE(mptcp_token_test_destroyed),
+	KUNIT_CASE(mptcp_token_test_bench),
 	{}
 };
 
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,7 +25,9 @@
 #include <netdb.h>
 #include <netinet/in.h>
 
+#include <linux/errqueue.h>
 #include <linux/tcp.h>
+#include "linux/mptcp.h"
 
 extern int optind;
 
@@ -34,6 +37,24 @@ extern int optind;
 #ifndef TCP_ULP
 #define TCP_ULP 31
 #endif
+#ifndef SOL_MPTCP
+#define SOL_MPTCP 284
+#endif
+#ifndef MPTCP_SCHEDULER
+#define MPTCP_SCHEDULER 1
+#endif
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE 35
+#endif
 
 static int  poll_timeout = 10 * 1000;
 static bool listen_mode;
@@ -43,6 +64,8 @@ enum cfg_mode {
 	CFG_MODE_POLL,
 	CFG_MODE_MMAP,
 	CFG_MODE_SENDFILE,
+	CFG_MODE_SPLICE,
+	CFG_MODE_ZEROCOPY,
 };
 
 static enum cfg_mode cfg_mode = CFG_MODE_POLL;
@@ -55,20 +78,28 @@ static int cfg_sndbuf;
 static int cfg_rcvbuf;
 static bool cfg_join;
 static int cfg_wait;
+static const char *cfg_sched;
+static bool cfg_fastopen;
+static bool cfg_fastclose;
+static int cfg_info_subflows;
 
 static void die_usage(void)
 {
 	fprintf(stderr, "Usage: mptcp_connect [-6] [-u] [-s MPTCP|TCP] [-p port] [-m mode]"
-		"[-l] [-w sec] connect_address\n");
+		"[-l] [-w sec] [-P sched] [-o] [-F] [-i num] connect_address\n");
 	fprintf(stderr, "\t-6 use ipv6\n");
 	fprintf(stderr, "\t-t num -- set poll timeout to num\n");
 	fprintf(stderr, "\t-S num -- set SO_SNDBUF to num\n");
 	fprintf(stderr, "\t-R num -- set SO_RCVBUF to num\n");
 	fprintf(stderr, "\t-p num -- use port num\n");
 	fprintf(stderr, "\t-m [MPTCP|TCP] -- use tcp or mptcp sockets\n");
-	fprintf(stderr, "\t-s [mmap|poll] -- use poll (default) or mmap\n");
+	fprintf(stderr, "\t-s [mmap|poll|sendfile|splice|zerocopy] -- use poll (default), mmap, sendfile, splice or zerocopy\n");
 	fprintf(stderr, "\t-u -- check mptcp ulp\n");
 	fprintf(stderr, "\t-w num -- wait num sec before closing the socket\n");
+	fprintf(stderr, "\t-P name -- use the MPTCP packet scheduler name\n");
+	fprintf(stderr, "\t-o -- use TCP Fast Open\n");
+	fprintf(stderr, "\t-F -- send the input then abort the connection (SO_LINGER 0), -l expects the reset\n");
+	fprintf(stderr, "\t-i num -- check MPTCP_INFO and MPTCP_FULL_INFO before closing, expecting num subflows\n");
 	exit(1);
 }
 
@@ -138,6 +169,31 @@ static void set_sndbuf(int fd, unsigned int size)
 	}
 }
 
+static void set_sched(int fd, const char *name)
+{
+	int err;
+
+	if (cfg_sock_proto != IPPROTO_MPTCP)
+		return;
+
+	err = setsockopt(fd, SOL_MPTCP, MPTCP_SCHEDULER, name, strlen(name));
+	if (err) {
+		perror("set MPTCP_SCHEDULER");
+		exit(1);
+	}
+}
+
+static void set_fastopen(int fd, int optname, int val)
+{
+	int err;
+
+	err = setsockopt(fd, IPPROTO_TCP, optname, &val, sizeof(val));
+	if (err) {
+		perror("set TCP_FASTOPEN");
+		exit(1);
+	}
+}
+
 static int sock_listen_mptcp(const char * const listenaddr,
 			     const char * const port)
 {
@@ -180,6 +236,9 @@ static int sock_listen_mptcp(const char * const listenaddr,
 		return sock;
 	}
 
+	if (cfg_fastopen)
+		set_fastopen(sock, TCP_FASTOPEN, 20);
+
 	if (listen(sock, 20)) {
 		perror("listen");
 		close(sock);
@@ -246,6 +305,9 @@ static int sock_connect_mptcp(const char * const remoteaddr,
 			continue;
 		}
 
+		if (cfg_fastopen)
+			set_fastopen(sock, TCP_FASTOPEN_CONNECT, 1);
+
 		if (connect(sock, a->ai_addr, a->ai_addrlen) == 0)
 			break; /* success */
 
@@ -329,6 +391,170 @@ static void set_nonblock(int fd)
 	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+#define INFO_POISON	0x5a
+
+static int info_fail(const char *what, int err)
+{
+	fprintf(stderr, "%s: %s (errno %d)\n", __func__, what, err);
+	return 1;
+}
+
+static bool info_poisoned(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (p[i] != INFO_POISON)
+			return false;
+	return true;
+}
+
+static int get_full_info(int fd, struct mptcp_full_info *mfi, socklen_t *olen)
+{
+	if (getsockopt(fd, SOL_MPTCP, MPTCP_FULL_INFO, mfi, olen) < 0)
+		return errno;
+	return 0;
+}
+
+/* Exercise the MPTCP_INFO and MPTCP_FULL_INFO size negotiation on a
+ * connection expected to have @subflows subflows: the kernel must clamp
+ * oversized lengths, honour truncated ones, reject non-zero kernel-owned
+ * fields and never write past the user-provided array sizes or strides.
+ */
+static int check_mptcp_info(int fd, int subflows)
+{
+	struct tcp_info ti[2][2];
+	struct {
+		struct mptcp_subflow_info sfi;
+		unsigned char tail[16];
+	} sfi[2];
+	unsigned char sfi_small[3][4];
+	unsigned char ti_small[3][8];
+	struct {
+		struct mptcp_info mi;
+		unsigned char tail[16];
+	} mi;
+	struct mptcp_full_info mfi;
+	socklen_t olen;
+	int i, err;
+
+	if (cfg_sock_proto != IPPROTO_MPTCP)
+		return 0;
+
+	/* MPTCP_INFO: oversized, truncated and negative lengths */
+	memset(&mi, INFO_POISON, sizeof(mi));
+	olen = sizeof(mi);
+	if (getsockopt(fd, SOL_MPTCP, MPTCP_INFO, &mi, &olen) < 0)
+		return info_fail("MPTCP_INFO", errno);
+	if (olen != sizeof(mi.mi) || !info_poisoned(mi.tail, sizeof(mi.tail)))
+		return info_fail("MPTCP_INFO not clamped", olen);
+
+	memset(&mi, INFO_POISON, sizeof(mi));
+	olen = 4;
+	if (getsockopt(fd, SOL_MPTCP, MPTCP_INFO, &mi, &olen) < 0)
+		return info_fail("truncated MPTCP_INFO", errno);
+	if (olen != 4 || !info_poisoned((char *)&mi + 4, sizeof(mi) - 4))
+		return info_fail("truncated MPTCP_INFO overflow", olen);
+
+	olen = -1;
+	if (getsockopt(fd, SOL_MPTCP, MPTCP_INFO, &mi, &olen) == 0 ||
+	    errno != EINVAL)
+		return info_fail("negative MPTCP_INFO length", errno);
+
+	/* MPTCP_FULL_INFO: the kernel-owned fields must be zero on input */
+	for (i = 0; i < 3; i++) {
+		memset(&mfi, 0, sizeof(mfi));
+		if (i == 0)
+			mfi.size_tcpinfo_kernel = sizeof(struct tcp_info);
+		else if (i == 1)
+			mfi.size_sfinfo_kernel = sizeof(struct mptcp_subflow_info);
+		else
+			mfi.num_subflows = 1;
+		olen = sizeof(mfi);
+		err = get_full_info(fd, &mfi, &olen);
+		if (err != EINVAL)
+			return info_fail("non-zero kernel field accepted", err);
+	}
+
+	/* too short to hold the negotiation header */
+	memset(&mfi, 0, sizeof(mfi));
+	olen = offsetof(struct mptcp_full_info, mptcp_info) - 1;
+	err = get_full_info(fd, &mfi, &olen);
+	if (err != EINVAL)
+		return info_fail("short MPTCP_FULL_INFO accepted", err);
+
+	/* header only, no arrays: reports the sizes and the subflow count */
+	memset(&mfi, 0, sizeof(mfi));
+	olen = offsetof(struct mptcp_full_info, mptcp_info);
+	err = get_full_info(fd, &mfi, &olen);
+	if (err)
+		return info_fail("header only MPTCP_FULL_INFO", err);
+	if (olen != offsetof(struct mptcp_full_info, mptcp_info))
+		return info_fail("header only MPTCP_FULL_INFO length", olen);
+	if (mfi.size_tcpinfo_kernel != sizeof(struct tcp_info) ||
+	    mfi.size_sfinfo_kernel != sizeof(struct mptcp_subflow_info))
+		return info_fail("bad kernel element sizes", 0);
+	if (mfi.num_subflows != subflows) {
+		fprintf(stderr, "%s: expected %d subflows, got %u\n", __func__,
+			subflows, mfi.num_subflows);
+		return 1;
+	}
+
+	/* oversized length and elements, with room for a single subflow:
+	 * the bytes past the kernel sizes and the second elements must be
+	 * left alone, while num_subflows still reports every subflow
+	 */
+	memset(sfi, INFO_POISON, sizeof(sfi));
+	memset(ti, INFO_POISON, sizeof(ti));
+	memset(&mfi, 0, sizeof(mfi));
+	mfi.size_sfinfo_user = sizeof(sfi[0]);
+	mfi.size_tcpinfo_user = sizeof(ti[0]);
+	mfi.size_arrays_user = 1;
+	mfi.subflow_info = (unsigned long)sfi;
+	mfi.tcp_info = (unsigned long)ti;
+	olen = sizeof(mfi) + 16;
+	err = get_full_info(fd, &mfi, &olen);
+	if (err)
+		return info_fail("oversized MPTCP_FULL_INFO", err);
+	if (olen != sizeof(mfi))
+		return info_fail("MPTCP_FULL_INFO not clamped", olen);
+	if (mfi.num_subflows != subflows)
+		return info_fail("num_subflows mismatch", mfi.num_subflows);
+	if (sfi[0].sfi.addrs.sa_family != pf || ti[0][0].tcpi_state == INFO_POISON)
+		return info_fail("first subflow not filled", 0);
+	if (!info_poisoned(sfi[0].tail, sizeof(sfi[0].tail)) ||
+	    !info_poisoned(&ti[0][1], sizeof(ti[0][1])))
+		return info_fail("write past the kernel element size", 0);
+	if (!info_poisoned(&sfi[1], sizeof(sfi[1])) ||
+	    !info_poisoned(&ti[1], sizeof(ti[1])))
+		return info_fail("write past size_arrays_user", 0);
+
+	/* truncated elements: the stride is the user size, not the kernel's */
+	memset(sfi_small, INFO_POISON, sizeof(sfi_small));
+	memset(ti_small, INFO_POISON, sizeof(ti_small));
+	memset(&mfi, 0, sizeof(mfi));
+	mfi.size_sfinfo_user = sizeof(sfi_small[0]);
+	mfi.size_tcpinfo_user = sizeof(ti_small[0]);
+	mfi.size_arrays_user = 2;
+	mfi.subflow_info = (unsigned long)sfi_small;
+	mfi.tcp_info = (unsigned long)ti_small;
+	olen = sizeof(mfi);
+	err = get_full_info(fd, &mfi, &olen);
+	if (err)
+		return info_fail("truncated MPTCP_FULL_INFO elements", err);
+	for (i = 0; i < 2 && i < subflows; i++) {
+		if (info_poisoned(sfi_small[i], sizeof(sfi_small[i])) ||
+		    ti_small[i][0] == INFO_POISON)
+			return info_fail("truncated element not filled", i);
+	}
+	if (!info_poisoned(sfi_small[2], sizeof(sfi_small[2])) ||
+	    !info_poisoned(ti_small[2], sizeof(ti_small[2])))
+		return info_fail("truncated element overflow", 0);
+
+	return 0;
+}
+
 static int copyfd_io_poll(int infd, int peerfd, int outfd)
 {
 	struct pollfd fds = {
@@ -430,6 +656,9 @@ static int copyfd_io_poll(int infd, int peerfd, int outfd)
 	if (cfg_wait)
 		usleep(cfg_wait);
 
+	if (cfg_info_subflows && check_mptcp_info(peerfd, cfg_info_subflows))
+		return 6;
+
 	close(peerfd);
 	return 0;
 }
@@ -482,6 +711,206 @@ static int do_mmap(int infd, int outfd, unsigned int size)
 	return rem;
 }
 
+/* read the MSG_ZEROCOPY notifications queued so far, return the number of
+ * completed sends or -1 on error
+ */
+static int do_zerocopy_completions(int fd)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	int completed = 0;
+
+	for (;;) {
+		struct msghdr msg = {
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		struct sock_extended_err *serr;
+		struct cmsghdr *cm;
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno == EAGAIN)
+				return completed;
+
+			perror("recvmsg(MSG_ERRQUEUE)");
+			return -1;
+		}
+
+		cm = CMSG_FIRSTHDR(&msg);
+		if (!cm ||
+		    !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+		      (cm->cmsg_level == SOL_IPV6 &&
+		       cm->cmsg_type == IPV6_RECVERR))) {
+			fprintf(stderr, "%s: unexpected cmsg\n", __func__);
+			return -1;
+		}
+
+		serr = (void *)CMSG_DATA(cm);
+		if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+		    serr->ee_errno || serr->ee_data < serr->ee_info) {
+			fprintf(stderr, "%s: bad notification origin %u errno %u range %u-%u\n",
+				__func__, serr->ee_origin, serr->ee_errno,
+				serr->ee_info, serr->ee_data);
+			return -1;
+		}
+
+		completed += serr->ee_data - serr->ee_info + 1;
+	}
+}
+
+/* send the whole file with MSG_ZEROCOPY: the mapping can be released only
+ * after every send has been reported as completed on the error queue
+ */
+static int do_zerocopy_send(int infd, int outfd, unsigned int size)
+{
+	char *inbuf = mmap(NULL, size, PROT_READ, MAP_SHARED, infd, 0);
+	struct pollfd pfd = { .fd = outfd };
+	int sent = 0, completed = 0, one = 1;
+	size_t rem = size, off = 0;
+	int ret;
+
+	if (inbuf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (setsockopt(outfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+		perror("set SO_ZEROCOPY");
+		goto out;
+	}
+
+	while (rem > 0) {
+		size_t len = rem > (1 << 16) ? (1 << 16) : rem;
+		ssize_t bw;
+
+		bw = send(outfd, inbuf + off, len, MSG_ZEROCOPY);
+		if (bw < 0) {
+			if (errno != ENOBUFS) {
+				perror("send");
+				goto out;
+			}
+
+			/* no room left for the notifications, reap some */
+			if (poll(&pfd, 1, poll_timeout) < 0) {
+				perror("poll");
+				goto out;
+			}
+		} else {
+			sent++;
+			off += bw;
+			rem -= bw;
+		}
+
+		ret = do_zerocopy_completions(outfd);
+		if (ret < 0)
+			goto out;
+		completed += ret;
+	}
+
+	while (completed < sent) {
+		/* POLLERR is reported even if not requested */
+		switch (poll(&pfd, 1, poll_timeout)) {
+		case -1:
+			perror("poll");
+			goto out;
+		case 0:
+			fprintf(stderr, "%s: timed out, %d of %d sends completed\n",
+				__func__, completed, sent);
+			goto out;
+		}
+
+		ret = do_zerocopy_completions(outfd);
+		if (ret < 0)
+			goto out;
+		completed += ret;
+	}
+
+	if (completed != sent) {
+		fprintf(stderr, "%s: %d sends, %d completions\n", __func__,
+			sent, completed);
+		goto out;
+	}
+
+	munmap(inbuf, size);
+	return 0;
+
+out:
+	munmap(inbuf, size);
+	return 1;
+}
+
+/* receive with TCP_ZEROCOPY_RECEIVE: the page-aligned data is remapped
+ * from the socket, what can't be mapped is read as hinted by the kernel
+ */
+static int do_zerocopy_recv(int infd, int outfd)
+{
+	const size_t map_size = 1 << 20;
+	char buf[16384];
+	void *addr;
+	int ret = 0;
+
+	addr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, infd, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	for (;;) {
+		struct tcp_zerocopy_receive zc = { 0 };
+		socklen_t zc_len = sizeof(zc);
+		size_t skip;
+		ssize_t r;
+
+		zc.address = (uintptr_t)addr;
+		zc.length = map_size;
+		if (getsockopt(infd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc,
+			       &zc_len)) {
+			/* MPTCP reports EIO when nothing is left after the
+			 * peer's DATA_FIN: let read() return the EOF
+			 */
+			if (errno != EIO) {
+				perror("getsockopt(TCP_ZEROCOPY_RECEIVE)");
+				ret = 1;
+				break;
+			}
+			zc.length = 0;
+			zc.recv_skip_hint = 0;
+		}
+
+		if (zc.length &&
+		    write(outfd, addr, zc.length) != (ssize_t)zc.length) {
+			perror("write");
+			ret = 1;
+			break;
+		}
+
+		skip = zc.recv_skip_hint;
+		if (!skip && zc.length)
+			continue;
+
+		/* copy what can't be mapped, or wait for more data */
+		if (!skip || skip > sizeof(buf))
+			skip = sizeof(buf);
+
+		r = read(infd, buf, skip);
+		if (r < 0) {
+			perror("read");
+			ret = 1;
+			break;
+		}
+		if (r == 0)
+			break;
+
+		if (write(outfd, buf, r) != r) {
+			perror("write");
+			ret = 1;
+			break;
+		}
+	}
+
+	munmap(addr, map_size);
+	return ret;
+}
+
 static int get_infd_size(int fd)
 {
 	struct stat sb;
@@ -525,6 +954,43 @@ static int do_sendfile(int infd, int outfd, unsigned int count)
 	return 0;
 }
 
+static int do_splicefile(int infd, int outfd)
+{
+	ssize_t r;
+	int p[2];
+
+	if (pipe(p)) {
+		perror("pipe");
+		return 1;
+	}
+
+	do {
+		ssize_t rem;
+
+		r = splice(infd, NULL, p[1], NULL, 1 << 16, SPLICE_F_MOVE);
+		if (r < 0) {
+			perror("splice");
+			break;
+		}
+
+		for (rem = r; rem > 0; ) {
+			ssize_t w = splice(p[0], NULL, outfd, NULL, rem,
+					   SPLICE_F_MOVE);
+
+			if (w <= 0) {
+				perror("splice");
+				r = -1;
+				break;
+			}
+			rem -= w;
+		}
+	} while (r > 0);
+
+	close(p[0]);
+	close(p[1]);
+	return (int)r;
+}
+
 static int copyfd_io_mmap(int infd, int peerfd, int outfd,
 			  unsigned int size)
 {
@@ -570,10 +1036,119 @@ static int copyfd_io_sendfile(int infd, int peerfd, int outfd,
 	return err;
 }
 
+static int copyfd_io_splice(int infd, int peerfd, int outfd,
+			    unsigned int size)
+{
+	int err;
+
+	if (listen_mode) {
+		err = do_splicefile(peerfd, outfd);
+		if (err)
+			return err;
+
+		err = do_sendfile(infd, peerfd, size);
+	} else {
+		err = do_sendfile(infd, peerfd, size);
+		if (err)
+			return err;
+		err = do_splicefile(peerfd, outfd);
+	}
+
+	return err;
+}
+
+static int copyfd_io_zerocopy(int infd, int peerfd, int outfd,
+			      unsigned int size)
+{
+	int err;
+
+	if (listen_mode) {
+		err = do_zerocopy_recv(peerfd, outfd);
+		if (err)
+			return err;
+
+		err = do_zerocopy_send(infd, peerfd, size);
+	} else {
+		err = do_zerocopy_send(infd, peerfd, size);
+		if (err)
+			return err;
+
+		shutdown(peerfd, SHUT_WR);
+
+		err = do_zerocopy_recv(peerfd, outfd);
+	}
+
+	return err;
+}
+
+/* the client sends the input, then closes with SO_LINGER and zero
+ * timeout: the MPTCP connection is reset with MP_FASTCLOSE on every
+ * subflow. The server must see the connection reset, not a clean EOF.
+ */
+static int copyfd_io_fastclose(int infd, int peerfd, int outfd)
+{
+	struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+	struct sockaddr addr = { .sa_family = AF_UNSPEC };
+	char buf[8192];
+	ssize_t len;
+
+	if (listen_mode) {
+		for (;;) {
+			len = read(peerfd, buf, sizeof(buf));
+			if (len < 0) {
+				if (errno == ECONNRESET)
+					break;
+
+				perror("read");
+				return 1;
+			}
+			if (len == 0) {
+				fprintf(stderr, "%s: peer closed without reset\n",
+					__func__);
+				return 1;
+			}
+
+			do_write(outfd, buf, len);
+		}
+
+		close(peerfd);
+		return 0;
+	}
+
+	while ((len = read(infd, buf, sizeof(buf))) > 0) {
+		if (do_write(peerfd, buf, len) != len)
+			return 1;
+	}
+
+	/* leave some time for the joins, too */
+	if (cfg_wait)
+		usleep(cfg_wait);
+
+	/* disconnecting an MPTCP socket is refused */
+	if (cfg_sock_proto == IPPROTO_MPTCP &&
+	    (!connect(peerfd, &addr, sizeof(addr)) || errno != EOPNOTSUPP)) {
+		fprintf(stderr, "%s: connect(AF_UNSPEC) not refused\n",
+			__func__);
+		return 1;
+	}
+
+	if (setsockopt(peerfd, SOL_SOCKET, SO_LINGER, &linger,
+		       sizeof(linger))) {
+		perror("set SO_LINGER");
+		return 1;
+	}
+
+	close(peerfd);
+	return 0;
+}
+
 static int copyfd_io(int infd, int peerfd, int outfd)
 {
 	int file_size;
 
+	if (cfg_fastclose)
+		return copyfd_io_fastclose(infd, peerfd, outfd);
+
 	switch (cfg_mode) {
 	case CFG_MODE_POLL:
 		return copyfd_io_poll(infd, peerfd, outfd);
@@ -587,6 +1162,16 @@ static int copyfd_io(int infd, int peerfd, int outfd)
 		if (file_size < 0)
 			return file_size;
 		return copyfd_io_sendfile(infd, peerfd, outfd, file_size);
+	case CFG_MODE_SPLICE:
+		file_size = get_infd_size(infd);
+		if (file_size < 0)
+			return file_size;
+		return copyfd_io_splice(infd, peerfd, outfd, file_size);
+	case CFG_MODE_ZEROCOPY:
+		file_size = get_infd_size(infd);
+		if (file_size < 0)
+			return file_size;
+		return copyfd_io_zerocopy(infd, peerfd, outfd, file_size);
 	}
 
 	fprintf(stderr, "Invalid mode %d\n", cfg_mode);
@@ -755,6 +1340,8 @@ int main_loop(void)
 		set_rcvbuf(fd, cfg_rcvbuf);
 	if (cfg_sndbuf)
 		set_sndbuf(fd, cfg_sndbuf);
+	if (cfg_sched)
+		set_sched(fd, cfg_sched);
 
 	return copyfd_io(0, fd, 1);
 }
@@ -781,12 +1368,18 @@ int parse_mode(const char *mode)
 		return CFG_MODE_MMAP;
 	if (!strcasecmp(mode, "sendfile"))
 		return CFG_MODE_SENDFILE;
+	if (!strcasecmp(mode, "splice"))
+		return CFG_MODE_SPLICE;
+	if (!strcasecmp(mode, "zerocopy"))
+		return CFG_MODE_ZEROCOPY;
 
 	fprintf(stderr, "Unknown test mode: %s\n", mode);
 	fprintf(stderr, "Supported modes are:\n");
 	fprintf(stderr, "\t\t\"poll\" - interleaved read/write using poll()\n");
 	fprintf(stderr, "\t\t\"mmap\" - send entire input file (mmap+write), then read response (-l will read input first)\n");
 	fprintf(stderr, "\t\t\"sendfile\" - send entire input file (sendfile), then read response (-l will read input first)\n");
+	fprintf(stderr, "\t\t\"splice\" - send entire input file (sendfile), then splice the response to the output (-l will read input first)\n");
+	fprintf(stderr, "\t\t\"zerocopy\" - send entire input file (mmap+MSG_ZEROCOPY) and wait for all completions, then receive the response with TCP_ZEROCOPY_RECEIVE (-l will read input first)\n");
 
 	die_usage();
 
@@ -821,7 +1414,7 @@ static void parse_opts(int argc, char **argv)
 {
 	int c;
 
-	while ((c = getopt(argc, argv, "6jlp:s:hut:m:S:R:w:")) != -1) {
+	while ((c = getopt(argc, argv, "6jlp:s:hut:m:S:R:w:P:oFi:")) != -1) {
 		switch (c) {
 		case 'j':
 			cfg_join = true;
@@ -863,6 +1456,18 @@ static void parse_opts(int argc, char **argv)
 		case 'w':
 			cfg_wait = atoi(optarg)*1000000;
 			break;
+		case 'P':
+			cfg_sched = optarg;
+			break;
+		case 'o':
+			cfg_fastopen = true;
+			break;
+		case 'F':
+			cfg_fastclose = true;
+			break;
+		case 'i':
+			cfg_info_subflows = parse_int(optarg);
+			break;
 		}
 	}
 
@@ -894,6 +1499,8 @@ int main(int argc, char *argv[])
 			set_rcvbuf(fd, cfg_rcvbuf);
 		if (cfg_sndbuf)
 			set_sndbuf(fd, cfg_sndbuf);
+		if (cfg_sched)
+			set_sched(fd, cfg_sched);
 
 		return main_loop_s(fd);
 	}
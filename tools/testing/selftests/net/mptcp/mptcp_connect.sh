@@ -3,7 +3,7 @@
 
 time_start=$(date +%s)
 
-optstring="S:R:d:e:l:r:h4cm:f:t"
+optstring="S:R:d:e:l:r:h4cm:f:tP:o"
 ret=0
 sin=""
 sout=""
@@ -18,6 +18,8 @@ tc_delay="$((RANDOM%400))"
 tc_loss=$((RANDOM%101))
 tc_reorder=""
 testmode=""
+sched=""
+fastopen=false
 sndbuf=0
 rcvbuf=0
 options_log=true
@@ -45,8 +47,10 @@ usage() {
 	echo -e "\t-f: size of file to transfer in bytes (default random)"
 	echo -e "\t-S: set sndbuf value (default: use kernel default)"
 	echo -e "\t-R: set rcvbuf value (default: use kernel default)"
-	echo -e "\t-m: test mode (poll, sendfile; default: poll)"
+	echo -e "\t-m: test mode (poll, sendfile, splice, zerocopy; default: poll)"
 	echo -e "\t-t: also run tests with TCP (use twice to non-fallback tcp)"
+	echo -e "\t-P: MPTCP packet scheduler (default: use net.mptcp.scheduler)"
+	echo -e "\t-o: use TCP Fast Open on the initial subflow"
 }
 
 while getopts "$optstring" option;do
@@ -104,6 +108,12 @@ while getopts "$optstring" option;do
 	"t")
 		do_tcp=$((do_tcp+1))
 		;;
+	"P")
+		sched="$OPTARG"
+		;;
+	"o")
+		fastopen=true
+		;;
 	"?")
 		usage $0
 		exit 1
@@ -148,6 +158,9 @@ trap cleanup EXIT
 for i in "$ns1" "$ns2" "$ns3" "$ns4";do
 	ip netns add $i || exit $ksft_skip
 	ip -net $i link set lo up
+	if $fastopen; then
+		ip netns exec $i sysctl -q net.ipv4.tcp_fastopen=3
+	fi
 done
 
 #  "$ns1"              ns2                    ns3                     ns4
@@ -374,6 +387,14 @@ do_transfer()
 		extra_args="$extra_args -m $testmode"
 	fi
 
+	if [ -n "$sched" ]; then
+		extra_args="$extra_args -P $sched"
+	fi
+
+	if $fastopen; then
+		extra_args="$extra_args -o"
+	fi
+
 	if [ -n "$extra_args" ] && $options_log; then
 		options_log=false
 		echo "INFO: extra options: $extra_args"
@@ -555,6 +576,18 @@ run_tests()
 	run_tests_lo $1 $2 $3 0
 }
 
+# $1: test mode, run on loopback only
+run_tests_mode()
+{
+	local old_testmode="$testmode"
+
+	testmode="$1"
+	echo "INFO: loopback tests with mode $testmode"
+	run_tests_lo "$ns1" "$ns1" 10.0.1.1 1
+	run_tests_lo "$ns1" "$ns1" dead:beef:1::1 1
+	testmode="$old_testmode"
+}
+
 make_file "$cin" "client"
 make_file "$sin" "server"
 
@@ -632,6 +665,13 @@ for sender in $ns1 $ns2 $ns3 $ns4;do
 	run_tests "$ns4" $sender dead:beef:3::1
 done
 
+# sendfile() goes through the MPTCP sendpage, zerocopy checks that every
+# MSG_ZEROCOPY send gets its completion notification
+if [ -z "$testmode" ]; then
+	run_tests_mode sendfile
+	run_tests_mode zerocopy
+fi
+
 time_end=$(date +%s)
 time_run=$((time_end-time_start))
 
@@ -72,6 +72,15 @@ reset()
 	init
 }
 
+reset_with_cookies()
+{
+	reset
+
+	for netns in "$ns1" "$ns2";do
+		ip netns exec $netns sysctl -q net.ipv4.tcp_syncookies=2
+	done
+}
+
 for arg in "$@"; do
 	if [ "$arg" = "-c" ]; then
 		capture=1
@@ -123,6 +132,19 @@ do_transfer()
 	cl_proto="$3"
 	srv_proto="$4"
 	connect_addr="$5"
+	rm_nr_ns1="$6"
+	mode="$7"
+	mode_args=""
+	cl_args=""
+
+	if [ "$mode" = "fastclose" ]; then
+		mode_args="-F"
+	elif [ "${mode%%=*}" = "info" ]; then
+		# info=<n>: the client checks MPTCP_[FULL_]INFO with n subflows
+		cl_args="-i ${mode#info=}"
+	elif [ -n "$mode" ]; then
+		mode_args="-m $mode"
+	fi
 
 	port=$((10000+$TEST_COUNT))
 	TEST_COUNT=$((TEST_COUNT+1))
@@ -147,14 +169,22 @@ do_transfer()
 		sleep 1
 	fi
 
-	ip netns exec ${listener_ns} ./mptcp_connect -j -t $timeout -l -p $port -s ${srv_proto} 0.0.0.0 < "$sin" > "$sout" &
+	ip netns exec ${listener_ns} ./mptcp_connect -j $mode_args -t $timeout -l -p $port -s ${srv_proto} 0.0.0.0 < "$sin" > "$sout" &
 	spid=$!
 
 	sleep 1
 
-	ip netns exec ${connector_ns} ./mptcp_connect -j -t $timeout -p $port -s ${cl_proto} $connect_addr < "$cin" > "$cout" &
+	ip netns exec ${connector_ns} ./mptcp_connect -j $mode_args $cl_args -t $timeout -p $port -s ${cl_proto} $connect_addr < "$cin" > "$cout" &
 	cpid=$!
 
+	# withdraw the listener endpoints while the join subflows are in use
+	if [ -n "$rm_nr_ns1" ] && [ $rm_nr_ns1 -gt 0 ]; then
+		sleep 0.5
+		for id in $(seq $rm_nr_ns1); do
+			ip netns exec ${listener_ns} ./pm_nl_ctl del $id
+		done
+	fi
+
 	wait $cpid
 	retc=$?
 	wait $spid
@@ -176,6 +206,12 @@ do_transfer()
 		return 1
 	fi
 
+	# the client aborts the connection: nothing is sent back
+	if [ "$mode" = "fastclose" ]; then
+		cat "$capout"
+		return 0
+	fi
+
 	check_transfer $sin $cout "file received by client"
 	retc=$?
 	check_transfer $cin $sout "file received by server"
@@ -195,7 +231,7 @@ make_file()
 	name=$1
 	who=$2
 
-	SIZE=1
+	SIZE=${3:-1}
 
 	dd if=/dev/urandom of="$name" bs=1024 count=$SIZE 2> /dev/null
 	echo -e "\nMPTCP_TEST_FILE_END_MARKER" >> "$name"
@@ -208,9 +244,11 @@ run_tests()
 	listener_ns="$1"
 	connector_ns="$2"
 	connect_addr="$3"
+	rm_nr_ns1="${4:-0}"
+	mode="$5"
 	lret=0
 
-	do_transfer ${listener_ns} ${connector_ns} MPTCP MPTCP ${connect_addr}
+	do_transfer ${listener_ns} ${connector_ns} MPTCP MPTCP ${connect_addr} ${rm_nr_ns1} ${mode}
 	lret=$?
 	if [ $lret -ne 0 ]; then
 		ret=$lret
@@ -267,6 +305,116 @@ chk_join_nr()
 	fi
 }
 
+chk_add_nr()
+{
+	local add_nr=$1
+	local echo_nr=$2
+	local count
+	local dump_stats
+
+	printf "%-36s %s" " " "add"
+	count=`ip netns exec $ns2 nstat -as | awk '$1 == "MPTcpExtAddAddr" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" != "$add_nr" ]; then
+		echo "[fail] got $count ADD_ADDR[s] expected $add_nr"
+		ret=1
+		dump_stats=1
+	else
+		echo -n "[ ok ]"
+	fi
+
+	echo -n " - echo  "
+	count=`ip netns exec $ns1 nstat -as | awk '$1 == "MPTcpExtEchoAdd" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" != "$echo_nr" ]; then
+		echo "[fail] got $count ADD_ADDR echo[s] expected $echo_nr"
+		ret=1
+		dump_stats=1
+	else
+		echo "[ ok ]"
+	fi
+	if [ "${dump_stats}" = 1 ]; then
+		echo Server ns stats
+		ip netns exec $ns1 nstat -as | grep MPTcp
+		echo Client ns stats
+		ip netns exec $ns2 nstat -as | grep MPTcp
+	fi
+}
+
+chk_rm_nr()
+{
+	local rm_addr_nr=$1
+	local rm_subflow_nr=$2
+	local count
+	local dump_stats
+
+	printf "%-36s %s" " " "rm "
+	count=`ip netns exec $ns2 nstat -as | awk '$1 == "MPTcpExtRmAddr" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" != "$rm_addr_nr" ]; then
+		echo "[fail] got $count RM_ADDR[s] expected $rm_addr_nr"
+		ret=1
+		dump_stats=1
+	else
+		echo -n "[ ok ]"
+	fi
+
+	echo -n " - sf    "
+	count=`ip netns exec $ns2 nstat -as | awk '$1 == "MPTcpExtRmSubflow" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" != "$rm_subflow_nr" ]; then
+		echo "[fail] got $count RM_SUBFLOW[s] expected $rm_subflow_nr"
+		ret=1
+		dump_stats=1
+	else
+		echo "[ ok ]"
+	fi
+	if [ "${dump_stats}" = 1 ]; then
+		echo Server ns stats
+		ip netns exec $ns1 nstat -as | grep MPTcp
+		echo Client ns stats
+		ip netns exec $ns2 nstat -as | grep MPTcp
+	fi
+}
+
+# $1: MP_FASTCLOSE sent by the client, $2: minimum received by the server,
+# it may reset its other subflows before the late RSTs reach them
+chk_fclose_nr()
+{
+	local fclose_tx=$1
+	local fclose_rx=$2
+	local count
+	local dump_stats
+
+	printf "%-36s %s" " " "fctx"
+	count=`ip netns exec $ns2 nstat -as | awk '$1 == "MPTcpExtMPFastcloseTx" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" != "$fclose_tx" ]; then
+		echo "[fail] got $count MP_FASTCLOSE[s] TX expected $fclose_tx"
+		ret=1
+		dump_stats=1
+	else
+		echo -n "[ ok ]"
+	fi
+
+	echo -n " - fcrx  "
+	count=`ip netns exec $ns1 nstat -as | awk '$1 == "MPTcpExtMPFastcloseRx" {print $2}'`
+	[ -z "$count" ] && count=0
+	if [ "$count" -lt "$fclose_rx" ]; then
+		echo "[fail] got $count MP_FASTCLOSE[s] RX expected at least $fclose_rx"
+		ret=1
+		dump_stats=1
+	else
+		echo "[ ok ]"
+	fi
+	if [ "${dump_stats}" = 1 ]; then
+		echo Server ns stats
+		ip netns exec $ns1 nstat -as | grep MPTcp
+		echo Client ns stats
+		ip netns exec $ns2 nstat -as | grep MPTcp
+	fi
+}
+
 sin=$(mktemp)
 sout=$(mktemp)
 cin=$(mktemp)
@@ -309,6 +457,16 @@ ip netns exec $ns2 ./pm_nl_ctl add 10.0.2.2 flags subflow
 run_tests $ns1 $ns2 10.0.1.1
 chk_join_nr "multiple subflows" 2 2 2
 
+# MPTCP_INFO and MPTCP_FULL_INFO, with more subflows than the room
+# provided for them by the client
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.2.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1 0 info=3
+chk_join_nr "MPTCP_INFO and MPTCP_FULL_INFO" 2 2 2
+
 # multiple subflows limited by serverf
 reset
 ip netns exec $ns1 ./pm_nl_ctl limits 0 1
@@ -331,6 +489,26 @@ ip netns exec $ns2 ./pm_nl_ctl limits 1 1
 ip netns exec $ns1 ./pm_nl_ctl add 10.0.2.1 flags signal
 run_tests $ns1 $ns2 10.0.1.1
 chk_join_nr "signal address" 1 1 1
+chk_add_nr 1 1
+
+# the announced port is served by a dedicated in-kernel listener
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl limits 1 1
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.2.1 flags signal port 10100
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "signal address with port" 1 1 1
+chk_add_nr 1 1
+
+# removing the signaled endpoint closes the subflow created towards it
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl limits 1 1
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.2.1 flags signal
+run_tests $ns1 $ns2 10.0.1.1 1
+chk_join_nr "remove signal address" 1 1 1
+chk_add_nr 1 1
+chk_rm_nr 1 1
 
 # accept and use add_addr with an additional subflow
 # note: signal address in server ns and local addresses in client ns must
@@ -354,4 +532,75 @@ ip netns exec $ns2 ./pm_nl_ctl add 10.0.4.2 flags subflow
 run_tests $ns1 $ns2 10.0.1.1
 chk_join_nr "multiple subflows and signal" 3 3 3
 
+# fullmesh endpoint connects to both the initial and the announced address
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 2
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.2.1 flags signal
+ip netns exec $ns2 ./pm_nl_ctl limits 1 2
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow,fullmesh
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "fullmesh subflow and signal" 2 2 2
+
+# ndiffports endpoint opens subflows on the same path up to the limit
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 3
+ip netns exec $ns2 ./pm_nl_ctl limits 0 3
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.1.2 flags subflow,ndiffports
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "ndiffports subflows" 3 3 3
+
+# both the MP_CAPABLE and the MP_JOIN handshakes survive syncookies
+reset_with_cookies
+ip netns exec $ns1 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "single subflow with syn cookies" 1 1 1
+
+reset_with_cookies
+ip netns exec $ns1 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.2.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "multiple subflows with syn cookies" 2 2 2
+
+# the join state stored with the cookie is still validated on the
+# third ACK: the server limit must be enforced
+reset_with_cookies
+ip netns exec $ns1 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.2.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1
+chk_join_nr "subflows limited by server with syn cookies" 2 2 1
+
+# abortive close: SO_LINGER with zero timeout sends MP_FASTCLOSE on every
+# subflow and the server sees the connection reset
+reset
+run_tests $ns1 $ns2 10.0.1.1 0 fastclose
+chk_join_nr "fastclose" 0 0 0
+chk_fclose_nr 1 1
+
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl limits 0 1
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1 0 fastclose
+chk_join_nr "fastclose with subflow" 1 1 1
+chk_fclose_nr 2 1
+
+# zerocopy receive: the data moved to the msk from all the subflows is
+# remapped in a single vma, across skbs coming from different subflows.
+# Large enough files so that the joins complete early in the transfer.
+make_file "$cin" "client" 16384
+make_file "$sin" "server" 16384
+reset
+ip netns exec $ns1 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl limits 0 2
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.3.2 flags subflow
+ip netns exec $ns2 ./pm_nl_ctl add 10.0.2.2 flags subflow
+run_tests $ns1 $ns2 10.0.1.1 0 zerocopy
+chk_join_nr "multiple subflows, zerocopy receive" 2 2 2
+
 exit $ret
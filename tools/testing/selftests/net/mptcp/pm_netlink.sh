@@ -112,9 +112,37 @@ id 6 flags signal 10.0.1.6
 id 7 flags signal 10.0.1.7
 id 8 flags signal 10.0.1.8" "id limit"
 
+ip netns exec $ns1 ./pm_nl_ctl set 4 backup
+check "ip netns exec $ns1 ./pm_nl_ctl get 4" "id 4 flags signal,backup 10.0.1.4" "set backup flag"
+ip netns exec $ns1 ./pm_nl_ctl set 3 nobackup
+check "ip netns exec $ns1 ./pm_nl_ctl get 3" "id 3 flags signal 10.0.1.3" "clear backup flag"
+
 ip netns exec $ns1 ./pm_nl_ctl flush
 check "ip netns exec $ns1 ./pm_nl_ctl dump" "" "flush addrs"
 
+# ids are not reset by flush, look them up
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.1.1 flags subflow,fullmesh
+id=`ip netns exec $ns1 ./pm_nl_ctl dump | cut -d' ' -f2`
+check "ip netns exec $ns1 ./pm_nl_ctl get $id" "id $id flags subflow,fullmesh 10.0.1.1" "fullmesh endpoint"
+ip netns exec $ns1 ./pm_nl_ctl flush
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.1.2 flags subflow,ndiffports
+id=`ip netns exec $ns1 ./pm_nl_ctl dump | cut -d' ' -f2`
+check "ip netns exec $ns1 ./pm_nl_ctl get $id" "id $id flags subflow,ndiffports 10.0.1.2" "ndiffports endpoint"
+ip netns exec $ns1 ./pm_nl_ctl flush
+ip netns exec $ns1 ./pm_nl_ctl add 10.0.1.3 flags signal,fullmesh 2>/dev/null
+check "ip netns exec $ns1 ./pm_nl_ctl dump" "" "fullmesh requires subflow"
+
+ip netns exec $ns1 ./pm_nl_ctl add 127.0.0.1 flags signal port 10100
+id=`ip netns exec $ns1 ./pm_nl_ctl dump | cut -d' ' -f2`
+check "ip netns exec $ns1 ./pm_nl_ctl get $id" "id $id flags signal port 10100 127.0.0.1" "signal endpoint with port"
+ip netns exec $ns1 ./pm_nl_ctl del $id
+ip netns exec $ns1 ./pm_nl_ctl add 127.0.0.1 flags signal,subflow port 10101 2>/dev/null
+check "ip netns exec $ns1 ./pm_nl_ctl dump" "" "port requires signal only"
+ip netns exec $ns1 ./pm_nl_ctl add 127.0.0.1 flags signal port 10100
+id=`ip netns exec $ns1 ./pm_nl_ctl dump | cut -d' ' -f2`
+check "ip netns exec $ns1 ./pm_nl_ctl get $id" "id $id flags signal port 10100 127.0.0.1" "port released on delete"
+ip netns exec $ns1 ./pm_nl_ctl flush
+
 ip netns exec $ns1 ./pm_nl_ctl limits 9 1
 check "ip netns exec $ns1 ./pm_nl_ctl limits" "accept 0
 subflows 0" "rcv addrs above hard limit"
@@ -127,4 +155,23 @@ ip netns exec $ns1 ./pm_nl_ctl limits 8 8
 check "ip netns exec $ns1 ./pm_nl_ctl limits" "accept 8
 subflows 8" "set limits"
 
+ip netns exec $ns1 sysctl -q net.mptcp.pm_type=1
+check "ip netns exec $ns1 sysctl -n net.mptcp.pm_type" "1" "userspace pm type"
+
+printf "%-50s %s" "announce on unknown token"
+if ip netns exec $ns1 ./pm_nl_ctl ann 10.0.1.1 id 1 token 1 2>/dev/null; then
+	echo "[FAIL] command succeeded"
+	ret=1
+else
+	echo "[ OK ]"
+fi
+
+printf "%-50s %s" "create subflow on unknown token"
+if ip netns exec $ns1 ./pm_nl_ctl csf lip 10.0.1.1 rip 10.0.1.2 token 1 2>/dev/null; then
+	echo "[FAIL] command succeeded"
+	ret=1
+else
+	echo "[ OK ]"
+fi
+
 exit $ret
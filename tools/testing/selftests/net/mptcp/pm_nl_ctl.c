@@ -9,6 +9,7 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <limits.h>
 
 #include <arpa/inet.h>
 #include <net/if.h>
@@ -21,16 +22,24 @@
 #ifndef MPTCP_PM_NAME
 #define MPTCP_PM_NAME		"mptcp_pm"
 #endif
+#ifndef MPTCP_PM_EV_GRP_NAME
+#define MPTCP_PM_EV_GRP_NAME	"mptcp_pm_events"
+#endif
 
 static void syntax(char *argv[])
 {
-	fprintf(stderr, "%s add|get|del|flush|dump|accept [<args>]\n", argv[0]);
-	fprintf(stderr, "\tadd [flags signal|subflow|backup] [id <nr>] [dev <name>] <ip>\n");
+	fprintf(stderr, "%s add|get|set|del|flush|dump|accept|ann|csf|dsf|events [<args>]\n", argv[0]);
+	fprintf(stderr, "\tadd [flags signal|subflow|backup|fullmesh|ndiffports] [id <nr>] [dev <name>] [port <nr>] <ip>\n");
 	fprintf(stderr, "\tdel <id>\n");
 	fprintf(stderr, "\tget <id>\n");
+	fprintf(stderr, "\tset <id> backup|nobackup\n");
 	fprintf(stderr, "\tflush\n");
 	fprintf(stderr, "\tdump\n");
 	fprintf(stderr, "\tlimits [<rcv addr max> <subflow max>]\n");
+	fprintf(stderr, "\tann <ip> id <id> token <token> [port <nr>]\n");
+	fprintf(stderr, "\tcsf lip <ip> [lid <id>] rip <ip> [rport <nr>] token <token>\n");
+	fprintf(stderr, "\tdsf lip <ip> lport <nr> rip <ip> rport <nr> token <token>\n");
+	fprintf(stderr, "\tevents\n");
 	exit(0);
 }
 
@@ -106,8 +115,13 @@ static int do_nl_req(int fd, struct nlmsghdr *nh, int len, int max)
 	/* Beware: the NLMSG_NEXT macro updates the 'rem' argument */
 	for (; NLMSG_OK(nh, rem); nh = NLMSG_NEXT(nh, rem)) {
 		if (nh->nlmsg_type == NLMSG_ERROR) {
+			struct nlmsgerr *nlerr = NLMSG_DATA(nh);
+
 			nl_error(nh);
-			err = 1;
+
+			/* a zero error code is a plain ack */
+			if (nlerr->error)
+				err = 1;
 		}
 	}
 	if (err)
@@ -115,11 +129,36 @@ static int do_nl_req(int fd, struct nlmsghdr *nh, int len, int max)
 	return ret;
 }
 
+static int events_mcast_grp;
+
+static void genl_parse_mcast_grps(struct rtattr *nest)
+{
+	struct rtattr *grp = RTA_DATA(nest);
+	int len = RTA_PAYLOAD(nest);
+
+	for (; RTA_OK(grp, len); grp = RTA_NEXT(grp, len)) {
+		struct rtattr *attrs = RTA_DATA(grp);
+		int alen = RTA_PAYLOAD(grp);
+		const char *name = NULL;
+		int id = 0;
+
+		for (; RTA_OK(attrs, alen); attrs = RTA_NEXT(attrs, alen)) {
+			if (attrs->rta_type == CTRL_ATTR_MCAST_GRP_NAME)
+				name = RTA_DATA(attrs);
+			if (attrs->rta_type == CTRL_ATTR_MCAST_GRP_ID)
+				id = *(__u32 *)RTA_DATA(attrs);
+		}
+		if (name && !strcmp(name, MPTCP_PM_EV_GRP_NAME))
+			events_mcast_grp = id;
+	}
+}
+
 static int genl_parse_getfamily(struct nlmsghdr *nlh)
 {
 	struct genlmsghdr *ghdr = NLMSG_DATA(nlh);
 	int len = nlh->nlmsg_len;
 	struct rtattr *attrs;
+	int family = -1;
 
 	if (nlh->nlmsg_type != GENL_ID_CTRL)
 		error(1, errno, "Not a controller message, len=%d type=0x%x\n",
@@ -136,12 +175,15 @@ static int genl_parse_getfamily(struct nlmsghdr *nlh)
 	attrs = (struct rtattr *) ((char *) ghdr + GENL_HDRLEN);
 	while (RTA_OK(attrs, len)) {
 		if (attrs->rta_type == CTRL_ATTR_FAMILY_ID)
-			return *(__u16 *)RTA_DATA(attrs);
+			family = *(__u16 *)RTA_DATA(attrs);
+		if (attrs->rta_type == CTRL_ATTR_MCAST_GROUPS)
+			genl_parse_mcast_grps(attrs);
 		attrs = RTA_NEXT(attrs, len);
 	}
 
-	error(1, errno, "can't find CTRL_ATTR_FAMILY_ID attr");
-	return -1;
+	if (family < 0)
+		error(1, errno, "can't find CTRL_ATTR_FAMILY_ID attr");
+	return family;
 }
 
 static int resolve_mptcp_pm_netlink(int fd)
@@ -236,6 +278,10 @@ int add_addr(int fd, int pm_family, int argc, char *argv[])
 					flags |= MPTCP_PM_ADDR_FLAG_SIGNAL;
 				else if (!strcmp(tok, "backup"))
 					flags |= MPTCP_PM_ADDR_FLAG_BACKUP;
+				else if (!strcmp(tok, "fullmesh"))
+					flags |= MPTCP_PM_ADDR_FLAG_FULLMESH;
+				else if (!strcmp(tok, "ndiffports"))
+					flags |= MPTCP_PM_ADDR_FLAG_NDIFFPORTS;
 				else
 					error(1, errno,
 					      "unknown flag %s", argv[arg]);
@@ -271,6 +317,18 @@ int add_addr(int fd, int pm_family, int argc, char *argv[])
 			rta->rta_len = RTA_LENGTH(4);
 			memcpy(RTA_DATA(rta), &ifindex, 4);
 			off += NLMSG_ALIGN(rta->rta_len);
+		} else if (!strcmp(argv[arg], "port")) {
+			u_int16_t port;
+
+			if (++arg >= argc)
+				error(1, 0, " missing port value");
+
+			port = atoi(argv[arg]);
+			rta = (void *)(data + off);
+			rta->rta_type = MPTCP_PM_ADDR_ATTR_PORT;
+			rta->rta_len = RTA_LENGTH(2);
+			memcpy(RTA_DATA(rta), &port, 2);
+			off += NLMSG_ALIGN(rta->rta_len);
 		} else
 			error(1, 0, "unknown keyword %s", argv[arg]);
 	}
@@ -320,6 +378,56 @@ int del_addr(int fd, int pm_family, int argc, char *argv[])
 	return 0;
 }
 
+int set_flags(int fd, int pm_family, int argc, char *argv[])
+{
+	char data[NLMSG_ALIGN(sizeof(struct nlmsghdr)) +
+		  NLMSG_ALIGN(sizeof(struct genlmsghdr)) +
+		  1024];
+	struct rtattr *rta, *nest;
+	struct nlmsghdr *nh;
+	u_int32_t flags = 0;
+	int nest_start;
+	u_int8_t id;
+	int off = 0;
+
+	memset(data, 0, sizeof(data));
+	nh = (void *)data;
+	off = init_genl_req(data, pm_family, MPTCP_PM_CMD_SET_FLAGS,
+			    MPTCP_PM_VER);
+
+	/* the address id and the new backup status */
+	if (argc != 4)
+		syntax(argv);
+
+	id = atoi(argv[2]);
+	if (!strcmp(argv[3], "backup"))
+		flags = MPTCP_PM_ADDR_FLAG_BACKUP;
+	else if (strcmp(argv[3], "nobackup"))
+		error(1, 0, "unknown flag %s", argv[3]);
+
+	nest_start = off;
+	nest = (void *)(data + off);
+	nest->rta_type = NLA_F_NESTED | MPTCP_PM_ATTR_ADDR;
+	nest->rta_len =  RTA_LENGTH(0);
+	off += NLMSG_ALIGN(nest->rta_len);
+
+	rta = (void *)(data + off);
+	rta->rta_type = MPTCP_PM_ADDR_ATTR_ID;
+	rta->rta_len = RTA_LENGTH(1);
+	memcpy(RTA_DATA(rta), &id, 1);
+	off += NLMSG_ALIGN(rta->rta_len);
+
+	rta = (void *)(data + off);
+	rta->rta_type = MPTCP_PM_ADDR_ATTR_FLAGS;
+	rta->rta_len = RTA_LENGTH(4);
+	memcpy(RTA_DATA(rta), &flags, 4);
+	off += NLMSG_ALIGN(rta->rta_len);
+	nest->rta_len = off - nest_start;
+
+	do_nl_req(fd, nh, off, 0);
+	return 0;
+}
+
 static void print_addr(struct rtattr *attrs, int len)
 {
 	uint16_t family = 0;
@@ -373,11 +481,31 @@ static void print_addr(struct rtattr *attrs, int len)
 					printf(",");
 			}
 
+			if (flags & MPTCP_PM_ADDR_FLAG_FULLMESH) {
+				printf("fullmesh");
+				flags &= ~MPTCP_PM_ADDR_FLAG_FULLMESH;
+				if (flags)
+					printf(",");
+			}
+
+			if (flags & MPTCP_PM_ADDR_FLAG_NDIFFPORTS) {
+				printf("ndiffports");
+				flags &= ~MPTCP_PM_ADDR_FLAG_NDIFFPORTS;
+				if (flags)
+					printf(",");
+			}
+
 			/* bump unknown flags, if any */
 			if (flags)
 				printf("0x%x", flags);
 			printf(" ");
 		}
+		if (attrs->rta_type == MPTCP_PM_ADDR_ATTR_PORT) {
+			uint16_t port;
+
+			memcpy(&port, RTA_DATA(attrs), 2);
+			printf("port %u ", port);
+		}
 		if (attrs->rta_type == MPTCP_PM_ADDR_ATTR_IF_IDX) {
 			char name[IF_NAMESIZE], *ret;
 			int32_t ifindex;
@@ -584,6 +712,256 @@ int get_set_limits(int fd, int pm_family, int argc, char *argv[])
 	return 0;
 }
 
+/* append a nested address of the given type, id and port are optional */
+static int append_addr(char *data, int off, int type, const char *ip,
+		       u_int8_t id, u_int16_t port)
+{
+	struct rtattr *rta, *nest;
+	u_int16_t family;
+	int nest_start;
+
+	nest_start = off;
+	nest = (void *)(data + off);
+	nest->rta_type = NLA_F_NESTED | type;
+	nest->rta_len = RTA_LENGTH(0);
+	off += NLMSG_ALIGN(nest->rta_len);
+
+	rta = (void *)(data + off);
+	if (inet_pton(AF_INET, ip, RTA_DATA(rta))) {
+		family = AF_INET;
+		rta->rta_type = MPTCP_PM_ADDR_ATTR_ADDR4;
+		rta->rta_len = RTA_LENGTH(4);
+	} else if (inet_pton(AF_INET6, ip, RTA_DATA(rta))) {
+		family = AF_INET6;
+		rta->rta_type = MPTCP_PM_ADDR_ATTR_ADDR6;
+		rta->rta_len = RTA_LENGTH(16);
+	} else
+		error(1, errno, "can't parse ip %s", ip);
+	off += NLMSG_ALIGN(rta->rta_len);
+
+	rta = (void *)(data + off);
+	rta->rta_type = MPTCP_PM_ADDR_ATTR_FAMILY;
+	rta->rta_len = RTA_LENGTH(2);
+	memcpy(RTA_DATA(rta), &family, 2);
+	off += NLMSG_ALIGN(rta->rta_len);
+
+	if (id) {
+		rta = (void *)(data + off);
+		rta->rta_type = MPTCP_PM_ADDR_ATTR_ID;
+		rta->rta_len = RTA_LENGTH(1);
+		memcpy(RTA_DATA(rta), &id, 1);
+		off += NLMSG_ALIGN(rta->rta_len);
+	}
+
+	if (port) {
+		rta = (void *)(data + off);
+		rta->rta_type = MPTCP_PM_ADDR_ATTR_PORT;
+		rta->rta_len = RTA_LENGTH(2);
+		memcpy(RTA_DATA(rta), &port, 2);
+		off += NLMSG_ALIGN(rta->rta_len);
+	}
+
+	nest->rta_len = off - nest_start;
+	return off;
+}
+
+static int append_token(char *data, int off, u_int32_t token)
+{
+	struct rtattr *rta = (void *)(data + off);
+
+	rta->rta_type = MPTCP_PM_ATTR_TOKEN;
+	rta->rta_len = RTA_LENGTH(4);
+	memcpy(RTA_DATA(rta), &token, 4);
+	return off + NLMSG_ALIGN(rta->rta_len);
+}
+
+static u_int32_t parse_token(const char *str)
+{
+	unsigned long token;
+	char *end;
+
+	errno = 0;
+	token = strtoul(str, &end, 10);
+	if (errno || *end || !token || token > UINT_MAX)
+		error(1, 0, "invalid token %s", str);
+	return token;
+}
+
+int announce_addr(int fd, int pm_family, int argc, char *argv[])
+{
+	char data[NLMSG_ALIGN(sizeof(struct nlmsghdr)) +
+		  NLMSG_ALIGN(sizeof(struct genlmsghdr)) +
+		  1024];
+	u_int32_t token = 0;
+	struct nlmsghdr *nh;
+	u_int16_t port = 0;
+	u_int8_t id = 0;
+	int off = 0;
+	int arg;
+
+	if (argc < 3)
+		syntax(argv);
+
+	for (arg = 3; arg < argc; arg++) {
+		if (++arg >= argc)
+			error(1, 0, " missing %s value", argv[arg - 1]);
+
+		if (!strcmp(argv[arg - 1], "id"))
+			id = atoi(argv[arg]);
+		else if (!strcmp(argv[arg - 1], "token"))
+			token = parse_token(argv[arg]);
+		else if (!strcmp(argv[arg - 1], "port"))
+			port = atoi(argv[arg]);
+		else
+			error(1, 0, "unknown keyword %s", argv[arg - 1]);
+	}
+	if (!id || !token)
+		error(1, 0, " id and token are required");
+
+	memset(data, 0, sizeof(data));
+	nh = (void *)data;
+	off = init_genl_req(data, pm_family, MPTCP_PM_CMD_ANNOUNCE,
+			    MPTCP_PM_VER);
+	nh->nlmsg_flags |= NLM_F_ACK;
+
+	off = append_addr(data, off, MPTCP_PM_ATTR_ADDR, argv[2], id, port);
+	off = append_token(data, off, token);
+
+	do_nl_req(fd, nh, off, sizeof(data));
+	return 0;
+}
+
+/* create or destroy the subflow specified by the given endpoints */
+int subflow_cmd(int fd, int pm_family, int cmd, int argc, char *argv[])
+{
+	char data[NLMSG_ALIGN(sizeof(struct nlmsghdr)) +
+		  NLMSG_ALIGN(sizeof(struct genlmsghdr)) +
+		  1024];
+	u_int16_t lport = 0, rport = 0;
+	char *lip = NULL, *rip = NULL;
+	u_int32_t token = 0;
+	struct nlmsghdr *nh;
+	u_int8_t lid = 0;
+	int off = 0;
+	int arg;
+
+	for (arg = 2; arg < argc; arg++) {
+		if (++arg >= argc)
+			error(1, 0, " missing %s value", argv[arg - 1]);
+
+		if (!strcmp(argv[arg - 1], "lip"))
+			lip = argv[arg];
+		else if (!strcmp(argv[arg - 1], "lid"))
+			lid = atoi(argv[arg]);
+		else if (!strcmp(argv[arg - 1], "lport"))
+			lport = atoi(argv[arg]);
+		else if (!strcmp(argv[arg - 1], "rip"))
+			rip = argv[arg];
+		else if (!strcmp(argv[arg - 1], "rport"))
+			rport = atoi(argv[arg]);
+		else if (!strcmp(argv[arg - 1], "token"))
+			token = parse_token(argv[arg]);
+		else
+			error(1, 0, "unknown keyword %s", argv[arg - 1]);
+	}
+	if (!lip || !rip || !token)
+		error(1, 0, " lip, rip and token are required");
+	if (cmd == MPTCP_PM_CMD_SUBFLOW_DESTROY && (!lport || !rport))
+		error(1, 0, " lport and rport are required");
+
+	memset(data, 0, sizeof(data));
+	nh = (void *)data;
+	off = init_genl_req(data, pm_family, cmd, MPTCP_PM_VER);
+	nh->nlmsg_flags |= NLM_F_ACK;
+
+	off = append_addr(data, off, MPTCP_PM_ATTR_ADDR, lip, lid, lport);
+	off = append_addr(data, off, MPTCP_PM_ATTR_ADDR_REMOTE, rip, 0, rport);
+	off = append_token(data, off, token);
+
+	do_nl_req(fd, nh, off, sizeof(data));
+	return 0;
+}
+
+static void print_event(struct nlmsghdr *nh)
+{
+	struct genlmsghdr *ghdr = NLMSG_DATA(nh);
+	int len = nh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	struct rtattr *attrs;
+	char str[INET6_ADDRSTRLEN];
+	u_int16_t port;
+
+	attrs = (struct rtattr *)((char *)ghdr + GENL_HDRLEN);
+	printf("type:%d", ghdr->cmd);
+	for (; RTA_OK(attrs, len); attrs = RTA_NEXT(attrs, len)) {
+		void *val = RTA_DATA(attrs);
+
+		switch (attrs->rta_type) {
+		case MPTCP_ATTR_TOKEN:
+			printf(",token:%u", *(u_int32_t *)val);
+			break;
+		case MPTCP_ATTR_FAMILY:
+			printf(",family:%u", *(u_int16_t *)val);
+			break;
+		case MPTCP_ATTR_LOC_ID:
+			printf(",loc_id:%u", *(u_int8_t *)val);
+			break;
+		case MPTCP_ATTR_REM_ID:
+			printf(",rem_id:%u", *(u_int8_t *)val);
+			break;
+		case MPTCP_ATTR_SADDR4:
+		case MPTCP_ATTR_DADDR4:
+			inet_ntop(AF_INET, val, str, sizeof(str));
+			printf(",%caddr:%s",
+			       attrs->rta_type == MPTCP_ATTR_SADDR4 ? 's' : 'd',
+			       str);
+			break;
+		case MPTCP_ATTR_SADDR6:
+		case MPTCP_ATTR_DADDR6:
+			inet_ntop(AF_INET6, val, str, sizeof(str));
+			printf(",%caddr:%s",
+			       attrs->rta_type == MPTCP_ATTR_SADDR6 ? 's' : 'd',
+			       str);
+			break;
+		case MPTCP_ATTR_SPORT:
+		case MPTCP_ATTR_DPORT:
+			memcpy(&port, val, 2);
+			printf(",%cport:%u",
+			       attrs->rta_type == MPTCP_ATTR_SPORT ? 's' : 'd',
+			       ntohs(port));
+			break;
+		case MPTCP_ATTR_BACKUP:
+			printf(",backup:%u", *(u_int8_t *)val);
+			break;
+		}
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int capture_events(int fd)
+{
+	char buf[8192];
+	int ret;
+
+	if (!events_mcast_grp)
+		error(1, 0, "can't find the %s group", MPTCP_PM_EV_GRP_NAME);
+
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+		       &events_mcast_grp, sizeof(events_mcast_grp)) < 0)
+		error(1, errno, "can't join the %s group",
+		      MPTCP_PM_EV_GRP_NAME);
+
+	while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0) {
+		struct nlmsghdr *nh = (void *)buf;
+
+		for (; NLMSG_OK(nh, ret); nh = NLMSG_NEXT(nh, ret))
+			print_event(nh);
+	}
+
+	error(1, errno, "recv netlink");
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd, pm_family;
@@ -603,12 +981,24 @@ int main(int argc, char *argv[])
 		return del_addr(fd, pm_family, argc, argv);
 	else if (!strcmp(argv[1], "flush"))
 		return flush_addrs(fd, pm_family, argc, argv);
+	else if (!strcmp(argv[1], "set"))
+		return set_flags(fd, pm_family, argc, argv);
 	else if (!strcmp(argv[1], "get"))
 		return get_addr(fd, pm_family, argc, argv);
 	else if (!strcmp(argv[1], "dump"))
 		return dump_addrs(fd, pm_family, argc, argv);
 	else if (!strcmp(argv[1], "limits"))
 		return get_set_limits(fd, pm_family, argc, argv);
+	else if (!strcmp(argv[1], "ann"))
+		return announce_addr(fd, pm_family, argc, argv);
+	else if (!strcmp(argv[1], "csf"))
+		return subflow_cmd(fd, pm_family, MPTCP_PM_CMD_SUBFLOW_CREATE,
+				   argc, argv);
+	else if (!strcmp(argv[1], "dsf"))
+		return subflow_cmd(fd, pm_family, MPTCP_PM_CMD_SUBFLOW_DESTROY,
+				   argc, argv);
+	else if (!strcmp(argv[1], "events"))
+		return capture_events(fd);
 
 	fprintf(stderr, "unknown sub-command: %s", argv[1]);
 	syntax(argv);